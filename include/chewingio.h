@@ -28,6 +28,32 @@
 #define KEYSTROKE_BELL 4
 #define KEYSTROKE_ABSORB 8
 
+/*! \name Key codes of chewing_handle_KeyArray(), besides ASCII characters.
+ */
+
+/*@{*/
+#define CHEWING_KEY_DBLTAB	892 /**< <TT> */
+#define CHEWING_KEY_SSPACE	893 /**< <SS> */
+#define CHEWING_KEY_PPAGE	894 /**< <PU> */
+#define CHEWING_KEY_NPAGE	895 /**< <PD> */
+#define CHEWING_KEY_SLEFT	896 /**< <SL> */
+#define CHEWING_KEY_SRIGHT	897 /**< <SR> */
+#define CHEWING_KEY_LEFT	898 /**< <L> */
+#define CHEWING_KEY_RIGHT	899 /**< <R> */
+#define CHEWING_KEY_UP		990 /**< <U> */
+#define CHEWING_KEY_DOWN	991 /**< <D> */
+#define CHEWING_KEY_ENTER	992 /**< <E> */
+#define CHEWING_KEY_BACKSPACE	993 /**< <B> */
+#define CHEWING_KEY_ESC		994 /**< <EE> */
+#define CHEWING_KEY_DELETE	995 /**< <DC> */
+#define CHEWING_KEY_HOME	996 /**< <H> */
+#define CHEWING_KEY_END		997 /**< <EN> */
+#define CHEWING_KEY_TAB		998 /**< <T> */
+#define CHEWING_KEY_CAPSLOCK	999 /**< <CB> */
+#define CHEWING_KEY_CTRL_BASE	1000 /**< <C0>..<C9>, plus the ASCII code of the number */
+#define CHEWING_KEY_NUMPAD_BASE	1100 /**< <N0>..<N9>, <N+>, <N->, <N*>, <N/>, <N.> */
+/*@}*/
+
 /*! \name Series of functions handling key stroke.
  */
 
@@ -167,6 +193,60 @@ CHEWING_API int chewing_handle_DblTab( ChewingContext *ctx );
  * @param key scan code of number key
  */
 CHEWING_API int chewing_handle_Numlock( ChewingContext *ctx, int key);
+
+/**
+ * @brief Handle a sequence of key strokes
+ *
+ * The keys are handled as if passed one by one to the chewing_handle_
+ * functions, but phrasing and output are only computed when needed.
+ * Handling stops after a key that commits a string.
+ *
+ * @param ctx Chewing IM context
+ * @param keys ASCII characters and CHEWING_KEY_ codes
+ * @param nKey number of keys
+ * @return number of keys handled
+ */
+CHEWING_API int chewing_handle_KeyArray( ChewingContext *ctx, const int *keys, int nKey );
+
+/**
+ * @brief Handle a sequence of key strokes written as a string
+ *
+ * Special keys are escaped as in the CHEWING_KEY_ codes, for example
+ * "<E>" for Enter; "<<>" and "<>>" stand for '<' and '>'. Handling stops
+ * after a key that commits a string, or before a malformed escape.
+ *
+ * @param ctx Chewing IM context
+ * @param keys key strokes
+ * @return number of bytes handled
+ */
+CHEWING_API int chewing_handle_String( ChewingContext *ctx, const char *keys );
+
+/**
+ * @brief Convert Bopomofo syllables to text
+ *
+ * Syllables are separated by white space, for example "ㄘㄜˋ ㄕˋ". Anything
+ * that is not a syllable breaks the phrasing and is copied as is. The
+ * editing state of ctx is not changed, and nothing is learned, so that
+ * contexts of a ChewingEngine can convert on different threads at the same
+ * time.
+ *
+ * @param ctx Chewing IM context
+ * @param bopomofo UTF-8 encoded syllables
+ * @return converted text, to be released by chewing_free(); NULL on failure
+ */
+CHEWING_API char *chewing_convert_Bopomofo( ChewingContext *ctx, const char *bopomofo );
+
+/**
+ * @brief Convert key strokes of the keyboard layout of ctx to text
+ *
+ * Keys out of syllables break the phrasing and are copied as is. As
+ * chewing_convert_Bopomofo(), the editing state of ctx is not changed.
+ *
+ * @param ctx Chewing IM context
+ * @param keys ASCII key strokes, for example "hk4g4"
+ * @return converted text, to be released by chewing_free(); NULL on failure
+ */
+CHEWING_API char *chewing_convert_Keystroke( ChewingContext *ctx, const char *keys );
 /*@}*/
 
 
@@ -189,6 +269,52 @@ CHEWING_API ChewingContext *chewing_new();
 CHEWING_API ChewingContext *chewing_new_IM( const char *IM_name );
 #endif
 
+/**
+ * @brief Create new handle sharing the loaded resources of another instance
+ *
+ * The dictionary, phrase tree, symbol tables and pinyin maps of @a tmpl are
+ * shared instead of being loaded again, and only its configuration is
+ * copied. The user phrases loaded by @a tmpl are shared as well, so that a
+ * phrase learned in one instance is seen by the others and written to the
+ * same file. Both instances can be deleted in any order, but instances must
+ * not be created from the same template concurrently; use
+ * chewing_engine_new_session() for that.
+ *
+ * @param tmpl Chewing IM context used as template
+ * @see chewing_delete()
+ */
+CHEWING_API ChewingContext *chewing_new_from_template( ChewingContext *tmpl );
+
+/**
+ * @brief Create an engine loading the system data once for many sessions
+ * @see chewing_engine_new_session()
+ * @see chewing_engine_delete()
+ */
+CHEWING_API ChewingEngine *chewing_engine_new();
+
+/**
+ * @brief Create a session of the engine
+ *
+ * Sessions share the system data of the engine, and sessions of the same
+ * profile share one user dictionary. Different sessions can handle keys on
+ * different threads at the same time; each session itself must be used by
+ * one thread at a time. Release a session with chewing_delete().
+ *
+ * @param engine Chewing engine
+ * @param profile Directory of the user dictionary, NULL for the default one
+ */
+CHEWING_API ChewingContext *chewing_engine_new_session( ChewingEngine *engine, const char *profile );
+
+/**
+ * @brief Release the engine
+ *
+ * Sessions still alive keep working and release the shared data with the
+ * last of them.
+ *
+ * @param engine Chewing engine
+ */
+CHEWING_API void chewing_engine_delete( ChewingEngine *engine );
+
 /**
  * @brief Release the handle and internal memory by given Chewing instance
  * @see chewing_new()
@@ -538,6 +664,105 @@ CHEWING_API int chewing_get_phraseChoiceRearward( ChewingContext *ctx );
 /*@}*/
 
 
+/*! \name Fuzzy matching of confusable phones
+ */
+
+/*@{*/
+/**
+ * @brief Set whether phrases of confusable phones are matched
+ *
+ * When enabled, phones differing only in symbols of the same confusion class,
+ * such as ㄣ and ㄥ, are also searched during phrasing.
+ *
+ * @param ctx
+ * @param mode
+ */
+CHEWING_API void chewing_set_fuzzyPhone( ChewingContext *ctx, int mode );
+
+/**
+ * @brief Get whether phrases of confusable phones are matched
+ *
+ * @param ctx
+ */
+CHEWING_API int chewing_get_fuzzyPhone( ChewingContext *ctx );
+
+/**
+ * @brief Add a confusion class of zuin symbols
+ *
+ * The default classes are ㄣㄥ, ㄓㄗ, ㄔㄘ and ㄕㄙ. Classes sharing a symbol
+ * are merged.
+ *
+ * @param ctx
+ * @param zuin UTF-8 string of at least two symbols of the same kind, e.g. "ㄣㄥ"
+ * @retval 0 on success; -1 on invalid symbols.
+ */
+CHEWING_API int chewing_add_fuzzyPhoneClass( ChewingContext *ctx, const char *zuin );
+
+/**
+ * @brief Remove all confusion classes
+ *
+ * @param ctx
+ */
+CHEWING_API void chewing_clear_fuzzyPhoneClass( ChewingContext *ctx );
+/*@}*/
+
+
+/*! \name Lazy phrasing
+ */
+
+/*@{*/
+/**
+ * @brief Set whether phrasing is postponed until its result is read
+ *
+ * When enabled, key strokes only mark the preedit buffer stale. Phrasing and
+ * output are computed by the first accessor reading them afterwards.
+ *
+ * @param ctx
+ * @param mode
+ */
+CHEWING_API void chewing_set_lazyPhrasing( ChewingContext *ctx, int mode );
+
+/**
+ * @brief Get whether phrasing is postponed until its result is read
+ *
+ * @param ctx
+ */
+CHEWING_API int chewing_get_lazyPhrasing( ChewingContext *ctx );
+/*@}*/
+
+
+/*! \name Background writing of the user dictionary
+ */
+
+/*@{*/
+/**
+ * @brief Set whether learned phrases are written to disk by a background thread
+ *
+ * The setting belongs to the user dictionary, and applies to every context
+ * sharing it.
+ *
+ * @param ctx
+ * @param mode
+ * @retval 0 on success, -1 when the writer thread cannot be started
+ */
+CHEWING_API int chewing_set_backgroundWrite( ChewingContext *ctx, int mode );
+
+/**
+ * @brief Get whether learned phrases are written to disk by a background thread
+ *
+ * @param ctx
+ */
+CHEWING_API int chewing_get_backgroundWrite( ChewingContext *ctx );
+
+/**
+ * @brief Wait until the learned phrases are written to disk
+ *
+ * @param ctx
+ */
+CHEWING_API void chewing_flush( ChewingContext *ctx );
+/*@}*/
+
+
 /*! \name Phonetic sequence in Chewing internal state machine
  */
 
@@ -561,6 +786,36 @@ CHEWING_API void chewing_set_logger( ChewingContext *ctx,
 	void (*logger)( void *data, int level, const char *fmt, ... ),
 	void *data );
 
+/*! \name Editing state snapshot
+ */
+
+/*@{*/
+/**
+ * @brief Serialize the editing state of Chewing IM
+ *
+ * The preedit buffer, phonetic sequence, selections, breakpoints, cursor,
+ * zuin input and configuration are stored in a compact, versioned form. The
+ * candidate window is not stored.
+ *
+ * @param ctx Chewing IM context
+ * @param buf Buffer for the snapshot, NULL to only get the size.
+ * @param len Size of buf
+ * @return size of the snapshot in bytes, written only when it fits in buf
+ */
+CHEWING_API int chewing_snapshot( ChewingContext *ctx, char *buf, int len );
+
+/**
+ * @brief Restore the editing state saved by chewing_snapshot()
+ *
+ * @param ctx Chewing IM context
+ * @param buf Snapshot
+ * @param len Size of the snapshot
+ * @retval 0 on success
+ * @retval -1 if the snapshot is invalid, in which case ctx is left untouched
+ */
+CHEWING_API int chewing_restore( ChewingContext *ctx, const char *buf, int len );
+/*@}*/
+
 #ifdef SUPPORT_MULTI_IM
 /**
  * @brief Get IM name from context.
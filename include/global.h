@@ -87,10 +87,34 @@ typedef struct {
 	/*@}*/
 } IntervalType;
 
+/**
+ * @brief Changes of the output reported by chewing_output_Diff()
+ *
+ * Characters [bufferFrom, bufferOldTo) of the previous pre-edit buffer are
+ * replaced by [bufferFrom, bufferTo) of the current one. The range is empty
+ * when the buffer is unchanged.
+ */
+typedef struct {
+	/*@{*/
+	int bufferFrom;		/**< first changed character of the pre-edit buffer */
+	int bufferTo;		/**< end of the changed characters in the current buffer */
+	int bufferOldTo;	/**< end of the changed characters in the previous buffer */
+	int intervalChanged;	/**< whether phrase intervals or break points changed */
+	int cursorChanged;	/**< whether the cursor moved */
+	int zuinChanged;	/**< whether the zuin string changed */
+	int candChanged;	/**< whether the candidate window changed */
+	int auxChanged;		/**< whether the auxiliary message changed */
+	/*@}*/
+} OutputDiffType;
+
 /** @brief context handle used for Chewing IM APIs
  */
 typedef struct _ChewingContext ChewingContext;
 
+/** @brief engine sharing system data and user dictionaries among contexts
+ */
+typedef struct _ChewingEngine ChewingEngine;
+
 /** @brief use "asdfjkl789" as selection key
  */
 #define HSU_SELKEY_TYPE1 1
@@ -23,6 +23,7 @@
 
 #include "global.h"
 #include "plat_mmap.h"
+#include "plat_thread.h"
 
 #define MAX_KBTYPE 13
 #define MAX_UTF8_SIZE 4
@@ -35,6 +36,12 @@
 #define MAX_INTERVAL ( ( MAX_PHONE_SEQ_LEN + 1 ) * MAX_PHONE_SEQ_LEN / 2 )
 #define MAX_CHOICE (567)
 #define MAX_CHOICE_BUF (50)                   /* max length of the choise buffer */
+#define CHOICE_SET_SIZE (1024)                /* power of 2, at least twice MAX_CHOICE */
+#define MAX_DICT_LAYER (4)                    /* system dictionary and those in CHEWING_DICT_PATH */
+#define CHOICE_SOURCE_PER_LAYER (MAX_FUZZY_ALT + 4)   /* phone, alternative phone, fuzzy and HSU phones */
+#define MAX_PREDICT_NUM (10)
+#define MAX_FUZZY_ALT (16)                    /* max alternatives of a phone */
+#define FUZZY_BEAM_WIDTH (8)                  /* max fuzzy paths of each layer kept per phone */
 #define N_HASH_BIT (14)
 #define HASH_TABLE_SIZE (1<<N_HASH_BIT)
 #define EASY_SYMBOL_KEY_TAB_LEN (36)
@@ -59,6 +66,85 @@ static inline int min( int a, int b )
 }
 #endif
 
+#ifdef _MSC_VER
+#define inline __inline
+#endif
+
+/*
+ * Flags of the positions 0 to MAX_PHONE_SEQ_LEN of a phone sequence, such as
+ * break points, one bit per position. Position i is between phone i - 1 and
+ * phone i.
+ */
+typedef uint64_t SeqBits;
+
+#if MAX_PHONE_SEQ_LEN + 1 > 64
+#error "SeqBits cannot hold MAX_PHONE_SEQ_LEN + 1 positions"
+#endif
+
+static inline SeqBits SeqBit( int i )
+{
+	return (SeqBits) 1 << i;
+}
+
+static inline int SeqBitTest( SeqBits bits, int i )
+{
+	return ( bits >> i ) & 1;
+}
+
+/* Positions from to to - 1 */
+static inline SeqBits SeqBitRange( int from, int to )
+{
+	SeqBits below_to = to >= 64 ? ~(SeqBits) 0 : SeqBit( to ) - 1;
+	SeqBits below_from = from >= 64 ? ~(SeqBits) 0 : SeqBit( from ) - 1;
+	return from < to ? below_to & ~below_from : 0;
+}
+
+/* Move len flags from position from to position to, as memmove() does */
+static inline SeqBits SeqBitMove( SeqBits bits, int to, int from, int len )
+{
+	SeqBits mask = SeqBitRange( to, to + len );
+	SeqBits moved = to >= from ? bits << ( to - from ) : bits >> ( from - to );
+	return ( bits & ~mask ) | ( moved & mask );
+}
+
+static inline int SeqBitCount( SeqBits bits )
+{
+#ifdef __GNUC__
+	return __builtin_popcountll( bits );
+#else
+	int n;
+	for ( n = 0; bits; n++ )
+		bits &= bits - 1;
+	return n;
+#endif
+}
+
+/* The lowest position set, bits must not be 0 */
+static inline int SeqBitLowest( SeqBits bits )
+{
+#ifdef __GNUC__
+	return __builtin_ctzll( bits );
+#else
+	int i;
+	for ( i = 0; ! SeqBitTest( bits, i ); i++ )
+		;
+	return i;
+#endif
+}
+
+/* The highest position set, bits must not be 0 */
+static inline int SeqBitHighest( SeqBits bits )
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll( bits );
+#else
+	int i;
+	for ( i = 63; ! SeqBitTest( bits, i ); i-- )
+		;
+	return i;
+#endif
+}
+
 typedef union {
 	unsigned char s[ MAX_UTF8_SIZE + 1];
 	KeySeqWord wch;
@@ -86,6 +172,15 @@ typedef struct {
 	};
 } TreeType;
 
+/*
+ * An index tree file may carry a prediction section right after its last node.
+ * The section is an int32_t array: tree_size + 1 offsets followed by indices of
+ * leaf nodes. Leaves listed in [offset[i], offset[i+1]) are the most frequent
+ * (at most MAX_PREDICT_NUM) distinct phrases below node i, sorted by descending
+ * frequency, so that phrases starting with a given phone sequence are found
+ * without walking the subtree. Files without this section are still valid.
+ */
+
 typedef struct {
 	char chiBuf[ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
 	IntervalType dispInterval[ MAX_INTERVAL ];
@@ -111,8 +206,8 @@ typedef struct {
 	/** @brief all kinds of lengths of available phrases. */
 	struct {
 		int len;
-		/** @brief phone id. */
-		const TreeType *id;
+		/** @brief phrase node in each dictionary layer, NULL if not there. */
+		const TreeType *id[ MAX_DICT_LAYER ];
 	} avail[ MAX_PHRASE_LEN ];
 	/** @brief total number of availble lengths. */
 	int nAvail;
@@ -124,6 +219,87 @@ typedef struct {
  *	@brief information of available phrases or characters choices.
  */
 
+typedef struct {
+	/** @brief whether fuzzy phone matching is enabled. */
+	int bFuzzy;
+	/** @brief confusion class of each zuin symbol, 0 for no class. */
+	unsigned char phoneClass[ ZUIN_SIZE ][ 32 ];
+	/** @brief number of confusion classes ever created. */
+	int nClass;
+} FuzzyData;
+/**
+ *	@struct FuzzyData
+ *	@brief confusion classes of zuin symbols for fuzzy phone matching.
+ */
+
+typedef struct {
+	/** @brief leaves of predicted phrases in descending frequency. */
+	const TreeType *leaf[ MAX_PREDICT_NUM ];
+	/** @brief number of predicted phrases. */
+	int nPredict;
+	/** @brief number of trailing phones used as the prefix. */
+	int nPrefix;
+} PredictInfo;
+/**
+ *	@struct PredictInfo
+ *	@brief phrases predicted from the phones typed so far.
+ */
+
+typedef struct {
+	/** @brief strings stored back to back, each followed by '\0'. */
+	char *buf;
+	/** @brief number of bytes in use. */
+	int len;
+	/** @brief number of bytes allocated. */
+	int size;
+} StringPool;
+/**
+ *	@struct StringPool
+ *	@brief growable storage of strings owned by a context.
+ */
+
+typedef struct {
+	/** @brief offset of the string in its StringPool. */
+	int offset;
+	/** @brief length of the string in bytes. */
+	int len;
+} StringRef;
+
+typedef struct {
+	/** @brief start of the candidate in dictionary, user phrase or symbol table. */
+	const char *str;
+	/** @brief length of the candidate in bytes. */
+	int len;
+} ChoiceRef;
+/**
+ *	@struct ChoiceRef
+ *	@brief candidate referring to storage owned by somebody else.
+ */
+
+typedef struct {
+	/** @brief next dictionary leaf, NULL if the source holds user phrases. */
+	const TreeType *leaf;
+	/** @brief end of the child range containing leaf. */
+	const TreeType *leafEnd;
+	/** @brief next and end index of user phrases in ChoiceInfo.userPhrase. */
+	int user, userEnd;
+	/** @brief sources of a lower group are exhausted first. */
+	int group;
+	/** @brief whether only the first character of a phrase is taken. */
+	int bFirstChar;
+} ChoiceSource;
+/**
+ *	@struct ChoiceSource
+ *	@brief candidates in descending frequency, not listed yet.
+ */
+
+typedef struct {
+	/** @brief generation the slot belongs to. */
+	unsigned short gen;
+	/** @brief index of the candidate in totalChoice. */
+	unsigned short no;
+} ChoiceSlot;
+
 typedef struct {
 	/** @brief total page number. */
 	int nPage;
@@ -131,10 +307,30 @@ typedef struct {
 	int pageNo;
 	/** @brief number of choices per page. */
 	int nChoicePerPage;
-	/** @brief store possible phrases for being chosen. */
-	char totalChoiceStr[ MAX_CHOICE ][ MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1 ];
+	/** @brief references of possible phrases for being chosen. */
+	ChoiceRef *totalChoice;
 	/** @brief number of phrases to choose. */
 	int nTotalChoice;
+	/** @brief number of allocated entries of totalChoice. */
+	int nAllocChoice;
+	/** @brief open addressing set of totalChoice, valid for setGen only. */
+	ChoiceSlot *choiceSet;
+	unsigned short setGen;
+	/** @brief candidates rendered as strings, one slot per selection key. */
+	char pageChoiceStr[ MAX_SELKEY ][ MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1 ];
+	/** @brief index + 1 of the candidate rendered in each slot, 0 for none. */
+	int pageChoiceNo[ MAX_SELKEY ];
+	/** @brief sources merged into totalChoice on demand. */
+	ChoiceSource *source;
+	int nSource;
+	/** @brief number of allocated entries of source, sized by the layers. */
+	int nAllocSource;
+	/** @brief whether some source is not exhausted yet. */
+	int bMoreChoice;
+	/** @brief user phrases referred by source, in descending frequency. */
+	struct tag_UserPhraseData **userPhrase;
+	int nUserPhrase;
+	int nAllocUserPhrase;
 	int oldChiSymbolCursor;
 	int isSymbol;
 } ChoiceInfo;
@@ -158,21 +354,55 @@ typedef struct _SymbolEntry {
 	char symbols[][ MAX_UTF8_SIZE + 1 ];
 } SymbolEntry;
 
-typedef struct {
-	char *IM_name;
+/*
+ * User phrases loaded from one hash file. The sessions of a ChewingEngine
+ * using the same profile share it across threads: items are only added at
+ * the head of a bucket and freed with the dictionary, so that readers walk
+ * the buckets without locking, while learning updates take lock.
+ */
+typedef struct tag_UserDict {
+	char hashfilename[ 200 ];
+	struct tag_HASH_ITEM *hashtable[ HASH_TABLE_SIZE ];
+	int chewing_lifetime;
+	/** @brief number of contexts and engines using the dictionary. */
+	int refcount;
+	plat_mutex lock;
+	/** @brief whether updates are persisted by the background writer. */
+	int async;
+	/** @brief background writer, started on first use and kept until free. */
+	struct tag_UserDictWriter *writer;
+} UserDict;
 
+typedef struct {
 	const TreeType *tree;
 	size_t tree_size;
 	plat_mmap tree_mmap;
-	const TreeType *tree_cur_pos, *tree_end_pos;
+	const int32_t *predict_offset, *predict_leaf;
 
 	const char *dict;
+	size_t dict_size;
 	plat_mmap dict_mmap;
+	/** @brief shards of a sharded dictionary, NULL for a single file. */
+	struct tag_DictShards *dict_shards;
+} DictLayer;
+/**
+ *	@struct DictLayer
+ *	@brief a dictionary file and its index tree, stacked with others.
+ */
 
-	int chewing_lifetime;
+typedef struct {
+	char *IM_name;
 
-	char hashfilename[ 200 ];
-	struct tag_HASH_ITEM *hashtable[ HASH_TABLE_SIZE ];
+	/*
+	 * Dictionaries in lookup order: those listed in CHEWING_DICT_PATH, then
+	 * the system one. Their phrases are merged by frequency.
+	 */
+	DictLayer layer[ MAX_DICT_LAYER ];
+	int nLayer;
+	const DictLayer *tree_cur_layer;
+	const TreeType *tree_cur_pos, *tree_end_pos;
+
+	UserDict *userdict;
 
 	unsigned int n_symbol_entry;
 	SymbolEntry ** symbol_table;
@@ -184,6 +414,12 @@ typedef struct {
 	struct keymap *hanyuFinalsMap;
 	int HANYU_INITIALS;
 	int HANYU_FINALS;
+
+	/*
+	 * Number of contexts sharing the dictionary, tree, symbol tables and
+	 * pinyin maps above, NULL when they belong to this context alone.
+	 */
+	int *shared_count;
 } ChewingStaticData;
 
 struct tag_HASH_ITEM;
@@ -191,9 +427,11 @@ struct tag_HASH_ITEM;
 typedef struct tag_ChewingData {
 	AvailInfo availInfo;
 	ChoiceInfo choiceInfo;
+	PredictInfo predictInfo;
 	PhrasingOutput phrOut;
 	ZuinData zuinData;
 	ChewingConfigData config;
+	FuzzyData fuzzyData;
     /** @brief current input buffer, content==0 means Chinese code */
 	wch_t chiSymbolBuf[ MAX_PHONE_SEQ_LEN ];
 	int chiSymbolCursor;
@@ -206,17 +444,23 @@ typedef struct tag_ChewingData {
 	KeySeqWord phoneSeq[ MAX_PHONE_SEQ_LEN ];
 	KeySeqWord phoneSeqAlt[ MAX_PHONE_SEQ_LEN ];
 	int nPhoneSeq;
-	char selectStr[ MAX_PHONE_SEQ_LEN ][ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
+	StringRef selectStr[ MAX_PHONE_SEQ_LEN ];
+	StringPool selectPool;
 	IntervalType selectInterval[ MAX_PHONE_SEQ_LEN ];
 	int nSelect;
 	IntervalType preferInterval[ MAX_INTERVAL ]; /* add connect points */
 	int nPrefer;
-	int bUserArrCnnct[ MAX_PHONE_SEQ_LEN + 1 ];
-	int bUserArrBrkpt[ MAX_PHONE_SEQ_LEN + 1 ];
-	int bArrBrkpt[ MAX_PHONE_SEQ_LEN + 1 ];
-	int bSymbolArrBrkpt[ MAX_PHONE_SEQ_LEN + 1 ];
-	/* "bArrBrkpt[10]=True" means "it breaks between 9 and 10" */
+	SeqBits bUserArrCnnct;
+	SeqBits bUserArrBrkpt;
+	SeqBits bArrBrkpt;
+	SeqBits bSymbolArrBrkpt;
+	/* bit 10 of bArrBrkpt set means "it breaks between 9 and 10" */
 	int bChiSym, bSelect, bFirstKey, bFullShape;
+	/*
+	 * Phrasing and output are postponed while keys are handled in a
+	 * batch, and all the time in lazy phrasing mode.
+	 */
+	int bLazyPhrasing, bDeferPhrasing, bPhrasingDirty, bOutputDirty;
 	/* Symbol Key buffer */
 	char symbolKeyBuf[ MAX_PHONE_SEQ_LEN ];
 
@@ -226,6 +470,27 @@ typedef struct tag_ChewingData {
 	void *loggerData;
 } ChewingData;
 
+typedef struct {
+	wch_t chiSymbolBuf[ MAX_PHONE_SEQ_LEN ];
+	int chiSymbolBufLen;
+	long chiSymbolCursor;
+	wch_t zuinBuf[ ZUIN_SIZE ];
+	IntervalType dispInterval[ MAX_INTERVAL ];
+	int nDispInterval;
+	SeqBits dispBrkpt;
+	int bSelect;
+	int pageNo;
+	int nChoicePerPage;
+	unsigned short setGen;
+	int bShowMsg;
+	wch_t showMsg[ MAX_PHONE_SEQ_LEN ];
+	int showMsgLen;
+} OutputSnapshot;
+/**
+ *   @struct OutputSnapshot
+ *   @brief  output last reported by chewing_output_Diff().
+ */
+
 typedef struct {
 	/** @brief the content of Edit buffer. */
 	wch_t chiSymbolBuf[ MAX_PHONE_SEQ_LEN ];
@@ -241,7 +506,7 @@ typedef struct {
 	IntervalType dispInterval[ MAX_INTERVAL ]; /* from prefer, considering symbol */
 	int nDispInterval;
 	/** @brief indicate the break points going to display.*/
-	int dispBrkpt[ MAX_PHONE_SEQ_LEN + 1 ];
+	SeqBits dispBrkpt;
 	/** @brief the string going to commit. */
 	wch_t commitStr[ MAX_PHONE_SEQ_LEN ];
 	int nCommitStr;
@@ -256,17 +521,46 @@ typedef struct {
 	/** @brief user message. */
 	wch_t showMsg[ MAX_PHONE_SEQ_LEN ];
 	int showMsgLen;
+	/** @brief strings returned by the _static accessors of mod_aux.c. */
+	char commitString[ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
+	char bufferString[ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
+	char zuinString[ ZUIN_SIZE * MAX_UTF8_SIZE + 1 ];
+	char auxString[ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
+	/** @brief output last reported, allocated on first chewing_output_Diff(). */
+	OutputSnapshot *lastReported;
 } ChewingOutput;
 /**
  *   @struct ChewingOutput
  *   @brief  information for Chewing output.
  */
 
+typedef struct {
+	/** @brief directory of the hash file. */
+	char *name;
+	UserDict *userdict;
+} EngineProfile;
+
+struct _ChewingEngine {
+	/** @brief context holding the system data shared by all sessions. */
+	ChewingContext *tmpl;
+	/** @brief user dictionaries opened so far, one per profile. */
+	EngineProfile *profile;
+	int nProfile;
+	int nAllocProfile;
+	/** @brief serializes the creation of sessions. */
+	plat_mutex lock;
+};
+/**
+ * @struct ChewingEngine
+ * @brief system data and user dictionaries shared by sessions
+ */
+
 struct _ChewingContext {
 	ChewingData *data;
 	ChewingOutput *output;
 	int cand_no;
 	int it_no;
+	int predict_no;
 	int kb_no;
 };
 /**
@@ -21,12 +21,16 @@
 #define SYMBOL_KEY_ERROR 1
 #define DECREASE_CURSOR 1
 #define NONDECREASE_CURSOR 0
+#define STRING_POOL_INIT_SIZE 64
 
 void AutoLearnPhrase( ChewingData *pgdata );
 void SetUpdatePhraseMsg( ChewingData *pgdata, const char *addWordSeq, int len, int state );
 int NoSymbolBetween( ChewingData *pgdata, int begin, int end );
 int ChewingIsEntering( ChewingData *pgdata );
 void CleanAllBuf( ChewingData * );
+int StringPoolAppend( StringPool *pool, const char *str, int len );
+void StringPoolCompact( StringPool *pool, StringRef refs[], int nRef );
+void StringPoolFree( StringPool *pool );
 int SpecialSymbolInput( int key, ChewingData *pgdata );
 int FullShapeSymbolInput( int key, ChewingData *pgdata );
 int EasySymbolInput( int key, ChewingData *pgdata );
@@ -37,7 +41,10 @@ int WriteChiSymbolToBuf( wch_t csBuf[], int csBufLen, ChewingData *pgdata );
 int ReleaseChiSymbolBuf( ChewingData *pgdata, ChewingOutput *);
 int AddChi( KeySeqWord phone, KeySeqWord phoneAlt, ChewingData *pgdata );
 int CallPhrasing( ChewingData *pgdata );
+int FlushPhrasing( ChewingData *pgdata );
 int MakeOutputWithRtn( ChewingOutput *pgo, ChewingData *pgdata, int keystrokeRtn );
+void FlushOutput( ChewingOutput *pgo, ChewingData *pgdata );
+void MakeDeferredOutput( ChewingOutput *pgo, ChewingData *pgdata );
 void MakeOutputAddMsgAndCleanInterval( ChewingOutput *pgo, ChewingData *pgdata );
 int AddSelect( ChewingData *pgdata, int sel_i );
 int CountSelKeyNum( int key, ChewingData *pgdata );
@@ -49,6 +56,8 @@ int ChewingKillChar(
 		int chiSymbolCursorToKill,
 		int minus );
 void RemoveSelectElement( int i, ChewingData *pgdata );
+const char *SelectStr( ChewingData *pgdata, int i );
+int SetSelectStr( ChewingData *pgdata, int i, const char *str, int nChar );
 int IsPreferIntervalConnted( int cursor, ChewingData *pgdata );
 int OpenSymbolChoice( ChewingData *pgdata );
 
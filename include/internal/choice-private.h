@@ -17,4 +17,33 @@ int ChoicePrevAvail( ChewingContext * );
 int ChoiceSelect( ChewingData *, int selectNo );
 int ChoiceEndChoice( ChewingData * );
 
+/** @brief Drop all candidates of the choice list. */
+void ChoiceInfoClear( ChoiceInfo *pci );
+/** @brief Release the storage of the choice list. */
+void ChoiceInfoFree( ChoiceInfo *pci );
+/**
+ * @brief Append a candidate referring to str, which must outlive the list.
+ *
+ * @return 1 if appended, 0 if the list is full.
+ */
+int ChoiceInfoAppend( ChoiceInfo *pci, const char *str, int len );
+/**
+ * @brief Render candidate no as a string.
+ *
+ * The string is kept in a slot shared with the candidates MAX_SELKEY apart,
+ * so it is only valid until one of them is rendered.
+ */
+const char *ChoiceInfoString( ChoiceInfo *pci, int no );
+/**
+ * @brief List candidates until there are nChoice of them or no more.
+ *
+ * Word candidates are merged from their sources on demand, so totalChoice
+ * and nPage only cover what has been listed so far.
+ *
+ * @return number of candidates listed.
+ */
+int ChoiceInfoFill( ChewingData *pgdata, int nChoice );
+/** @brief List candidates of the current page and the one after it. */
+void ChoiceInfoFillPage( ChewingData *pgdata );
+
 #endif
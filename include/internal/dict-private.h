@@ -17,12 +17,11 @@
 #define SEEK_SET 0
 #endif
 
-#define PHONE_PHRASE_NUM (162244)
-
 int GetCharFirst( ChewingData *, Phrase *, KeySeqWord );
 int GetPhraseFirst( ChewingData *pgdata, Phrase *phr_ptr, const TreeType *phrase_parent );
 int GetVocabNext ( ChewingData *pgdata, Phrase *phr_ptr );
-int InitDict( ChewingData *pgdata, const char * prefix );
-void TerminateDict( ChewingData *pgdata );
+const char *GetDictPhrase( ChewingData *pgdata, const TreeType *leaf );
+int InitDict( ChewingData *pgdata, int layer, const char * prefix );
+void TerminateDict( ChewingData *pgdata, int layer );
 
 #endif
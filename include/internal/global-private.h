@@ -20,4 +20,27 @@
 #define SOFTKBD_TABLE_FILE	"swkb.dat"
 #define PINYIN_TAB_NAME         "pinyin.tab"
 
+/*
+ * A system dictionary may be split into shards, which are mapped only when a
+ * phrase in them is read. DICT_FILE is then shard 0 and begins with a header,
+ * DICT_SHARD_MAGIC followed by the number of shards as uint32_t. Shard n > 0
+ * is DICT_FILE.n. Positions in the index tree hold the shard in the high bits
+ * and the offset in the shard in the low DICT_SHARD_SHIFT bits, so that they
+ * still fit in phrase.pos of TreeType. Shards are at most DICT_SHARD_SIZE
+ * (16 MB) bytes and there are at most DICT_MAX_SHARD (256) of them, which
+ * holds 4 GB of phrases, as much as a single DICT_FILE addressed by 32 bits.
+ * Without the header, positions are offsets in DICT_FILE.
+ */
+#define DICT_SHARD_FILE		DICT_FILE ".%d"
+#define DICT_SHARD_MAGIC	"\0SHD"
+#define DICT_SHARD_MAGIC_LEN	4
+#define DICT_SHARD_HEADER_SIZE	8
+#define DICT_SHARD_SHIFT	24
+#define DICT_SHARD_SIZE		( 1 << DICT_SHARD_SHIFT )
+#define DICT_MAX_SHARD		( 1 << ( 32 - DICT_SHARD_SHIFT ) )
+#define DictShardOf( pos )	( (uint32_t) ( pos ) >> DICT_SHARD_SHIFT )
+#define DictShardOffset( pos )	( (uint32_t) ( pos ) & ( DICT_SHARD_SIZE - 1 ) )
+#define DictShardPos( shard, offset ) \
+	( ( (uint32_t) ( shard ) << DICT_SHARD_SHIFT ) | (uint32_t) ( offset ) )
+
 #endif
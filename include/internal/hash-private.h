@@ -28,6 +28,9 @@ typedef struct tag_HASH_ITEM {
 	int item_index;
 	UserPhraseData data;
 	struct tag_HASH_ITEM *next;
+	/* Queue of the background writer, see UserDictSetAsync() */
+	int dirty;
+	struct tag_HASH_ITEM *dirty_next;
 } HASH_ITEM;
 
 HASH_ITEM *HashFindPhone( const KeySeqWord phoneSeq[] );
@@ -37,6 +40,11 @@ HASH_ITEM *HashFindPhonePhrase( struct tag_ChewingData *pgdata, const KeySeqWord
 void HashModify( struct tag_ChewingData *pgdata, HASH_ITEM *pItem );
 int AlcUserPhraseSeq( UserPhraseData *pData, int phonelen, int wordlen );
 int InitHash( struct tag_ChewingData *ctx );
+struct tag_UserDict *UserDictOpen( const char *path );
+void UserDictRetain( struct tag_UserDict *dict );
+void UserDictRelease( struct tag_UserDict *dict );
+int UserDictSetAsync( struct tag_UserDict *dict, int async );
+void UserDictFlush( struct tag_UserDict *dict );
 void TerminateHash( struct tag_ChewingData *pgdata );
 void FreeHashTable( void );
 
@@ -22,17 +22,19 @@
 #define inline __inline
 #endif
 
+/* Bytes are read unsigned, since a plain char may be sign extended. */
 static inline KeySeqWord GetUint16( const char *ptr )
 {
+	const unsigned char *p = (const unsigned char *) ptr;
 	KeySeqWord val;
 #if WORDS_BIGENDIAN
 	val =
-		( ptr[0] << 8 ) |
-		( ptr[1] << 0 );
+		( p[0] << 8 ) |
+		( p[1] << 0 );
 #else
 	val =
-		( ptr[0] << 0 ) |
-		( ptr[1] << 8 );
+		( p[0] << 0 ) |
+		( p[1] << 8 );
 #endif
 	return val;
 }
@@ -50,21 +52,22 @@ static inline void PutUint16( KeySeqWord val, char *ptr )
 
 static inline int GetInt32( const char *ptr )
 {
-	int val;
+	const unsigned char *p = (const unsigned char *) ptr;
+	unsigned int val;
 #if WORDS_BIGENDIAN
 	val =
-		( ptr[0] << 24 ) |
-		( ptr[1] << 16 ) |
-		( ptr[2] <<  8 ) |
-		( ptr[3] <<  0 );
+		( (unsigned int) p[0] << 24 ) |
+		( (unsigned int) p[1] << 16 ) |
+		( (unsigned int) p[2] <<  8 ) |
+		( (unsigned int) p[3] <<  0 );
 #else
 	val =
-		( ptr[0] <<  0 ) |
-		( ptr[1] <<  8 ) |
-		( ptr[2] << 16 ) |
-		( ptr[3] << 24 );
+		( (unsigned int) p[0] <<  0 ) |
+		( (unsigned int) p[1] <<  8 ) |
+		( (unsigned int) p[2] << 16 ) |
+		( (unsigned int) p[3] << 24 );
 #endif
-	return val;
+	return (int) val;
 }
 
 static inline void PutInt32( int val, char *ptr )
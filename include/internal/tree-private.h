@@ -14,13 +14,18 @@
 #define IS_USER_PHRASE 1
 #define IS_DICT_PHRASE 0
 
-int InitTree( ChewingData *pgdata, const char *prefix );
-void TerminateTree( ChewingData *pgdata );
+int InitTree( ChewingData *pgdata, int layer, const char *prefix );
+void TerminateTree( ChewingData *pgdata, int layer );
 
 int Phrasing( ChewingData *pgdata );
 int IsIntersect( IntervalType in1, IntervalType in2 );
 
-const TreeType *TreeFindPhrase( ChewingData *pgdata, int begin, int end, const KeySeqWord *phoneSeq );
+int TreeLayerOf( ChewingData *pgdata, const TreeType *node );
+const TreeType *TreeFindChild( ChewingData *pgdata, int layer, const TreeType *parent, KeySeqWord key );
+int TreeHasPhrase( ChewingData *pgdata, int layer, const TreeType *node );
+const TreeType *TreeFindPrefix( ChewingData *pgdata, int layer, int begin, int end, const KeySeqWord *phoneSeq );
+const TreeType *TreeFindPhrase( ChewingData *pgdata, int layer, int begin, int end, const KeySeqWord *phoneSeq );
+int TreePredictPhrase( ChewingData *pgdata );
 void TreeChildRange( ChewingData *pgdata, const TreeType *parent );
 
 #endif
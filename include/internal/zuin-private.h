@@ -43,4 +43,9 @@ int ZuinRemoveLast( ZuinData * );
 int ZuinRemoveAll( ZuinData * );
 int ZuinIsEntering( ZuinData * );
 
+void InitFuzzyPhone( FuzzyData *pFuzzy );
+int FuzzyAddPhoneClass( FuzzyData *pFuzzy, const char *zuin );
+void FuzzyClearPhoneClass( FuzzyData *pFuzzy );
+int FuzzyPhoneAlt( const FuzzyData *pFuzzy, KeySeqWord phone, KeySeqWord alt[], int cost[] );
+
 #endif
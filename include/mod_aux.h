@@ -33,12 +33,24 @@ CHEWING_API int chewing_commit_Check( ChewingContext *ctx );
  */
 CHEWING_API char *chewing_commit_String( ChewingContext *ctx );
 
+/**
+ * @brief Get current commit string without allocation
+ * @param ctx handle to Chewing IM context
+ * @param[out] len length of the string in bytes, if not NULL
+ *
+ * The _static accessors return a NUL-terminated string owned by the context.
+ * It stays valid until the next key is handled or the context is reset, and
+ * must not be freed.
+ */
+CHEWING_API const char *chewing_commit_String_static( ChewingContext *ctx, int *len );
+
 
 /*! \name Preedit string buffer
  */
 
 /*@{*/
 CHEWING_API char *chewing_buffer_String( ChewingContext *ctx );
+CHEWING_API const char *chewing_buffer_String_static( ChewingContext *ctx, int *len );
 CHEWING_API int chewing_buffer_Check( ChewingContext *ctx );
 CHEWING_API int chewing_buffer_Len( ChewingContext *ctx );
 /*@}*/
@@ -53,6 +65,14 @@ CHEWING_API int chewing_buffer_Len( ChewingContext *ctx );
  */
 CHEWING_API char *chewing_zuin_String( ChewingContext *ctx, int *zuin_count );
 
+/**
+ * @param ctx handle to Chewing IM context
+ * @param[out] len length of the string in bytes, if not NULL
+ *
+ * See chewing_commit_String_static() for the lifetime of the string.
+ */
+CHEWING_API const char *chewing_zuin_String_static( ChewingContext *ctx, int *len );
+
 CHEWING_API int chewing_zuin_Check( ChewingContext *ctx );
 /*@}*/
 
@@ -67,6 +87,46 @@ CHEWING_API int chewing_cand_CurrentPage( ChewingContext *ctx );
 CHEWING_API void chewing_cand_Enumerate( ChewingContext *ctx );
 CHEWING_API int chewing_cand_hasNext( ChewingContext *ctx );
 CHEWING_API char *chewing_cand_String( ChewingContext *ctx );
+/**
+ * @param ctx handle to Chewing IM context
+ * @param[out] len length of the string in bytes, if not NULL
+ *
+ * As chewing_commit_String_static(), but the string is also overwritten once
+ * MAX_SELKEY more candidates are fetched.
+ */
+CHEWING_API const char *chewing_cand_String_static( ChewingContext *ctx, int *len );
+/*@}*/
+
+
+/*! \name Phrase prediction
+ */
+
+/*@{*/
+/**
+ * @brief Predict phrases starting with the phones typed so far
+ * @param ctx handle to Chewing IM context
+ *
+ * The longest trailing phone sequence of preedit buffer having continuations
+ * is used as the prefix. Predicted phrases are enumerated by descending
+ * frequency, and only a few most frequent phrases are given.
+ *
+ * Predictions are not candidates: they are available without opening the
+ * selection window, and they contain phones not typed yet, so they are kept
+ * out of chewing_cand_*().
+ */
+CHEWING_API void chewing_predict_Enumerate( ChewingContext *ctx );
+CHEWING_API int chewing_predict_hasNext( ChewingContext *ctx );
+/**
+ * @brief Get the number of trailing phones used as the prefix of prediction
+ * @param ctx handle to Chewing IM context
+ */
+CHEWING_API int chewing_predict_PrefixLen( ChewingContext *ctx );
+/**
+ * @param ctx handle to Chewing IM context
+ *
+ * Always returns a char pointer, caller must free it.
+ */
+CHEWING_API char *chewing_predict_String( ChewingContext *ctx );
 /*@}*/
 
 
@@ -80,9 +140,21 @@ CHEWING_API void chewing_interval_Get( ChewingContext *ctx, IntervalType *it );
 CHEWING_API int chewing_aux_Check( ChewingContext *ctx );
 CHEWING_API int chewing_aux_Length( ChewingContext *ctx );
 CHEWING_API char *chewing_aux_String( ChewingContext *ctx );
+CHEWING_API const char *chewing_aux_String_static( ChewingContext *ctx, int *len );
 /*@}*/
 
 
+/**
+ * @brief Report what changed in the output since the previous call
+ * @param ctx handle to Chewing IM context
+ * @param[out] diff changes of the pre-edit buffer, intervals, cursor, zuin,
+ *             candidate window and auxiliary message, may be NULL
+ * @retval 1 if anything changed, 0 otherwise
+ *
+ * Calling it after each key stroke lets a frontend redraw only what changed.
+ */
+CHEWING_API int chewing_output_Diff( ChewingContext *ctx, OutputDiffType *diff );
+
 /*@{*/
 CHEWING_API int chewing_keystroke_CheckIgnore( ChewingContext *ctx );
 CHEWING_API int chewing_keystroke_CheckAbsorb( ChewingContext *ctx );
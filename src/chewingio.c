@@ -18,6 +18,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -30,6 +31,7 @@
 #include "userphrase-private.h"
 #include "choice-private.h"
 #include "dict-private.h"
+#include "key2pho-private.h"
 #include "hash-private.h"
 #include "tree-private.h"
 #include "pinyin-private.h"
@@ -152,11 +154,67 @@ static ChewingData * allocate_ChewingData()
 		data->config.maxChiSymbolLen = MAX_CHI_SYMBOL_LEN;
 		data->logger = NullLogger;
 		memcpy( data->config.selKey, DEFAULT_SELKEY, sizeof( data->config.selKey ) );
+		InitFuzzyPhone( &data->fuzzyData );
 	}
 
 	return data;
 }
 
+/* Map a dictionary and its index tree at path as the next layer. */
+static int InitDictLayer( ChewingData *pgdata, const char *path )
+{
+	int layer = pgdata->static_data.nLayer;
+
+	if ( layer >= MAX_DICT_LAYER )
+		return -1;
+	if ( InitDict( pgdata, layer, path ) ) {
+		TerminateDict( pgdata, layer );
+		return -1;
+	}
+	if ( InitTree( pgdata, layer, path ) ) {
+		TerminateTree( pgdata, layer );
+		TerminateDict( pgdata, layer );
+		return -1;
+	}
+	pgdata->static_data.nLayer++;
+	return 0;
+}
+
+static void TerminateDictLayers( ChewingData *pgdata )
+{
+	int i;
+
+	for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+		TerminateTree( pgdata, i );
+		TerminateDict( pgdata, i );
+	}
+	pgdata->static_data.nLayer = 0;
+}
+
+/*
+ * Stack the dictionaries of the directories in CHEWING_DICT_PATH, in order,
+ * over the system dictionary at path. Directories without a readable
+ * dictionary and index tree are skipped.
+ */
+static int InitDictLayers( ChewingData *pgdata, const char *path )
+{
+	char buffer[ PATH_MAX ];
+	const char *dict_path;
+	char *dir, *saveptr;
+
+	pgdata->static_data.nLayer = 0;
+	dict_path = getenv( "CHEWING_DICT_PATH" );
+	if ( dict_path ) {
+		strncpy( buffer, dict_path, sizeof( buffer ) - 1 );
+		buffer[ sizeof( buffer ) - 1 ] = '\0';
+		for ( dir = strtok_r( buffer, SEARCH_PATH_SEP, &saveptr );
+		      dir && pgdata->static_data.nLayer < MAX_DICT_LAYER - 1;
+		      dir = strtok_r( NULL, SEARCH_PATH_SEP, &saveptr ) )
+			InitDictLayer( pgdata, dir );
+	}
+	return InitDictLayer( pgdata, path );
+}
+
 #ifdef SUPPORT_MULTI_IM
 CHEWING_API ChewingContext *chewing_new_IM( const char *IM_name )
 #else
@@ -197,10 +255,7 @@ static ChewingContext *chewing_new_IM( const char *IM_name )
 	ret = open_DICT_FILES( IM_name, search_path, path, sizeof(path) );
 	if ( ret )
 		goto error;
-	ret = InitDict( ctx->data, path );
-	if ( ret )
-		goto error;
-	ret = InitTree( ctx->data, path );
+	ret = InitDictLayers( ctx->data, path );
 	if ( ret )
 		goto error;
 
@@ -245,6 +300,157 @@ CHEWING_API ChewingContext *chewing_new()
 	return chewing_new_IM("");
 }
 
+static int ShareStaticData( ChewingData *pgdata )
+{
+	if ( !pgdata->static_data.shared_count ) {
+		pgdata->static_data.shared_count = ALC( int, 1 );
+		if ( !pgdata->static_data.shared_count )
+			return -1;
+		*pgdata->static_data.shared_count = 1;
+	}
+	return 0;
+}
+
+/*
+ * Create a context sharing the loaded resources of tmpl. The user phrases of
+ * tmpl are shared too, unless userdict is given to be shared instead.
+ */
+static ChewingContext *NewFromTemplate( ChewingContext *tmpl, UserDict *userdict )
+{
+	ChewingContext *ctx;
+	ChewingData *pgdata, *tmpl_data = tmpl->data;
+
+	if ( ShareStaticData( tmpl_data ) < 0 )
+		return NULL;
+
+	ctx = ALC( ChewingContext, 1 );
+	if ( !ctx )
+		return NULL;
+	ctx->output = ALC( ChewingOutput, 1 );
+	ctx->data = allocate_ChewingData();
+	if ( !ctx->output || !ctx->data ) {
+		free( ctx->output );
+		free( ctx->data );
+		free( ctx );
+		return NULL;
+	}
+	pgdata = ctx->data;
+
+	pgdata->static_data = tmpl_data->static_data;
+	pgdata->static_data.userdict = NULL;
+	plat_atomic_add_int( pgdata->static_data.shared_count, 1 );
+	pgdata->static_data.IM_name = strdup( tmpl_data->static_data.IM_name );
+	if ( !pgdata->static_data.IM_name )
+		goto error;
+	if ( !userdict )
+		userdict = tmpl_data->static_data.userdict;
+	UserDictRetain( userdict );
+	pgdata->static_data.userdict = userdict;
+
+	pgdata->config = tmpl_data->config;
+	pgdata->fuzzyData = tmpl_data->fuzzyData;
+	pgdata->bLazyPhrasing = tmpl_data->bLazyPhrasing;
+	pgdata->logger = tmpl_data->logger;
+	chewing_Reset( ctx );
+	pgdata->loggerData = tmpl_data->loggerData;
+	pgdata->zuinData.kbtype = tmpl_data->zuinData.kbtype;
+	pgdata->bChiSym = tmpl_data->bChiSym;
+	pgdata->bFullShape = tmpl_data->bFullShape;
+
+	return ctx;
+error:
+	chewing_delete( ctx );
+	return NULL;
+}
+
+CHEWING_API ChewingContext *chewing_new_from_template( ChewingContext *tmpl )
+{
+	if ( !tmpl )
+		return NULL;
+	return NewFromTemplate( tmpl, NULL );
+}
+
+CHEWING_API ChewingEngine *chewing_engine_new()
+{
+	ChewingEngine *engine = ALC( ChewingEngine, 1 );
+
+	if ( !engine )
+		return NULL;
+	if ( plat_mutex_init( &engine->lock ) != 0 ) {
+		free( engine );
+		return NULL;
+	}
+	engine->tmpl = chewing_new();
+	if ( !engine->tmpl || ShareStaticData( engine->tmpl->data ) < 0 ) {
+		chewing_engine_delete( engine );
+		return NULL;
+	}
+	return engine;
+}
+
+static UserDict *EngineFindProfile( ChewingEngine *engine, const char *profile )
+{
+	EngineProfile *list;
+	UserDict *userdict;
+	int i;
+
+	if ( !profile )
+		return engine->tmpl->data->static_data.userdict;
+	for ( i = 0; i < engine->nProfile; i++ ) {
+		if ( !strcmp( engine->profile[ i ].name, profile ) )
+			return engine->profile[ i ].userdict;
+	}
+
+	if ( engine->nProfile == engine->nAllocProfile ) {
+		list = realloc( engine->profile,
+			sizeof( EngineProfile ) * ( engine->nAllocProfile * 2 + 4 ) );
+		if ( !list )
+			return NULL;
+		engine->profile = list;
+		engine->nAllocProfile = engine->nAllocProfile * 2 + 4;
+	}
+	userdict = UserDictOpen( profile );
+	if ( !userdict )
+		return NULL;
+	engine->profile[ engine->nProfile ].name = strdup( profile );
+	if ( !engine->profile[ engine->nProfile ].name ) {
+		UserDictRelease( userdict );
+		return NULL;
+	}
+	engine->profile[ engine->nProfile ].userdict = userdict;
+	engine->nProfile++;
+	return userdict;
+}
+
+CHEWING_API ChewingContext *chewing_engine_new_session( ChewingEngine *engine, const char *profile )
+{
+	ChewingContext *ctx = NULL;
+	UserDict *userdict;
+
+	plat_mutex_lock( &engine->lock );
+	userdict = EngineFindProfile( engine, profile );
+	if ( userdict )
+		ctx = NewFromTemplate( engine->tmpl, userdict );
+	plat_mutex_unlock( &engine->lock );
+	return ctx;
+}
+
+CHEWING_API void chewing_engine_delete( ChewingEngine *engine )
+{
+	int i;
+
+	if ( !engine )
+		return;
+	for ( i = 0; i < engine->nProfile; i++ ) {
+		free( engine->profile[ i ].name );
+		UserDictRelease( engine->profile[ i ].userdict );
+	}
+	free( engine->profile );
+	chewing_delete( engine->tmpl );
+	plat_mutex_destroy( &engine->lock );
+	free( engine );
+}
+
 CHEWING_API int chewing_Init(
 		const char *dataPath UNUSED,
 		const char *hashPath UNUSED)
@@ -257,14 +463,25 @@ CHEWING_API int chewing_Reset( ChewingContext *ctx )
 	ChewingData *pgdata = ctx->data;
 	ChewingStaticData static_data;
 	ChewingConfigData old_config;
+	FuzzyData old_fuzzy;
+	int bLazyPhrasing;
 	void (*logger)( void *data, int level, const char *fmt, ...);
 
+	/* Storage owned by the context would leak once pgdata is cleared. */
+	ChoiceInfoFree( &pgdata->choiceInfo );
+	StringPoolFree( &pgdata->selectPool );
+
 	/* Backup old config and restore it after clearing pgdata structure. */
 	old_config = pgdata->config;
+	old_fuzzy = pgdata->fuzzyData;
+	bLazyPhrasing = pgdata->bLazyPhrasing;
 	static_data = pgdata->static_data;
 	logger = pgdata->logger;
 	memset( pgdata, 0, sizeof( ChewingData ) );
 	pgdata->config = old_config;
+	pgdata->fuzzyData = old_fuzzy;
+	pgdata->bLazyPhrasing = bLazyPhrasing;
+	pgdata->bDeferPhrasing = bLazyPhrasing;
 	pgdata->static_data = static_data;
 	pgdata->logger = logger;
 
@@ -277,8 +494,8 @@ CHEWING_API int chewing_Reset( ChewingContext *ctx )
 	pgdata->chiSymbolCursor = 0;
 	pgdata->chiSymbolBufLen = 0;
 	pgdata->nPhoneSeq = 0;
-	memset( pgdata->bUserArrCnnct, 0, sizeof( int ) * ( MAX_PHONE_SEQ_LEN + 1 ) );
-	memset( pgdata->bUserArrBrkpt, 0, sizeof( int ) * ( MAX_PHONE_SEQ_LEN + 1 ) );
+	pgdata->bUserArrCnnct = 0;
+	pgdata->bUserArrBrkpt = 0;
 	pgdata->bChiSym = CHINESE_MODE;
 	pgdata->bFullShape = HALFSHAPE_MODE;
 	pgdata->bSelect = 0;
@@ -318,18 +535,26 @@ CHEWING_API void chewing_delete( ChewingContext *ctx )
 {
 	if ( ctx ) {
 		if ( ctx->data ) {
-			TerminatePinyin( ctx->data );
-			TerminateEasySymbolTable( ctx->data );
-			TerminateSymbolTable( ctx->data );
+			int *shared_count = ctx->data->static_data.shared_count;
+
+			if ( !shared_count || plat_atomic_add_int( shared_count, -1 ) == 0 ) {
+				free( shared_count );
+				TerminatePinyin( ctx->data );
+				TerminateEasySymbolTable( ctx->data );
+				TerminateSymbolTable( ctx->data );
+				TerminateDictLayers( ctx->data );
+			}
 			TerminateHash( ctx->data );
-			TerminateTree( ctx->data );
-			TerminateDict( ctx->data );
+			ChoiceInfoFree( &ctx->data->choiceInfo );
+			StringPoolFree( &ctx->data->selectPool );
 			if( ctx->data->static_data.IM_name ) free( ctx->data->static_data.IM_name );
 			free( ctx->data );
 		}
 
-		if ( ctx->output )
+		if ( ctx->output ) {
+			free( ctx->output->lastReported );
 			free( ctx->output);
+		}
 		free( ctx );
 	}
 	return;
@@ -476,6 +701,67 @@ CHEWING_API int chewing_get_phraseChoiceRearward( ChewingContext *ctx )
 	return ctx->data->config.bPhraseChoiceRearward;
 }
 
+CHEWING_API void chewing_set_fuzzyPhone( ChewingContext *ctx, int mode )
+{
+	if ( mode == 0 || mode == 1 )
+		ctx->data->fuzzyData.bFuzzy = mode;
+}
+
+CHEWING_API int chewing_get_fuzzyPhone( ChewingContext *ctx )
+{
+	return ctx->data->fuzzyData.bFuzzy;
+}
+
+CHEWING_API int chewing_add_fuzzyPhoneClass( ChewingContext *ctx, const char *zuin )
+{
+	if ( !zuin )
+		return -1;
+	return FuzzyAddPhoneClass( &ctx->data->fuzzyData, zuin );
+}
+
+CHEWING_API void chewing_clear_fuzzyPhoneClass( ChewingContext *ctx )
+{
+	FuzzyClearPhoneClass( &ctx->data->fuzzyData );
+}
+
+CHEWING_API void chewing_set_lazyPhrasing( ChewingContext *ctx, int mode )
+{
+	if ( mode == 0 || mode == 1 ) {
+		ctx->data->bLazyPhrasing = mode;
+		ctx->data->bDeferPhrasing = mode;
+		FlushPhrasing( ctx->data );
+		FlushOutput( ctx->output, ctx->data );
+	}
+}
+
+CHEWING_API int chewing_get_lazyPhrasing( ChewingContext *ctx )
+{
+	return ctx->data->bLazyPhrasing;
+}
+
+CHEWING_API int chewing_set_backgroundWrite( ChewingContext *ctx, int mode )
+{
+	if ( mode == 0 || mode == 1 )
+		return UserDictSetAsync( ctx->data->static_data.userdict, mode );
+	return -1;
+}
+
+CHEWING_API int chewing_get_backgroundWrite( ChewingContext *ctx )
+{
+	UserDict *dict = ctx->data->static_data.userdict;
+	int mode;
+
+	plat_mutex_lock( &dict->lock );
+	mode = dict->async;
+	plat_mutex_unlock( &dict->lock );
+	return mode;
+}
+
+CHEWING_API void chewing_flush( ChewingContext *ctx )
+{
+	UserDictFlush( ctx->data->static_data.userdict );
+}
+
 CHEWING_API void chewing_set_ChiEngMode( ChewingContext *ctx, int mode )
 {
 	if ( mode == CHINESE_MODE || mode == SYMBOL_MODE )
@@ -801,8 +1087,11 @@ CHEWING_API int chewing_handle_Left( ChewingContext *ctx )
 		assert( pgdata->choiceInfo.nPage > 0 );
 		if ( pgdata->choiceInfo.pageNo > 0 )
 			pgdata->choiceInfo.pageNo--;
-		else
+		else {
+			/* The last page is only known once all candidates are listed. */
+			ChoiceInfoFill( pgdata, MAX_CHOICE );
 			pgdata->choiceInfo.pageNo = pgdata->choiceInfo.nPage - 1;
+		}
 	}
 	else {
 		if (
@@ -860,8 +1149,10 @@ CHEWING_API int chewing_handle_Right( ChewingContext *ctx )
 	}
 
 	if ( pgdata->bSelect ) {
-		if ( pgdata->choiceInfo.pageNo < pgdata->choiceInfo.nPage - 1)
+		if ( pgdata->choiceInfo.pageNo < pgdata->choiceInfo.nPage - 1) {
 			pgdata->choiceInfo.pageNo++;
+			ChoiceInfoFillPage( pgdata );
+		}
 		else
 			pgdata->choiceInfo.pageNo = 0;
 	}
@@ -899,12 +1190,12 @@ CHEWING_API int chewing_handle_Tab( ChewingContext *ctx )
 		else if ( ChewingIsChiAt( pgdata->chiSymbolCursor - 1, pgdata ) ) {
 			cursor = PhoneSeqCursor( pgdata );
 			if ( IsPreferIntervalConnted( cursor, pgdata) ) {
-				pgdata->bUserArrBrkpt[ cursor ] = 1;
-				pgdata->bUserArrCnnct[ cursor ] = 0;
+				pgdata->bUserArrBrkpt |= SeqBit( cursor );
+				pgdata->bUserArrCnnct &= ~SeqBit( cursor );
 			}
 			else {
-				pgdata->bUserArrBrkpt[ cursor ] = 0;
-				pgdata->bUserArrCnnct[ cursor ] = 1;
+				pgdata->bUserArrBrkpt &= ~SeqBit( cursor );
+				pgdata->bUserArrCnnct |= SeqBit( cursor );
 			}
 		}
 		CallPhrasing( pgdata );
@@ -928,8 +1219,8 @@ CHEWING_API int chewing_handle_DblTab( ChewingContext *ctx )
 
 	if ( ! pgdata->bSelect ) {
 		cursor = PhoneSeqCursor( pgdata );
-		pgdata->bUserArrBrkpt[ cursor ] = 0;
-		pgdata->bUserArrCnnct[ cursor ] = 0;
+		pgdata->bUserArrBrkpt &= ~SeqBit( cursor );
+		pgdata->bUserArrCnnct &= ~SeqBit( cursor );
 	}
 	CallPhrasing( pgdata );
 
@@ -1059,7 +1350,7 @@ CHEWING_API int chewing_handle_Default( ChewingContext *ctx, int key )
 	int bQuickCommit = 0;
 
 	/* Update lifetime */
-	ctx->data->static_data.chewing_lifetime++;
+	plat_atomic_add_int( &ctx->data->static_data.userdict->chewing_lifetime, 1 );
 
 	/* Skip the special key */
 	if ( key & 0xFF00 ) {
@@ -1246,8 +1537,8 @@ End_keyproc:
 	if ( pgdata->phrOut.nNumCut > 0 ) {
 		int i;
 		for ( i = 0; i < pgdata->phrOut.nDispInterval; i++ ) {
-			pgdata->bUserArrBrkpt[ pgdata->phrOut.dispInterval[ i ].from ] = 1;
-			pgdata->bUserArrBrkpt[ pgdata->phrOut.dispInterval[ i ].to ] = 1;
+			pgdata->bUserArrBrkpt |= SeqBit( pgdata->phrOut.dispInterval[ i ].from );
+			pgdata->bUserArrBrkpt |= SeqBit( pgdata->phrOut.dispInterval[ i ].to );
 		}
 		pgdata->phrOut.nNumCut = 0;
 	}
@@ -1265,7 +1556,6 @@ CHEWING_API int chewing_handle_CtrlNum( ChewingContext *ctx, int key )
 	ChewingOutput *pgo = ctx->output;
 	int keystrokeRtn = KEYSTROKE_ABSORB;
 	int newPhraseLen;
-	int i;
 	KeySeqWord addPhoneSeq[ MAX_PHONE_SEQ_LEN ];
 	char addWordSeq[ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ];
 	int phraseState;
@@ -1289,6 +1579,7 @@ CHEWING_API int chewing_handle_CtrlNum( ChewingContext *ctx, int key )
 		return 0;
 	}
 
+	FlushPhrasing( pgdata );
 	cursor = PhoneSeqCursor( pgdata );
 	if ( ! pgdata->config.bAddPhraseForward ) {
 		if (
@@ -1317,8 +1608,7 @@ CHEWING_API int chewing_handle_CtrlNum( ChewingContext *ctx, int key )
 					phraseState );
 
 				/* Clear the breakpoint between the New Phrase */
-				for ( i = 1; i < newPhraseLen; i++ )
-					pgdata->bUserArrBrkpt[ cursor + i ] = 0;
+				pgdata->bUserArrBrkpt &= ~SeqBitRange( cursor + 1, cursor + newPhraseLen );
 			}
 		}
 	}
@@ -1347,8 +1637,7 @@ CHEWING_API int chewing_handle_CtrlNum( ChewingContext *ctx, int key )
 					phraseState );
 
 				/* Clear the breakpoint between the New Phrase */
-				for ( i = 1; i < newPhraseLen; i++ )
-					pgdata->bUserArrBrkpt[ cursor - newPhraseLen + i ] = 0;
+				pgdata->bUserArrBrkpt &= ~SeqBitRange( cursor - newPhraseLen + 1, cursor );
 			}
 		}
 	}
@@ -1423,6 +1712,348 @@ CHEWING_API int chewing_handle_Numlock( ChewingContext *ctx, int key )
 	return 0;
 }
 
+static void HandleKeyStroke( ChewingContext *ctx, int key )
+{
+	switch ( key ) {
+		case CHEWING_KEY_LEFT:
+			chewing_handle_Left( ctx );
+			break;
+		case CHEWING_KEY_SLEFT:
+			chewing_handle_ShiftLeft( ctx );
+			break;
+		case CHEWING_KEY_RIGHT:
+			chewing_handle_Right( ctx );
+			break;
+		case CHEWING_KEY_SRIGHT:
+			chewing_handle_ShiftRight( ctx );
+			break;
+		case CHEWING_KEY_UP:
+			chewing_handle_Up( ctx );
+			break;
+		case CHEWING_KEY_DOWN:
+			chewing_handle_Down( ctx );
+			break;
+		case ' ':
+			chewing_handle_Space( ctx );
+			break;
+		case CHEWING_KEY_ENTER:
+			chewing_handle_Enter( ctx );
+			break;
+		case CHEWING_KEY_BACKSPACE:
+			chewing_handle_Backspace( ctx );
+			break;
+		case CHEWING_KEY_ESC:
+			chewing_handle_Esc( ctx );
+			break;
+		case CHEWING_KEY_DELETE:
+			chewing_handle_Del( ctx );
+			break;
+		case CHEWING_KEY_HOME:
+			chewing_handle_Home( ctx );
+			break;
+		case CHEWING_KEY_END:
+			chewing_handle_End( ctx );
+			break;
+		case CHEWING_KEY_TAB:
+			chewing_handle_Tab( ctx );
+			break;
+		case CHEWING_KEY_CAPSLOCK:
+			chewing_handle_Capslock( ctx );
+			break;
+		case CHEWING_KEY_NPAGE:
+			chewing_handle_PageDown( ctx );
+			break;
+		case CHEWING_KEY_PPAGE:
+			chewing_handle_PageUp( ctx );
+			break;
+		case CHEWING_KEY_SSPACE:
+			chewing_handle_ShiftSpace( ctx );
+			break;
+		case CHEWING_KEY_DBLTAB:
+			chewing_handle_DblTab( ctx );
+			break;
+		default:
+			if ( CHEWING_KEY_CTRL_BASE <= key && key < CHEWING_KEY_NUMPAD_BASE )
+				chewing_handle_CtrlNum( ctx, key - CHEWING_KEY_CTRL_BASE );
+			else if ( CHEWING_KEY_NUMPAD_BASE <= key )
+				chewing_handle_Numlock( ctx, key - CHEWING_KEY_NUMPAD_BASE );
+			else
+				chewing_handle_Default( ctx, key );
+			break;
+	}
+}
+
+/* Handle one key of a batch, and tell whether it has committed a string. */
+static int HandleBatchKey( ChewingContext *ctx, int key )
+{
+	ctx->output->keystrokeRtn = 0;
+	HandleKeyStroke( ctx, key );
+	return ctx->output->keystrokeRtn & KEYSTROKE_COMMIT;
+}
+
+CHEWING_API int chewing_handle_KeyArray( ChewingContext *ctx, const int *keys, int nKey )
+{
+	int i = 0;
+
+	if ( nKey <= 0 )
+		return 0;
+
+	ctx->data->bDeferPhrasing = 1;
+	while ( i < nKey ) {
+		if ( HandleBatchKey( ctx, keys[ i++ ] ) )
+			break;
+	}
+	MakeDeferredOutput( ctx->output, ctx->data );
+	return i;
+}
+
+/*
+ * Parse one key stroke of chewing_handle_String(). Return the number of
+ * bytes read, or 0 if the escape is malformed.
+ */
+static int ParseKeyString( const char *str, int *key )
+{
+	static const struct {
+		const char *name;
+		int key;
+	} escape_key[] = {
+		{ "TT", CHEWING_KEY_DBLTAB },
+		{ "SS", CHEWING_KEY_SSPACE },
+		{ "PU", CHEWING_KEY_PPAGE },
+		{ "PD", CHEWING_KEY_NPAGE },
+		{ "SL", CHEWING_KEY_SLEFT },
+		{ "SR", CHEWING_KEY_SRIGHT },
+		{ "L", CHEWING_KEY_LEFT },
+		{ "R", CHEWING_KEY_RIGHT },
+		{ "U", CHEWING_KEY_UP },
+		{ "D", CHEWING_KEY_DOWN },
+		{ "E", CHEWING_KEY_ENTER },
+		{ "B", CHEWING_KEY_BACKSPACE },
+		{ "EE", CHEWING_KEY_ESC },
+		{ "DC", CHEWING_KEY_DELETE },
+		{ "H", CHEWING_KEY_HOME },
+		{ "EN", CHEWING_KEY_END },
+		{ "T", CHEWING_KEY_TAB },
+		{ "CB", CHEWING_KEY_CAPSLOCK },
+	};
+	const char *end;
+	size_t i, len;
+
+	if ( str[ 0 ] != '<' ) {
+		*key = (unsigned char) str[ 0 ];
+		return 1;
+	}
+	if ( ( str[ 1 ] == '<' || str[ 1 ] == '>' ) && str[ 2 ] == '>' ) {
+		*key = str[ 1 ];
+		return 3;
+	}
+
+	end = strchr( str + 1, '>' );
+	if ( ! end )
+		return 0;
+	len = end - str - 1;
+
+	for ( i = 0; i < ARRAY_SIZE( escape_key ); i++ ) {
+		if ( strlen( escape_key[ i ].name ) == len &&
+		     ! strncmp( escape_key[ i ].name, str + 1, len ) ) {
+			*key = escape_key[ i ].key;
+			return len + 2;
+		}
+	}
+	if ( len == 2 && str[ 1 ] == 'C' && isdigit( (unsigned char) str[ 2 ] ) ) {
+		*key = CHEWING_KEY_CTRL_BASE + str[ 2 ];
+		return 4;
+	}
+	if ( len == 2 && str[ 1 ] == 'N' ) {
+		*key = CHEWING_KEY_NUMPAD_BASE + str[ 2 ];
+		return 4;
+	}
+	return 0;
+}
+
+CHEWING_API int chewing_handle_String( ChewingContext *ctx, const char *keys )
+{
+	const char *p = keys;
+	int key, len;
+
+	if ( ! *p )
+		return 0;
+
+	ctx->data->bDeferPhrasing = 1;
+	while ( *p ) {
+		len = ParseKeyString( p, &key );
+		if ( len == 0 )
+			break;
+		p += len;
+		if ( HandleBatchKey( ctx, key ) )
+			break;
+	}
+	MakeDeferredOutput( ctx->output, ctx->data );
+	return p - keys;
+}
+
+/*
+ * Conversion phrases whole phone sequences without the keystroke state
+ * machine. It runs on a scratch ChewingData holding the static data of the
+ * context, so that the editing state is kept and nothing is learned.
+ */
+typedef struct {
+	char *str;
+	size_t len;
+	size_t size;
+} ConvertBuffer;
+
+static int ConvertAppend( ConvertBuffer *out, const char *str, size_t len )
+{
+	char *p;
+	size_t size;
+
+	if ( out->len + len + 1 > out->size ) {
+		size = out->size ? out->size * 2 : 64;
+		while ( size < out->len + len + 1 )
+			size *= 2;
+		p = realloc( out->str, size );
+		if ( ! p )
+			return -1;
+		out->str = p;
+		out->size = size;
+	}
+	memcpy( out->str + out->len, str, len );
+	out->len += len;
+	out->str[ out->len ] = '\0';
+	return 0;
+}
+
+static int ConvertFlush( ChewingData *pgdata, ConvertBuffer *out )
+{
+	if ( pgdata->nPhoneSeq == 0 )
+		return 0;
+	Phrasing( pgdata );
+	pgdata->nPhoneSeq = 0;
+	return ConvertAppend( out, pgdata->phrOut.chiBuf, strlen( pgdata->phrOut.chiBuf ) );
+}
+
+/* Sequences longer than the preedit buffer are phrased in pieces. */
+static int ConvertAddPhone( ChewingData *pgdata, KeySeqWord phone, ConvertBuffer *out )
+{
+	if ( pgdata->nPhoneSeq == MAX_CHI_SYMBOL_LEN && ConvertFlush( pgdata, out ) != 0 )
+		return -1;
+	pgdata->phoneSeq[ pgdata->nPhoneSeq++ ] = phone;
+	return 0;
+}
+
+static ChewingData *ConvertBegin( ChewingContext *ctx, ConvertBuffer *out )
+{
+	ChewingData *pgdata = ALC( ChewingData, 1 );
+
+	if ( ! pgdata )
+		return NULL;
+	pgdata->static_data = ctx->data->static_data;
+	pgdata->config = ctx->data->config;
+	pgdata->fuzzyData = ctx->data->fuzzyData;
+	pgdata->zuinData.kbtype = ctx->data->zuinData.kbtype;
+	pgdata->logger = ctx->data->logger;
+	pgdata->loggerData = ctx->data->loggerData;
+
+	memset( out, 0, sizeof( *out ) );
+	if ( ConvertAppend( out, "", 0 ) != 0 ) {
+		free( pgdata );
+		return NULL;
+	}
+	return pgdata;
+}
+
+static char *ConvertEnd( ChewingData *pgdata, ConvertBuffer *out, int ret )
+{
+	if ( ret == 0 )
+		ret = ConvertFlush( pgdata, out );
+	free( pgdata );
+	if ( ret != 0 ) {
+		free( out->str );
+		return NULL;
+	}
+	return out->str;
+}
+
+static int IsConvertSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+CHEWING_API char *chewing_convert_Bopomofo( ChewingContext *ctx, const char *bopomofo )
+{
+	ChewingData *pgdata;
+	ConvertBuffer out;
+	char syllable[ ZUIN_SIZE * MAX_UTF8_SIZE + 1 ];
+	const char *p = bopomofo, *end;
+	Phrase word;
+	KeySeqWord phone;
+	int ret = 0;
+
+	pgdata = ConvertBegin( ctx, &out );
+	if ( ! pgdata )
+		return NULL;
+
+	while ( *p && ret == 0 ) {
+		if ( IsConvertSpace( *p ) ) {
+			p++;
+			continue;
+		}
+		for ( end = p; *end && ! IsConvertSpace( *end ); end++ )
+			;
+
+		phone = 0;
+		if ( (size_t) ( end - p ) < sizeof( syllable ) ) {
+			memcpy( syllable, p, end - p );
+			syllable[ end - p ] = '\0';
+			phone = UintFromPhone( syllable );
+			if ( phone && GetCharFirst( pgdata, &word, phone ) == 0 )
+				phone = 0;
+		}
+
+		/* Anything but a syllable breaks the phrase and is copied as is. */
+		if ( phone )
+			ret = ConvertAddPhone( pgdata, phone, &out );
+		else if ( ( ret = ConvertFlush( pgdata, &out ) ) == 0 )
+			ret = ConvertAppend( &out, p, end - p );
+		p = end;
+	}
+	return ConvertEnd( pgdata, &out, ret );
+}
+
+CHEWING_API char *chewing_convert_Keystroke( ChewingContext *ctx, const char *keys )
+{
+	ChewingData *pgdata;
+	ConvertBuffer out;
+	const char *p;
+	int ret = 0;
+
+	pgdata = ConvertBegin( ctx, &out );
+	if ( ! pgdata )
+		return NULL;
+
+	for ( p = keys; *p && ret == 0; p++ ) {
+		switch ( ZuinPhoInput( pgdata, (unsigned char) *p ) ) {
+			case ZUIN_ABSORB:
+				break;
+			case ZUIN_COMMIT:
+				ret = ConvertAddPhone( pgdata, pgdata->zuinData.phone, &out );
+				ZuinRemoveAll( &pgdata->zuinData );
+				break;
+			case ZUIN_NO_WORD:
+				ZuinRemoveAll( &pgdata->zuinData );
+				break;
+			default:
+				/* Keys out of syllables break the phrase and are copied as is. */
+				ZuinRemoveAll( &pgdata->zuinData );
+				if ( ( ret = ConvertFlush( pgdata, &out ) ) == 0 )
+					ret = ConvertAppend( &out, p, 1 );
+				break;
+		}
+	}
+	return ConvertEnd( pgdata, &out, ret );
+}
+
 CHEWING_API KeySeqWord *chewing_get_phoneSeq( ChewingContext *ctx )
 {
 	KeySeqWord *seq;
@@ -1449,6 +2080,348 @@ CHEWING_API void chewing_set_logger( ChewingContext *ctx,
 	ctx->data->loggerData = data;
 }
 
+/*
+ * A snapshot starts with SNAPSHOT_MAGIC and its version byte, followed by the
+ * editing state as variable length integers: 7 bits per byte, least
+ * significant group first, and zigzag encoded so that small negative values
+ * stay short. Byte strings are stored as their length and their bytes.
+ */
+#define SNAPSHOT_MAGIC "ChS"
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+	unsigned char *buf;
+	int size;
+	int len;
+} SnapshotWriter;
+
+typedef struct {
+	const unsigned char *buf;
+	int size;
+	int pos;
+	int bError;
+} SnapshotReader;
+
+static void PutByte( SnapshotWriter *w, int byte )
+{
+	if ( w->len < w->size )
+		w->buf[ w->len ] = (unsigned char) byte;
+	w->len++;
+}
+
+static void PutInt( SnapshotWriter *w, int value )
+{
+	unsigned int u = ( (unsigned int) value << 1 ) ^ ( value < 0 ? ~0u : 0u );
+
+	while ( u >= 0x80 ) {
+		PutByte( w, ( u & 0x7f ) | 0x80 );
+		u >>= 7;
+	}
+	PutByte( w, u );
+}
+
+static void PutBytes( SnapshotWriter *w, const void *str, int len )
+{
+	int i;
+
+	PutInt( w, len );
+	for ( i = 0; i < len; i++ )
+		PutByte( w, ( (const unsigned char *) str )[ i ] );
+}
+
+static int GetByte( SnapshotReader *r )
+{
+	if ( r->pos >= r->size ) {
+		r->bError = 1;
+		return 0;
+	}
+	return r->buf[ r->pos++ ];
+}
+
+static int GetInt( SnapshotReader *r, int min_value, int max_value )
+{
+	unsigned int u = 0;
+	int byte, shift = 0, value;
+
+	do {
+		byte = GetByte( r );
+		if ( shift > 28 ) {
+			r->bError = 1;
+			return min_value;
+		}
+		u |= (unsigned int) ( byte & 0x7f ) << shift;
+		shift += 7;
+	} while ( byte & 0x80 );
+
+	value = (int) ( u >> 1 ) ^ -(int) ( u & 1 );
+	if ( value < min_value || value > max_value ) {
+		r->bError = 1;
+		return min_value;
+	}
+	return value;
+}
+
+/* Read at most max_len bytes into str, which is left zero terminated. */
+static int GetBytes( SnapshotReader *r, void *str, int max_len )
+{
+	int i, len = GetInt( r, 0, max_len );
+
+	for ( i = 0; i < len; i++ )
+		( (unsigned char *) str )[ i ] = GetByte( r );
+	( (unsigned char *) str )[ len ] = '\0';
+	return len;
+}
+
+static void WriteSnapshot( SnapshotWriter *w, ChewingData *pgdata )
+{
+	ChewingConfigData *config = &pgdata->config;
+	FuzzyData *fuzzy = &pgdata->fuzzyData;
+	ZuinData *zuin = &pgdata->zuinData;
+	int i, j, nClassEntry = 0;
+
+	for ( i = 0; SNAPSHOT_MAGIC[ i ]; i++ )
+		PutByte( w, SNAPSHOT_MAGIC[ i ] );
+	PutByte( w, SNAPSHOT_VERSION );
+
+	PutInt( w, config->candPerPage );
+	PutInt( w, config->maxChiSymbolLen );
+	for ( i = 0; i < MAX_SELKEY; i++ )
+		PutInt( w, config->selKey[ i ] );
+	PutInt( w, config->bAddPhraseForward );
+	PutInt( w, config->bSpaceAsSelection );
+	PutInt( w, config->bEscCleanAllBuf );
+	PutInt( w, config->bAutoShiftCur );
+	PutInt( w, config->bEasySymbolInput );
+	PutInt( w, config->bPhraseChoiceRearward );
+
+	/* Only symbols belonging to a confusion class are stored. */
+	PutInt( w, fuzzy->bFuzzy );
+	PutInt( w, fuzzy->nClass );
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		for ( j = 0; j < 32; j++ )
+			if ( fuzzy->phoneClass[ i ][ j ] )
+				nClassEntry++;
+	PutInt( w, nClassEntry );
+	for ( i = 0; i < ZUIN_SIZE; i++ ) {
+		for ( j = 0; j < 32; j++ ) {
+			if ( fuzzy->phoneClass[ i ][ j ] ) {
+				PutInt( w, i * 32 + j );
+				PutInt( w, fuzzy->phoneClass[ i ][ j ] );
+			}
+		}
+	}
+
+	PutInt( w, pgdata->bLazyPhrasing );
+	PutInt( w, pgdata->bChiSym );
+	PutInt( w, pgdata->bFullShape );
+
+	PutInt( w, zuin->kbtype );
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		PutInt( w, zuin->pho_inx[ i ] );
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		PutInt( w, zuin->pho_inx_alt[ i ] );
+	PutInt( w, zuin->phone );
+	PutInt( w, zuin->phoneAlt );
+	PutBytes( w, zuin->pinYinData.keySeq, strlen( zuin->pinYinData.keySeq ) );
+
+	/* Chinese characters are stored as empty strings. */
+	PutInt( w, pgdata->chiSymbolBufLen );
+	PutInt( w, pgdata->chiSymbolCursor );
+	PutInt( w, pgdata->PointStart );
+	PutInt( w, pgdata->PointEnd );
+	for ( i = 0; i < pgdata->chiSymbolBufLen; i++ ) {
+		if ( pgdata->chiSymbolBuf[ i ].wch == 0 )
+			PutBytes( w, "", 0 );
+		else
+			PutBytes( w, pgdata->chiSymbolBuf[ i ].s,
+				ueBytesFromChar( pgdata->chiSymbolBuf[ i ].s[ 0 ] ) );
+		PutInt( w, (unsigned char) pgdata->symbolKeyBuf[ i ] );
+	}
+
+	PutInt( w, pgdata->nPhoneSeq );
+	for ( i = 0; i < pgdata->nPhoneSeq; i++ ) {
+		PutInt( w, pgdata->phoneSeq[ i ] );
+		PutInt( w, pgdata->phoneSeqAlt[ i ] );
+	}
+	for ( i = 0; i <= pgdata->nPhoneSeq; i++ ) {
+		PutInt( w, SeqBitTest( pgdata->bUserArrBrkpt, i ) );
+		PutInt( w, SeqBitTest( pgdata->bUserArrCnnct, i ) );
+	}
+
+	PutInt( w, pgdata->nSelect );
+	for ( i = 0; i < pgdata->nSelect; i++ ) {
+		PutInt( w, pgdata->selectInterval[ i ].from );
+		PutInt( w, pgdata->selectInterval[ i ].to );
+		PutBytes( w, SelectStr( pgdata, i ), pgdata->selectStr[ i ].len );
+	}
+}
+
+/*
+ * Decode a snapshot into pgdata, which is zero filled by the caller. Every
+ * value is checked, so that a corrupted snapshot is rejected instead of
+ * leading to out of range accesses later.
+ */
+static int ReadSnapshot( SnapshotReader *r, ChewingData *pgdata )
+{
+	static const int MAX_PHO_INX[ ZUIN_SIZE ] = { 21, 3, 13, 4 };
+	ChewingConfigData *config = &pgdata->config;
+	FuzzyData *fuzzy = &pgdata->fuzzyData;
+	ZuinData *zuin = &pgdata->zuinData;
+	char str[ MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1 ];
+	int i, n, len, nChi = 0;
+
+	for ( i = 0; SNAPSHOT_MAGIC[ i ]; i++ )
+		if ( GetByte( r ) != SNAPSHOT_MAGIC[ i ] )
+			return -1;
+	if ( GetByte( r ) != SNAPSHOT_VERSION )
+		return -1;
+
+	config->candPerPage = GetInt( r, MIN_SELKEY, MAX_SELKEY );
+	config->maxChiSymbolLen = GetInt( r, MIN_CHI_SYMBOL_LEN, MAX_CHI_SYMBOL_LEN );
+	for ( i = 0; i < MAX_SELKEY; i++ )
+		config->selKey[ i ] = GetInt( r, INT_MIN, INT_MAX );
+	config->bAddPhraseForward = GetInt( r, 0, 1 );
+	config->bSpaceAsSelection = GetInt( r, 0, 1 );
+	config->bEscCleanAllBuf = GetInt( r, 0, 1 );
+	config->bAutoShiftCur = GetInt( r, 0, 1 );
+	config->bEasySymbolInput = GetInt( r, 0, 1 );
+	config->bPhraseChoiceRearward = GetInt( r, 0, 1 );
+
+	fuzzy->bFuzzy = GetInt( r, 0, 1 );
+	fuzzy->nClass = GetInt( r, 0, 255 );
+	n = GetInt( r, 0, ZUIN_SIZE * 32 );
+	for ( i = 0; i < n && !r->bError; i++ ) {
+		int index = GetInt( r, 0, ZUIN_SIZE * 32 - 1 );
+		fuzzy->phoneClass[ index / 32 ][ index % 32 ] = GetInt( r, 1, fuzzy->nClass );
+	}
+
+	pgdata->bLazyPhrasing = GetInt( r, 0, 1 );
+	pgdata->bChiSym = GetInt( r, 0, 1 );
+	pgdata->bFullShape = GetInt( r, 0, 1 );
+
+	zuin->kbtype = GetInt( r, 0, KB_TYPE_NUM - 1 );
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		zuin->pho_inx[ i ] = GetInt( r, 0, MAX_PHO_INX[ i ] );
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		zuin->pho_inx_alt[ i ] = GetInt( r, 0, MAX_PHO_INX[ i ] );
+	zuin->phone = GetInt( r, 0, 0xffff );
+	zuin->phoneAlt = GetInt( r, 0, 0xffff );
+	GetBytes( r, zuin->pinYinData.keySeq, PINYIN_SIZE - 1 );
+
+	pgdata->chiSymbolBufLen = GetInt( r, 0, MAX_PHONE_SEQ_LEN - 1 );
+	pgdata->chiSymbolCursor = GetInt( r, 0, pgdata->chiSymbolBufLen );
+	pgdata->PointStart = GetInt( r, -1, pgdata->chiSymbolBufLen );
+	pgdata->PointEnd = GetInt( r, -9, 9 );
+	for ( i = 0; i < pgdata->chiSymbolBufLen && !r->bError; i++ ) {
+		len = GetBytes( r, pgdata->chiSymbolBuf[ i ].s, MAX_UTF8_SIZE );
+		if ( len == 0 )
+			nChi++;
+		else if ( ueBytesFromChar( pgdata->chiSymbolBuf[ i ].s[ 0 ] ) != len )
+			return -1;
+		pgdata->symbolKeyBuf[ i ] = (char) GetInt( r, 0, 255 );
+	}
+
+	pgdata->nPhoneSeq = GetInt( r, nChi, nChi );
+	for ( i = 0; i < pgdata->nPhoneSeq; i++ ) {
+		pgdata->phoneSeq[ i ] = GetInt( r, 0, 0xffff );
+		pgdata->phoneSeqAlt[ i ] = GetInt( r, 0, 0xffff );
+	}
+	for ( i = 0; i <= pgdata->nPhoneSeq; i++ ) {
+		if ( GetInt( r, 0, 1 ) )
+			pgdata->bUserArrBrkpt |= SeqBit( i );
+		if ( GetInt( r, 0, 1 ) )
+			pgdata->bUserArrCnnct |= SeqBit( i );
+	}
+
+	pgdata->nSelect = GetInt( r, 0, pgdata->nPhoneSeq );
+	for ( i = 0; i < pgdata->nSelect && !r->bError; i++ ) {
+		pgdata->selectInterval[ i ].from = GetInt( r, 0, pgdata->nPhoneSeq - 1 );
+		pgdata->selectInterval[ i ].to = GetInt( r,
+			pgdata->selectInterval[ i ].from + 1,
+			min( pgdata->selectInterval[ i ].from + MAX_PHRASE_LEN, pgdata->nPhoneSeq ) );
+		len = GetBytes( r, str, sizeof( str ) - 1 );
+		if ( r->bError || ueStrLen( str ) !=
+				pgdata->selectInterval[ i ].to - pgdata->selectInterval[ i ].from )
+			return -1;
+		pgdata->selectStr[ i ].offset = StringPoolAppend( &pgdata->selectPool, str, len );
+		pgdata->selectStr[ i ].len = len;
+		if ( pgdata->selectStr[ i ].offset < 0 )
+			return -1;
+	}
+
+	if ( r->bError || r->pos != r->size )
+		return -1;
+	return 0;
+}
+
+CHEWING_API int chewing_snapshot( ChewingContext *ctx, char *buf, int len )
+{
+	SnapshotWriter w;
+
+	w.buf = (unsigned char *) buf;
+	w.size = buf ? len : 0;
+	w.len = 0;
+	WriteSnapshot( &w, ctx->data );
+	return w.len;
+}
+
+CHEWING_API int chewing_restore( ChewingContext *ctx, const char *buf, int len )
+{
+	ChewingData *pgdata = ctx->data;
+	ChewingData *state;
+	SnapshotReader r;
+
+	if ( !buf || len <= 0 )
+		return -1;
+	state = ALC( ChewingData, 1 );
+	if ( !state )
+		return -1;
+
+	r.buf = (const unsigned char *) buf;
+	r.size = len;
+	r.pos = 0;
+	r.bError = 0;
+	if ( ReadSnapshot( &r, state ) < 0 ) {
+		StringPoolFree( &state->selectPool );
+		free( state );
+		return -1;
+	}
+
+	chewing_Reset( ctx );
+	pgdata->config = state->config;
+	pgdata->fuzzyData = state->fuzzyData;
+	pgdata->bLazyPhrasing = state->bLazyPhrasing;
+	pgdata->bDeferPhrasing = state->bLazyPhrasing;
+	pgdata->bChiSym = state->bChiSym;
+	pgdata->bFullShape = state->bFullShape;
+	pgdata->zuinData = state->zuinData;
+
+	pgdata->chiSymbolBufLen = state->chiSymbolBufLen;
+	pgdata->chiSymbolCursor = state->chiSymbolCursor;
+	pgdata->PointStart = state->PointStart;
+	pgdata->PointEnd = pgdata->PointStart == -1 ? 0 : state->PointEnd;
+	memcpy( pgdata->chiSymbolBuf, state->chiSymbolBuf,
+		sizeof( pgdata->chiSymbolBuf[ 0 ] ) * state->chiSymbolBufLen );
+	memcpy( pgdata->symbolKeyBuf, state->symbolKeyBuf, state->chiSymbolBufLen );
+
+	pgdata->nPhoneSeq = state->nPhoneSeq;
+	memcpy( pgdata->phoneSeq, state->phoneSeq, sizeof( KeySeqWord ) * state->nPhoneSeq );
+	memcpy( pgdata->phoneSeqAlt, state->phoneSeqAlt, sizeof( KeySeqWord ) * state->nPhoneSeq );
+	pgdata->bUserArrBrkpt = state->bUserArrBrkpt & SeqBitRange( 0, state->nPhoneSeq + 1 );
+	pgdata->bUserArrCnnct = state->bUserArrCnnct & SeqBitRange( 0, state->nPhoneSeq + 1 );
+
+	/* The strings of the selections are handed over with their pool. */
+	pgdata->nSelect = state->nSelect;
+	memcpy( pgdata->selectInterval, state->selectInterval, sizeof( IntervalType ) * state->nSelect );
+	memcpy( pgdata->selectStr, state->selectStr, sizeof( StringRef ) * state->nSelect );
+	pgdata->selectPool = state->selectPool;
+	free( state );
+
+	CallPhrasing( pgdata );
+	MakeOutputWithRtn( ctx->output, pgdata, KEYSTROKE_ABSORB );
+	return 0;
+}
+
 #ifdef SUPPORT_MULTI_IM
 CHEWING_API char *chewing_get_IM( ChewingContext *ctx, char *buffer, size_t buf_size )
 {
@@ -1473,6 +2446,10 @@ CHEWING_API int switch_IM( ChewingContext *ctx, const char *IM_name )
 	if( !IM_name ) IM_name = "";
 	if( !strcmp(ctx->data->static_data.IM_name, IM_name) ) return 0;
 
+	/* The tree is shared with other contexts, see chewing_new_from_template(). */
+	if( ctx->data->static_data.shared_count &&
+	    plat_atomic_load_int( ctx->data->static_data.shared_count ) > 1 ) return 0;
+
 	/* It does not send selected range into hash. */
 	CheckAndResetRange( ctx->data );
 
@@ -1480,7 +2457,7 @@ CHEWING_API int switch_IM( ChewingContext *ctx, const char *IM_name )
 	do chewing_handle_Enter( ctx );
 	while( ctx->output->keystrokeRtn!=KEYSTROKE_IGNORE || ctx->output->keystrokeRtn!=KEYSTROKE_COMMIT );
 
-	TerminateTree( ctx->data );
+	TerminateDictLayers( ctx->data );
 	if( ctx->data->static_data.IM_name ) free( ctx->data->static_data.IM_name);
 	ctx->data->static_data.IM_name = (char*)malloc( strlen(IM_name)+2 );
 	strcpy( ctx->data->static_data.IM_name, IM_name );
@@ -1492,7 +2469,7 @@ CHEWING_API int switch_IM( ChewingContext *ctx, const char *IM_name )
 	ret = open_DICT_FILES( IM_name, search_path, path, sizeof(path) );
 	if( ret ) return 0;
 
-	ret = InitTree( ctx->data, path );
+	ret = InitDictLayers( ctx->data, path );
 	if( ret ) return 0;
 
 	return 1;
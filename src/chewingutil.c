@@ -141,14 +141,14 @@ int HaninSymbolInput( ChewingData *pgdata )
 	if ( ! pgdata->static_data.symbol_table )
 		return ZUIN_ABSORB;
 
-	pci->nTotalChoice = 0;
+	ChoiceInfoClear( pci );
 	for ( i = 0; i < pgdata->static_data.n_symbol_entry; i++ ) {
-		strcpy( pci->totalChoiceStr[ pci->nTotalChoice ],
-			pgdata->static_data.symbol_table[ i ]->category );
-		pci->nTotalChoice++;
+		ChoiceInfoAppend( pci,
+			pgdata->static_data.symbol_table[ i ]->category,
+			strlen( pgdata->static_data.symbol_table[ i ]->category ) );
 	}
 	pai->avail[ 0 ].len = 1;
-	pai->avail[ 0 ].id = NULL;
+	memset( pai->avail[ 0 ].id, 0, sizeof( pai->avail[ 0 ].id ) );
 	pai->nAvail = 1;
 	pai->currentAvail = 0;
 	pci->nChoicePerPage = pgdata->config.candPerPage;
@@ -182,7 +182,7 @@ static int _Inner_InternalSpecialSymbol(
 			sizeof( pgdata->symbolKeyBuf[0] ) *
 			( pgdata->chiSymbolBufLen - pgdata->chiSymbolCursor ) );
 		pgdata->symbolKeyBuf[ pgdata->chiSymbolCursor ] = key;
-		pgdata->bUserArrCnnct[ PhoneSeqCursor( pgdata ) ] = 0;
+		pgdata->bUserArrCnnct &= ~SeqBit( PhoneSeqCursor( pgdata ) );
 		pgdata->chiSymbolCursor++;
 		pgdata->chiSymbolBufLen++;
 		/* reset Zuin data */
@@ -353,14 +353,13 @@ int SymbolChoice( ChewingData *pgdata, int sel_i )
 		AvailInfo* pai = &pgdata->availInfo;
 
 		/* Display all symbols in this category */
-		pci->nTotalChoice = 0;
+		ChoiceInfoClear( pci );
 		for ( i = 0; i < pgdata->static_data.symbol_table[ sel_i ]->nSymbols; i++ ) {
-			ueStrNCpy( pci->totalChoiceStr[ pci->nTotalChoice ],
-					pgdata->static_data.symbol_table[ sel_i ]->symbols[ i ], 1, 1 );
-			pci->nTotalChoice++;
+			const char *symbol = pgdata->static_data.symbol_table[ sel_i ]->symbols[ i ];
+			ChoiceInfoAppend( pci, symbol, ueBytesFromChar( symbol[ 0 ] ) );
 		}
 		pai->avail[ 0 ].len = 1;
-		pai->avail[ 0 ].id = NULL;
+		memset( pai->avail[ 0 ].id, 0, sizeof( pai->avail[ 0 ].id ) );
 		pai->nAvail = 1;
 		pai->currentAvail = 0;
 		pci->nChoicePerPage = pgdata->config.candPerPage;
@@ -380,13 +379,13 @@ int SymbolChoice( ChewingData *pgdata, int sel_i )
 		}
 		pgdata->chiSymbolBuf[ pgdata->chiSymbolCursor ].wch = 0;
 		ueStrNCpy( (char *) pgdata->chiSymbolBuf[ pgdata->chiSymbolCursor ].s,
-				pgdata->choiceInfo.totalChoiceStr[ sel_i ], 1, 1);
+				ChoiceInfoString( &pgdata->choiceInfo, sel_i ), 1, 1);
 
 		/* This is very strange */
-		key = FindSymbolKey( pgdata->choiceInfo.totalChoiceStr[ sel_i ] );
+		key = FindSymbolKey( ChoiceInfoString( &pgdata->choiceInfo, sel_i ) );
 		pgdata->symbolKeyBuf[ pgdata->chiSymbolCursor ] = key ? key : '0';
 
-		pgdata->bUserArrCnnct[ PhoneSeqCursor( pgdata ) ] = 0;
+		pgdata->bUserArrCnnct &= ~SeqBit( PhoneSeqCursor( pgdata ) );
 		ChoiceEndChoice(pgdata);
 		/* Don't forget the kbtype */
 		kbtype = pgdata->zuinData.kbtype;
@@ -423,7 +422,7 @@ int SymbolInput( int key, ChewingData *pgdata )
 			( pgdata->chiSymbolBufLen - pgdata->chiSymbolCursor ) );
 			pgdata->symbolKeyBuf[ pgdata->chiSymbolCursor ] = toupper( key );
 
-		pgdata->bUserArrCnnct[ PhoneSeqCursor( pgdata ) ] = 0;
+		pgdata->bUserArrCnnct &= ~SeqBit( PhoneSeqCursor( pgdata ) );
 		pgdata->chiSymbolCursor++;
 		pgdata->chiSymbolBufLen++;
 		return SYMBOL_KEY_OK;
@@ -453,6 +452,7 @@ int WriteChiSymbolToBuf( wch_t csBuf[], int csBufLen, ChewingData *pgdata )
 {
 	int i, phoneseq_i = 0;
 
+	FlushPhrasing( pgdata );
 	for ( i = 0 ; i < csBufLen; i++ ) {
 		if ( ChewingIsChiAt( i, pgdata ) ) {
 			/*
@@ -479,6 +479,7 @@ static int CountReleaseNum( ChewingData *pgdata )
 	if ( remain >= 0 )
 		return 0;
 
+	FlushPhrasing( pgdata );
 	qsort(
 		pgdata->preferInterval,
 		pgdata->nPrefer,
@@ -510,6 +511,55 @@ static void KillFromLeft( ChewingData *pgdata, int nKill )
 		ChewingKillChar( pgdata, 0, DECREASE_CURSOR );
 }
 
+int StringPoolAppend( StringPool *pool, const char *str, int len )
+{
+	char *buf;
+	int size;
+
+	if ( pool->len + len + 1 > pool->size ) {
+		size = pool->size ? pool->size : STRING_POOL_INIT_SIZE;
+		while ( size < pool->len + len + 1 )
+			size *= 2;
+		buf = realloc( pool->buf, size );
+		if ( ! buf )
+			return -1;
+		pool->buf = buf;
+		pool->size = size;
+	}
+	memcpy( pool->buf + pool->len, str, len );
+	pool->buf[ pool->len + len ] = '\0';
+	pool->len += len + 1;
+	return pool->len - len - 1;
+}
+
+void StringPoolCompact( StringPool *pool, StringRef refs[], int nRef )
+{
+	char *buf;
+	int i, len = 0;
+
+	if ( ! pool->buf )
+		return;
+	/* On failure the pool is simply left as it is. */
+	buf = ALC( char, pool->size );
+	if ( ! buf )
+		return;
+	for ( i = 0; i < nRef; i++ ) {
+		memcpy( buf + len, pool->buf + refs[ i ].offset, refs[ i ].len + 1 );
+		refs[ i ].offset = len;
+		len += refs[ i ].len + 1;
+	}
+	free( pool->buf );
+	pool->buf = buf;
+	pool->len = len;
+}
+
+void StringPoolFree( StringPool *pool )
+{
+	free( pool->buf );
+	pool->buf = NULL;
+	pool->len = pool->size = 0;
+}
+
 void CleanAllBuf( ChewingData *pgdata )
 {
 	/* 1 */
@@ -519,13 +569,14 @@ void CleanAllBuf( ChewingData *pgdata )
 	pgdata->chiSymbolBufLen = 0;
 	memset( pgdata->chiSymbolBuf, 0, sizeof( pgdata->chiSymbolBuf ) );
 	/* 3 */
-	memset( pgdata->bUserArrBrkpt, 0, sizeof( pgdata->bUserArrBrkpt ) );
+	pgdata->bUserArrBrkpt = 0;
 	/* 4 */
 	pgdata->nSelect = 0;
+	pgdata->selectPool.len = 0;
 	/* 5 */
 	pgdata->chiSymbolCursor = 0;
 	/* 6 */
-	memset( pgdata->bUserArrCnnct, 0, sizeof( pgdata->bUserArrCnnct ) );
+	pgdata->bUserArrCnnct = 0;
 
 	pgdata->phrOut.nNumCut = 0;
 
@@ -614,6 +665,7 @@ void AutoLearnPhrase( ChewingData *pgdata )
 	int prev_pos = 0;
 	int pending = 0;
 
+	FlushPhrasing( pgdata );
 	for ( i = 0; i < pgdata->nPrefer; i++ ) {
 		from = pgdata->preferInterval[ i ].from;
 		len = pgdata->preferInterval[i].to - from;
@@ -662,14 +714,10 @@ int AddChi( KeySeqWord phone, KeySeqWord phoneAlt, ChewingData *pgdata )
 
 	/* shift the Brkpt */
 	assert( pgdata->nPhoneSeq >= cursor );
-	memmove(
-		&( pgdata->bUserArrBrkpt[ cursor + 2 ] ),
-		&( pgdata->bUserArrBrkpt[ cursor + 1 ] ),
-		sizeof( int ) * ( pgdata->nPhoneSeq - cursor ) );
-	memmove(
-		&( pgdata->bUserArrCnnct[ cursor + 2 ] ),
-		&( pgdata->bUserArrCnnct[ cursor + 1 ] ),
-		sizeof( int ) * ( pgdata->nPhoneSeq - cursor ) );
+	pgdata->bUserArrBrkpt = SeqBitMove( pgdata->bUserArrBrkpt,
+		cursor + 2, cursor + 1, pgdata->nPhoneSeq - cursor );
+	pgdata->bUserArrCnnct = SeqBitMove( pgdata->bUserArrCnnct,
+		cursor + 2, cursor + 1, pgdata->nPhoneSeq - cursor );
 
 	/* add to phoneSeq */
 	memmove(
@@ -717,24 +765,24 @@ static void ShowChewingData( ChewingData *pgdata )
 	for ( i = 0; i < pgdata->nSelect; i++ ) {
 		DEBUG_OUT(
 			"  %14s%4d%4d\n",
-			pgdata->selectStr[ i ],
+			SelectStr( pgdata, i ),
 			pgdata->selectInterval[ i ].from,
 			pgdata->selectInterval[ i ].to );
 	}
 
 	DEBUG_OUT( "bUserArrCnnct : " );
 	for ( i = 0; i <= pgdata->nPhoneSeq; i++ )
-		DEBUG_OUT( "%d ", pgdata->bUserArrCnnct[ i ] );
+		DEBUG_OUT( "%d ", SeqBitTest( pgdata->bUserArrCnnct, i ) );
 	DEBUG_OUT( "\n" );
 
 	DEBUG_OUT( "bUserArrBrkpt : " );
 	for ( i = 0; i <= pgdata->nPhoneSeq; i++ )
-		DEBUG_OUT( "%d ", pgdata->bUserArrBrkpt[ i ] );
+		DEBUG_OUT( "%d ", SeqBitTest( pgdata->bUserArrBrkpt, i ) );
 	DEBUG_OUT( "\n" );
 
 	DEBUG_OUT( "bArrBrkpt     : " );
 	for ( i = 0; i <= pgdata->nPhoneSeq; i++ )
-		DEBUG_OUT( "%d ", pgdata->bArrBrkpt[ i ] );
+		DEBUG_OUT( "%d ", SeqBitTest( pgdata->bArrBrkpt, i ) );
 	DEBUG_OUT( "\n" );
 
 	DEBUG_OUT(
@@ -747,33 +795,42 @@ int CallPhrasing( ChewingData *pgdata )
 {
 	/* set "bSymbolArrBrkpt" && "bArrBrkpt" */
 	int i, ch_count = 0;
+	SeqBits brkpt;
 
-	memcpy(
-		pgdata->bArrBrkpt,
-		pgdata->bUserArrBrkpt,
-		(MAX_PHONE_SEQ_LEN + 1) * sizeof( int ) );
-	memset(
-		pgdata->bSymbolArrBrkpt, 0,
-		(MAX_PHONE_SEQ_LEN + 1) * sizeof( int ) );
-
+	pgdata->bSymbolArrBrkpt = 0;
 	for ( i = 0; i < pgdata->chiSymbolBufLen; i++ ) {
 		if ( ChewingIsChiAt( i, pgdata ) )
 			ch_count++;
-		else {
-			pgdata->bArrBrkpt[ ch_count ] = 1;
-			pgdata->bSymbolArrBrkpt[ ch_count ] = 1;
-		}
+		else
+			pgdata->bSymbolArrBrkpt |= SeqBit( ch_count );
 	}
+	pgdata->bArrBrkpt = pgdata->bUserArrBrkpt | pgdata->bSymbolArrBrkpt;
 
 	/* kill select interval */
-	for ( i = 0; i < pgdata->nPhoneSeq; i++ ) {
-		if ( pgdata->bArrBrkpt[ i ] ) {
-			ChewingKillSelectIntervalAcross( i, pgdata );
-		}
-	}
+	brkpt = pgdata->bArrBrkpt & SeqBitRange( 0, pgdata->nPhoneSeq );
+	for ( ; brkpt; brkpt &= brkpt - 1 )
+		ChewingKillSelectIntervalAcross( SeqBitLowest( brkpt ), pgdata );
 
 	ShowChewingData(pgdata);
 
+	pgdata->bPhrasingDirty = 1;
+	/*
+	 * A pending Tab cut is resolved against the phrasing list of the
+	 * moment, so it cannot be postponed.
+	 */
+	if ( pgdata->bDeferPhrasing && pgdata->phrOut.nNumCut == 0 )
+		return 0;
+
+	return FlushPhrasing( pgdata );
+}
+
+/* Run the phrasing postponed by CallPhrasing, if any. */
+int FlushPhrasing( ChewingData *pgdata )
+{
+	if ( ! pgdata->bPhrasingDirty )
+		return 0;
+	pgdata->bPhrasingDirty = 0;
+
 	/* then phrasing */
 	Phrasing( pgdata );
 
@@ -827,7 +884,7 @@ static void MakePreferInterval( ChewingData *pgdata )
 
 	/* for each connect point */
 	for ( i = 1; i < pgdata->nPhoneSeq; i++ ) {
-		if ( pgdata->bUserArrCnnct[ i ] ) {
+		if ( SeqBitTest( pgdata->bUserArrCnnct, i ) ) {
 			Union( belong_set[ i - 1 ], belong_set[ i ], parent );
 		}
 	}
@@ -872,6 +929,9 @@ static int MakeOutput( ChewingOutput *pgo, ChewingData *pgdata )
 {
 	int chi_i, chiSymbol_i, i ;
 
+	FlushPhrasing( pgdata );
+	pgdata->bOutputDirty = 0;
+
 	/* fill zero to chiSymbolBuf first */
 	memset( pgo->chiSymbolBuf, 0, sizeof( wch_t ) * MAX_PHONE_SEQ_LEN );
 
@@ -939,9 +999,7 @@ static int MakeOutput( ChewingOutput *pgo, ChewingData *pgdata )
 	}
 
 	ShiftInterval( pgo, pgdata );
-	memcpy(
-		pgo->dispBrkpt, pgdata->bUserArrBrkpt,
-		sizeof( pgo->dispBrkpt[ 0 ] ) * ( MAX_PHONE_SEQ_LEN + 1 ) );
+	pgo->dispBrkpt = pgdata->bUserArrBrkpt;
 	pgo->pci = &( pgdata->choiceInfo );
 	pgo->bChiSym = pgdata->bChiSym;
 	memcpy( pgo->selKey, pgdata->config.selKey, sizeof( pgdata->config.selKey ) );
@@ -952,9 +1010,39 @@ static int MakeOutput( ChewingOutput *pgo, ChewingData *pgdata )
 int MakeOutputWithRtn( ChewingOutput *pgo, ChewingData *pgdata, int keystrokeRtn )
 {
 	pgo->keystrokeRtn = keystrokeRtn;
+	if ( pgdata->bDeferPhrasing ) {
+		/* built on demand by FlushOutput() */
+		pgo->bShowMsg = 0;
+		pgdata->bOutputDirty = 1;
+		return 0;
+	}
 	return MakeOutput( pgo, pgdata );
 }
 
+/* Build the output postponed by MakeOutputWithRtn, if any. */
+void FlushOutput( ChewingOutput *pgo, ChewingData *pgdata )
+{
+	int bShowMsg = pgo->bShowMsg;
+
+	if ( ! pgdata->bOutputDirty )
+		return;
+
+	MakeOutput( pgo, pgdata );
+	if ( bShowMsg )
+		MakeOutputAddMsgAndCleanInterval( pgo, pgdata );
+}
+
+/*
+ * Leave batch mode. The output of the last key is built now, unless lazy
+ * phrasing mode postpones it until it is read.
+ */
+void MakeDeferredOutput( ChewingOutput *pgo, ChewingData *pgdata )
+{
+	pgdata->bDeferPhrasing = pgdata->bLazyPhrasing;
+	if ( ! pgdata->bDeferPhrasing )
+		FlushOutput( pgo, pgdata );
+}
+
 void MakeOutputAddMsgAndCleanInterval( ChewingOutput *pgo, ChewingData *pgdata )
 {
 	pgo->bShowMsg = 1;
@@ -972,9 +1060,10 @@ int AddSelect( ChewingData *pgdata, int sel_i )
 	nSelect = pgdata->nSelect;
 
 	/* change "selectStr" , "selectInterval" , and "nSelect" of ChewingData */
-	ueStrNCpy( pgdata->selectStr[ nSelect ],
-			pgdata->choiceInfo.totalChoiceStr[ sel_i ],
-			length, 1 );
+	if ( SetSelectStr( pgdata, nSelect,
+			ChoiceInfoString( &pgdata->choiceInfo, sel_i ),
+			length ) < 0 )
+		return -1;
 	cursor = PhoneSeqCursor( pgdata );
 	pgdata->selectInterval[ nSelect ].from = cursor;
 	pgdata->selectInterval[ nSelect ].to = cursor + length;
@@ -1024,7 +1113,29 @@ void RemoveSelectElement( int i, ChewingData *pgdata )
 	if ( --pgdata->nSelect == i )
 		return;
 	pgdata->selectInterval[ i ] = pgdata->selectInterval[ pgdata->nSelect ];
-	strcpy( pgdata->selectStr[ i ], pgdata->selectStr[ pgdata->nSelect ] );
+	pgdata->selectStr[ i ] = pgdata->selectStr[ pgdata->nSelect ];
+}
+
+const char *SelectStr( ChewingData *pgdata, int i )
+{
+	return pgdata->selectPool.buf + pgdata->selectStr[ i ].offset;
+}
+
+int SetSelectStr( ChewingData *pgdata, int i, const char *str, int nChar )
+{
+	StringPool *pool = &pgdata->selectPool;
+	int len = ueStrNBytes( str, nChar );
+	int offset;
+
+	/* Strings of removed selections are dropped before growing. */
+	if ( pool->len + len + 1 > pool->size )
+		StringPoolCompact( pool, pgdata->selectStr, pgdata->nSelect );
+	offset = StringPoolAppend( pool, str, len );
+	if ( offset < 0 )
+		return -1;
+	pgdata->selectStr[ i ].offset = offset;
+	pgdata->selectStr[ i ].len = len;
+	return 0;
 }
 
 static int ChewingKillSelectIntervalAcross( int cursor, ChewingData *pgdata )
@@ -1056,14 +1167,10 @@ static int KillCharInSelectIntervalAndBrkpt( ChewingData *pgdata, int cursorToKi
 		}
 	}
 	assert ( pgdata->nPhoneSeq >= cursorToKill );
-	memmove(
-		&( pgdata->bUserArrBrkpt[ cursorToKill ] ),
-		&( pgdata->bUserArrBrkpt[ cursorToKill + 1 ] ),
-		sizeof( int ) * ( pgdata->nPhoneSeq - cursorToKill ) );
-	memmove(
-		&( pgdata->bUserArrCnnct[ cursorToKill ] ),
-		&( pgdata->bUserArrCnnct[ cursorToKill + 1 ] ),
-		sizeof( int ) * ( pgdata->nPhoneSeq - cursorToKill ) );
+	pgdata->bUserArrBrkpt = SeqBitMove( pgdata->bUserArrBrkpt,
+		cursorToKill, cursorToKill + 1, pgdata->nPhoneSeq - cursorToKill );
+	pgdata->bUserArrCnnct = SeqBitMove( pgdata->bUserArrCnnct,
+		cursorToKill, cursorToKill + 1, pgdata->nPhoneSeq - cursorToKill );
 
 	return 0;
 }
@@ -1104,6 +1211,7 @@ int IsPreferIntervalConnted( int cursor, ChewingData *pgdata )
 {
 	int i;
 
+	FlushPhrasing( pgdata );
 	for ( i = 0; i < pgdata->nPrefer; i++ ) {
 		if (
 			pgdata->preferInterval[ i ].from < cursor &&
@@ -1304,12 +1412,9 @@ int OpenSymbolChoice( ChewingData *pgdata )
 		ChoiceEndChoice( pgdata );
 		return 0;
 	}
-	pci->nTotalChoice = 0;
-	for ( i = 1; pBuf[ i ]; i++ ) {
-		ueStrNCpy( pci->totalChoiceStr[ pci->nTotalChoice ],
-				pBuf[ i ], ueStrLen( pBuf[i] ), 1 );
-		pci->nTotalChoice++;
-	}
+	ChoiceInfoClear( pci );
+	for ( i = 1; pBuf[ i ]; i++ )
+		ChoiceInfoAppend( pci, pBuf[ i ], strlen( pBuf[ i ] ) );
 
 	pci->nChoicePerPage = pgdata->config.candPerPage;
 	assert( pci->nTotalChoice > 0 );
@@ -1320,7 +1425,7 @@ int OpenSymbolChoice( ChewingData *pgdata )
 	pgdata->bSelect = 1;
 	pgdata->availInfo.nAvail = 1;
 	pgdata->availInfo.currentAvail = 0;
-	pgdata->availInfo.avail[ 0 ].id = NULL;
+	memset( pgdata->availInfo.avail[ 0 ].id, 0, sizeof( pgdata->availInfo.avail[ 0 ].id ) );
 	pgdata->availInfo.avail[ 0 ].len = 1;
 	return 0;
 }
@@ -17,6 +17,7 @@
  * @brief Choice module
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -57,15 +58,12 @@ static void ChangeSelectIntervalAndBreakpoint(
 	if ( ( user_alloc = ( to - from ) ) == 0 )
 		return;
 
-	ueStrNCpy( pgdata->selectStr[ pgdata->nSelect ],
-			str,
-			user_alloc, 1);
+	if ( SetSelectStr( pgdata, pgdata->nSelect, str, user_alloc ) < 0 )
+		return;
 	pgdata->nSelect++;
 
-	if ( user_alloc > 1 ) {
-		memset( &pgdata->bUserArrBrkpt[ from + 1 ], 0, sizeof( int ) * ( user_alloc - 1 ) );
-		memset( &pgdata->bUserArrCnnct[ from + 1 ], 0, sizeof( int ) * ( user_alloc - 1 ) );
-	}
+	pgdata->bUserArrBrkpt &= ~SeqBitRange( from + 1, to );
+	pgdata->bUserArrCnnct &= ~SeqBitRange( from + 1, to );
 }
 
 /** @brief Loading all possible phrases after the cursor from long to short into AvailInfo structure.*/
@@ -74,9 +72,10 @@ static void SetAvailInfo( ChewingData *pgdata, int begin, int end)
 	AvailInfo *pai = &( pgdata->availInfo );
 	const KeySeqWord *phoneSeq = pgdata->phoneSeq;
 	int nPhoneSeq = pgdata->nPhoneSeq;
-	const int *bSymbolArrBrkpt = pgdata->bSymbolArrBrkpt;
+	SeqBits symbol_brkpt;
 
-	const TreeType *tree_pos;
+	const TreeType *tree_pos, *node[ MAX_DICT_LAYER ];
+	int nLayer = pgdata->static_data.nLayer;
 	int diff;
 	KeySeqWord userPhoneSeq[ MAX_PHONE_SEQ_LEN ];
 
@@ -88,10 +87,10 @@ static void SetAvailInfo( ChewingData *pgdata, int begin, int end)
 	pai->nAvail = 0;
 
 	if ( pgdata->config.bPhraseChoiceRearward ) {
-		for ( i = end; i >= begin; i--){
-			head = i;
-			if ( bSymbolArrBrkpt[ i ] )
-				break;
+		/* back to the last symbol break point in [begin, end], or begin */
+		if ( end >= begin ) {
+			symbol_brkpt = pgdata->bSymbolArrBrkpt & SeqBitRange( begin, end + 1 );
+			head = symbol_brkpt ? SeqBitHighest( symbol_brkpt ) : begin;
 		}
 		head_tmp = end;
 	} else {
@@ -101,22 +100,39 @@ static void SetAvailInfo( ChewingData *pgdata, int begin, int end)
 	if ( pgdata->config.bPhraseChoiceRearward ) {
 		tail_tmp = tail = end;
 	} else {
-		for ( i = begin; i < nPhoneSeq; i++ ) {
-			if ( bSymbolArrBrkpt[ i ] )
-				break;
-			tail = i;
-		}
+		/* up to the first symbol break point from begin, or the end */
+		symbol_brkpt = pgdata->bSymbolArrBrkpt & SeqBitRange( begin, nPhoneSeq );
+		i = symbol_brkpt ? SeqBitLowest( symbol_brkpt ) : nPhoneSeq;
+		if ( i > begin )
+			tail = i - 1;
 		tail_tmp = begin;
 	}
 
+	/*
+	 * Walking forward, the phrases share their head, so each layer keeps a
+	 * prefix cursor extended by one phone per step.
+	 */
+	for ( i = 0; i < nLayer; i++ )
+		node[ i ] = pgdata->static_data.layer[ i ].tree;
+
 	while ( head <= head_tmp && tail_tmp <= tail ) {
 		diff = tail_tmp - head_tmp;
-		tree_pos = TreeFindPhrase( pgdata, head_tmp, tail_tmp, phoneSeq );
+		pai->avail[ pai->nAvail ].len = 0;
+		for ( i = 0; i < nLayer; i++ ) {
+			if ( pgdata->config.bPhraseChoiceRearward ) {
+				tree_pos = TreeFindPhrase( pgdata, i, head_tmp, tail_tmp, phoneSeq );
+			} else {
+				if ( node[ i ] )
+					node[ i ] = TreeFindChild( pgdata, i, node[ i ], phoneSeq[ tail_tmp ] );
+				tree_pos = node[ i ] && TreeHasPhrase( pgdata, i, node[ i ] ) ? node[ i ] : NULL;
+			}
+			pai->avail[ pai->nAvail ].id[ i ] = tree_pos;
+			if ( tree_pos )
+				pai->avail[ pai->nAvail ].len = diff + 1;
+		}
 
-		if ( tree_pos ) {
+		if ( pai->avail[ pai->nAvail ].len ) {
 			/* save it! */
-			pai->avail[ pai->nAvail ].len = diff + 1;
-			pai->avail[ pai->nAvail ].id = tree_pos;
 			pai->nAvail++;
 		}
 		else {
@@ -128,11 +144,7 @@ static void SetAvailInfo( ChewingData *pgdata, int begin, int end)
 			if ( UserGetPhraseFirst( pgdata, userPhoneSeq ) ) {
 				/* save it! */
 				pai->avail[ pai->nAvail ].len = diff + 1;
-				pai->avail[ pai->nAvail ].id = NULL;
 				pai->nAvail++;
-			} else {
-				pai->avail[ pai->nAvail ].len = 0;
-				pai->avail[ pai->nAvail ].id = NULL;
 			}
 		}
 
@@ -144,36 +156,272 @@ static void SetAvailInfo( ChewingData *pgdata, int begin, int end)
 	}
 }
 
-/* FIXME: Improper use of len parameter */
-static int ChoiceTheSame( ChoiceInfo *pci, const char *str, int len )
+void ChoiceInfoClear( ChoiceInfo *pci )
 {
-	int i;
+	pci->nTotalChoice = 0;
+	/* Slots of older generations count as empty, so nothing is wiped. */
+	if ( ++pci->setGen == 0 ) {
+		if ( pci->choiceSet )
+			memset( pci->choiceSet, 0, sizeof( ChoiceSlot ) * CHOICE_SET_SIZE );
+		pci->setGen = 1;
+	}
+	memset( pci->pageChoiceNo, 0, sizeof( pci->pageChoiceNo ) );
+	pci->nSource = 0;
+	pci->bMoreChoice = 0;
+}
 
-	for ( i = 0; i < pci->nTotalChoice; i++ )
-		if ( ! memcmp( pci->totalChoiceStr[ i ], str, len ) )
-			return 1;
-	return 0;
+void ChoiceInfoFree( ChoiceInfo *pci )
+{
+	free( pci->totalChoice );
+	free( pci->choiceSet );
+	free( pci->userPhrase );
+	free( pci->source );
+	pci->totalChoice = NULL;
+	pci->choiceSet = NULL;
+	pci->userPhrase = NULL;
+	pci->source = NULL;
+	pci->nTotalChoice = pci->nAllocChoice = 0;
+	pci->nUserPhrase = pci->nAllocUserPhrase = 0;
+	pci->nSource = pci->nAllocSource = 0;
+	pci->bMoreChoice = 0;
 }
 
-static void ChoiceInfoAppendChi( ChewingData *pgdata,  ChoiceInfo *pci, KeySeqWord phone )
+int ChoiceInfoAppend( ChoiceInfo *pci, const char *str, int len )
 {
-	Phrase tempWord;
+	ChoiceRef *totalChoice;
+	int nAlloc;
+
+	if ( pci->nTotalChoice >= pci->nAllocChoice ) {
+		if ( pci->nAllocChoice >= MAX_CHOICE )
+			return 0;
+		nAlloc = pci->nAllocChoice ? min( pci->nAllocChoice * 2, MAX_CHOICE ) : MAX_SELKEY;
+		totalChoice = realloc( pci->totalChoice, sizeof( ChoiceRef ) * nAlloc );
+		if ( ! totalChoice )
+			return 0;
+		pci->totalChoice = totalChoice;
+		pci->nAllocChoice = nAlloc;
+	}
+	pci->totalChoice[ pci->nTotalChoice ].str = str;
+	pci->totalChoice[ pci->nTotalChoice ].len = len;
+	pci->nTotalChoice++;
+	return 1;
+}
+
+const char *ChoiceInfoString( ChoiceInfo *pci, int no )
+{
+	int slot = no % MAX_SELKEY;
+	const ChoiceRef *ref = &pci->totalChoice[ no ];
 	int len;
-	if ( GetCharFirst( pgdata, &tempWord, phone ) ) {
-		do {
-			len = ueBytesFromChar( tempWord.phrase[ 0 ] );
-			if ( ChoiceTheSame( pci, tempWord.phrase,
-					    len) )
+
+	if ( pci->pageChoiceNo[ slot ] != no + 1 ) {
+		len = min( ref->len, sizeof( pci->pageChoiceStr[ 0 ] ) - 1 );
+		memcpy( pci->pageChoiceStr[ slot ], ref->str, len );
+		pci->pageChoiceStr[ slot ][ len ] = '\0';
+		pci->pageChoiceNo[ slot ] = no + 1;
+	}
+	return pci->pageChoiceStr[ slot ];
+}
+
+/* FNV-1a */
+static unsigned int ChoiceHash( const char *str, int len )
+{
+	unsigned int h = 2166136261u;
+	int i;
+
+	for ( i = 0; i < len; i++ ) {
+		h ^= (unsigned char) str[ i ];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* Append the candidate unless the same string is already listed. */
+static int ChoiceInfoAppendUnique( ChoiceInfo *pci, const char *str, int len )
+{
+	unsigned int i = ChoiceHash( str, len ) & ( CHOICE_SET_SIZE - 1 );
+	const ChoiceRef *ref;
+
+	/* Zeroed slots belong to no generation, since setGen starts at 1. */
+	if ( ! pci->choiceSet ) {
+		pci->choiceSet = ALC( ChoiceSlot, CHOICE_SET_SIZE );
+		if ( ! pci->choiceSet )
+			return 0;
+	}
+	/* The set never fills up, so probing always reaches an empty slot. */
+	while ( pci->choiceSet[ i ].gen == pci->setGen ) {
+		ref = &pci->totalChoice[ pci->choiceSet[ i ].no ];
+		if ( ref->len == len && ! memcmp( ref->str, str, len ) )
+			return 0;
+		i = ( i + 1 ) & ( CHOICE_SET_SIZE - 1 );
+	}
+	if ( ! ChoiceInfoAppend( pci, str, len ) )
+		return 0;
+	pci->choiceSet[ i ].gen = pci->setGen;
+	pci->choiceSet[ i ].no = pci->nTotalChoice - 1;
+	return 1;
+}
+
+/*
+ * Whether another source can be added. Sources are allocated on first use,
+ * as many as the layers of dictionary may need.
+ */
+static int ChoiceInfoHasRoom( ChewingData *pgdata, ChoiceInfo *pci )
+{
+	int nAlloc;
+
+	if ( ! pci->source ) {
+		nAlloc = CHOICE_SOURCE_PER_LAYER * pgdata->static_data.nLayer;
+		pci->source = ALC( ChoiceSource, nAlloc );
+		if ( ! pci->source )
+			return 0;
+		pci->nAllocSource = nAlloc;
+	}
+	return pci->nSource < pci->nAllocSource;
+}
+
+/* Add the phrases under the tree node of a layer, which stay mapped in dictionary. */
+static void ChoiceInfoAddTree( ChewingData *pgdata, ChoiceInfo *pci, int layer, const TreeType *parent, int group, int bFirstChar )
+{
+	const TreeType *tree = pgdata->static_data.layer[ layer ].tree;
+	ChoiceSource *src;
+
+	if ( ! ChoiceInfoHasRoom( pgdata, pci ) )
+		return;
+	src = &pci->source[ pci->nSource++ ];
+	src->leaf = tree + parent->child.begin;
+	src->leafEnd = tree + parent->child.end;
+	src->user = src->userEnd = 0;
+	src->group = group;
+	src->bFirstChar = bFirstChar;
+	pci->bMoreChoice = 1;
+}
+
+static void ChoiceInfoAddChi( ChewingData *pgdata,  ChoiceInfo *pci, KeySeqWord phone )
+{
+	const TreeType *pinx;
+	/* Words of each phone are listed after those of the previous one. */
+	int group = pci->nSource;
+	int i;
+
+	/* Words of the layers are merged by frequency. */
+	for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+		/* &phone serves as an array whose begin and end are both 0. */
+		pinx = TreeFindPhrase( pgdata, i, 0, 0, &phone );
+		if ( pinx )
+			ChoiceInfoAddTree( pgdata, pci, i, pinx, group, 1 );
+	}
+}
+
+/* Add user phrases of phoneSeq, sorted as leaves are by freq. */
+static void ChoiceInfoAddUser( ChewingData *pgdata, ChoiceInfo *pci, const KeySeqWord phoneSeq[], int group )
+{
+	ChoiceSource *src;
+	UserPhraseData *pUserPhraseData, **userPhrase;
+	int nAlloc, i;
+
+	if ( ! ChoiceInfoHasRoom( pgdata, pci ) )
+		return;
+	pci->nUserPhrase = 0;
+	pUserPhraseData = UserGetPhraseFirst( pgdata, phoneSeq );
+	while ( pUserPhraseData ) {
+		if ( pci->nUserPhrase >= pci->nAllocUserPhrase ) {
+			nAlloc = pci->nAllocUserPhrase ? pci->nAllocUserPhrase * 2 : MAX_SELKEY;
+			userPhrase = realloc( pci->userPhrase, sizeof( UserPhraseData * ) * nAlloc );
+			if ( ! userPhrase )
+				break;
+			pci->userPhrase = userPhrase;
+			pci->nAllocUserPhrase = nAlloc;
+		}
+		/* insertion sort keeps phrases of the same freq in hash order */
+		for ( i = pci->nUserPhrase;
+		      i > 0 && plat_atomic_load_int( &pci->userPhrase[ i - 1 ]->userfreq ) <
+		               plat_atomic_load_int( &pUserPhraseData->userfreq );
+		      i-- )
+			pci->userPhrase[ i ] = pci->userPhrase[ i - 1 ];
+		pci->userPhrase[ i ] = pUserPhraseData;
+		pci->nUserPhrase++;
+		pUserPhraseData = UserGetPhraseNext( pgdata, phoneSeq );
+	}
+	if ( pci->nUserPhrase == 0 )
+		return;
+
+	src = &pci->source[ pci->nSource++ ];
+	src->leaf = src->leafEnd = NULL;
+	src->user = 0;
+	src->userEnd = pci->nUserPhrase;
+	src->group = group;
+	src->bFirstChar = 0;
+	pci->bMoreChoice = 1;
+}
+
+static int ChoiceSourceEmpty( const ChoiceSource *src )
+{
+	if ( src->leaf )
+		return src->leaf >= src->leafEnd || src->leaf->key != 0;
+	return src->user >= src->userEnd;
+}
+
+static int ChoiceSourceFreq( const ChoiceInfo *pci, const ChoiceSource *src )
+{
+	if ( src->leaf )
+		return src->leaf->phrase.freq;
+	return plat_atomic_load_int( &pci->userPhrase[ src->user ]->userfreq );
+}
+
+/*
+ * List the next candidate: the most frequent head among the sources of the
+ * lowest group not exhausted yet. Ties go to the source added first.
+ */
+static int ChoiceInfoNext( ChewingData *pgdata, ChoiceInfo *pci )
+{
+	ChoiceSource *src, *best;
+	const char *str;
+	int i;
+
+	while ( pci->nTotalChoice < MAX_CHOICE ) {
+		best = NULL;
+		for ( i = 0; i < pci->nSource; i++ ) {
+			src = &pci->source[ i ];
+			if ( ChoiceSourceEmpty( src ) )
 				continue;
-			assert( pci->nTotalChoice < MAX_CHOICE );
-			memcpy(
-				pci->totalChoiceStr[ pci->nTotalChoice ],
-				tempWord.phrase, len );
-			pci->totalChoiceStr[ pci->nTotalChoice ]
-					   [ len ] = '\0';
-			pci->nTotalChoice++;
-		} while ( GetVocabNext( pgdata, &tempWord ) );
+			if ( ! best || src->group < best->group ||
+			     ( src->group == best->group &&
+			       ChoiceSourceFreq( pci, src ) > ChoiceSourceFreq( pci, best ) ) )
+				best = src;
+		}
+		if ( ! best )
+			break;
+
+		if ( best->leaf )
+			str = GetDictPhrase( pgdata, best->leaf++ );
+		else
+			str = pci->userPhrase[ best->user++ ]->wordSeq;
+		if ( ChoiceInfoAppendUnique( pci, str,
+				best->bFirstChar ? ueBytesFromChar( str[ 0 ] ) : (int) strlen( str ) ) )
+			return 1;
 	}
+	pci->bMoreChoice = 0;
+	return 0;
+}
+
+int ChoiceInfoFill( ChewingData *pgdata, int nChoice )
+{
+	ChoiceInfo *pci = &( pgdata->choiceInfo );
+
+	if ( ! pci->bMoreChoice )
+		return pci->nTotalChoice;
+	while ( pci->bMoreChoice && pci->nTotalChoice < nChoice )
+		ChoiceInfoNext( pgdata, pci );
+	pci->nPage = CEIL_DIV( pci->nTotalChoice, pci->nChoicePerPage );
+	return pci->nTotalChoice;
+}
+
+void ChoiceInfoFillPage( ChewingData *pgdata )
+{
+	ChoiceInfo *pci = &( pgdata->choiceInfo );
+
+	/* One page ahead, so that a following page is known to exist. */
+	ChoiceInfoFill( pgdata, ( pci->pageNo + 2 ) * pci->nChoicePerPage );
 }
 
 /** @brief Loading all possible phrases of certain length.
@@ -184,9 +432,7 @@ static void ChoiceInfoAppendChi( ChewingData *pgdata,  ChoiceInfo *pci, KeySeqWo
  */
 static void SetChoiceInfo( ChewingData *pgdata )
 {
-	Phrase tempPhrase;
-	int len;
-	UserPhraseData *pUserPhraseData;
+	int len, i;
 	KeySeqWord userPhoneSeq[ MAX_PHONE_SEQ_LEN ];
 
 	ChoiceInfo *pci = &( pgdata->choiceInfo );
@@ -197,82 +443,89 @@ static void SetChoiceInfo( ChewingData *pgdata )
 	int candPerPage = pgdata->config.candPerPage;
 
 	/* Clears previous candidates. */
-	memset( pci->totalChoiceStr, '\0',
-		MAX_CHOICE * MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1);
+	ChoiceInfoClear( pci );
 
-	pci->nTotalChoice = 0;
 	len = pai->avail[ pai->currentAvail ].len;
 	assert(len);
 
 	/* secondly, read tree phrase */
 	if ( len == 1 ) { /* single character */
-		ChoiceInfoAppendChi( pgdata, pci, phoneSeq[ cursor ] );
+		ChoiceInfoAddChi( pgdata, pci, phoneSeq[ cursor ] );
 
 		if ( phoneSeq[ cursor ] != phoneSeqAlt[ cursor ] ) {
-			ChoiceInfoAppendChi( pgdata, pci, phoneSeqAlt[ cursor ] );
+			ChoiceInfoAddChi( pgdata, pci, phoneSeqAlt[ cursor ] );
+		}
+
+		if ( pgdata->fuzzyData.bFuzzy && pgdata->static_data.IM_name[ 0 ] == '\0' ) {
+			KeySeqWord alt[ MAX_FUZZY_ALT ];
+			int cost[ MAX_FUZZY_ALT ], nAlt;
+
+			nAlt = FuzzyPhoneAlt( &pgdata->fuzzyData, phoneSeq[ cursor ], alt, cost );
+			for ( i = 1; i < nAlt; i++ )
+				ChoiceInfoAddChi( pgdata, pci, alt[ i ] );
 		}
 
 		if ( pgdata->zuinData.kbtype == KB_HSU ||
 		     pgdata->zuinData.kbtype == KB_DVORAK_HSU ) {
 			switch ( phoneSeq[ cursor ] ) {
 				case 0x2800:	/* 'ㄘ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x30 );		/* 'ㄟ' */
 					break;
 				case 0x80:	/* 'ㄧ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x20 );		/* 'ㄝ' */
 					break;
 				case 0x2A00:	/* 'ㄙ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1 );		/* '˙' */
 					break;
 				case 0xA00:	/* 'ㄉ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x2 );		/* 'ˊ' */
 					break;
 				case 0x800:	/* 'ㄈ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x3 ); 		/* 'ˇ' */
 					break;
 				case 0x18:	/* 'ㄜ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1200 );	/* 'ㄍ' */
 					break;
 				case 0x10:	/* 'ㄛ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1600 );	/* 'ㄏ' */
 					break;
 				case 0x1E00:	/* 'ㄓ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1800 );	/* 'ㄐ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x4 );		/* 'ˋ' */
 					break;
 				case 0x58:	/* 'ㄤ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1400 );	/* 'ㄎ' */
 					break;
 				case 0x68:	/* 'ㄦ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1000 );	/* 'ㄌ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x60 );		/* 'ㄥ' */
 					break;
 				case 0x2200:	/* 'ㄕ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1C00 );	/* 'ㄒ' */
 					break;
 				case 0x2000:	/* 'ㄔ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x1A00 );	/* 'ㄑ' */
 					break;
 				case 0x50:	/* 'ㄣ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0xE00 );	/* 'ㄋ' */
 					break;
 				case 0x48:	/* 'ㄢ' */
-					ChoiceInfoAppendChi( pgdata, pci,
+					ChoiceInfoAddChi( pgdata, pci,
 						0x600 );	/* 'ㄇ' */
 					break;
 				default:
@@ -282,50 +535,24 @@ static void SetChoiceInfo( ChewingData *pgdata )
 	}
 	/* phrase */
 	else {
-		if ( pai->avail[ pai->currentAvail ].id ) {
-			GetPhraseFirst( pgdata, &tempPhrase, pai->avail[ pai->currentAvail ].id );
-			do {
-				if ( ChoiceTheSame(
-					pci,
-					tempPhrase.phrase,
-					len * ueBytesFromChar( tempPhrase.phrase[0] ) ) ) {
-					continue;
-				}
-				ueStrNCpy( pci->totalChoiceStr[ pci->nTotalChoice ],
-						tempPhrase.phrase, len, 1);
-				pci->nTotalChoice++;
-			} while( GetVocabNext( pgdata, &tempPhrase ) );
+		/* Phrases of the layers and user phrases are merged by frequency. */
+		for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+			if ( pai->avail[ pai->currentAvail ].id[ i ] )
+				ChoiceInfoAddTree( pgdata, pci, i, pai->avail[ pai->currentAvail ].id[ i ], 0, 0 );
 		}
 
 		memcpy( userPhoneSeq, &phoneSeq[ cursor ], sizeof( KeySeqWord ) * len );
 		userPhoneSeq[ len ] = 0;
-		pUserPhraseData = UserGetPhraseFirst( pgdata, userPhoneSeq );
-		if ( pUserPhraseData ) {
-			do {
-				/* check if the phrase is already in the choice list */
-				if ( ChoiceTheSame(
-					pci,
-					pUserPhraseData->wordSeq,
-					len * ueBytesFromChar( pUserPhraseData->wordSeq[0] ) ) )
-					continue;
-				/* otherwise store it */
-				ueStrNCpy(
-						pci->totalChoiceStr[ pci->nTotalChoice ],
-						pUserPhraseData->wordSeq,
-						len, 1);
-				pci->nTotalChoice++;
-			} while ( ( pUserPhraseData =
-				    UserGetPhraseNext( pgdata, userPhoneSeq ) ) != NULL );
-		}
-
+		ChoiceInfoAddUser( pgdata, pci, userPhoneSeq, 0 );
 	}
 
 	/* magic number */
 	pci->nChoicePerPage = candPerPage;
-	assert( pci->nTotalChoice > 0 );
-	pci->nPage = CEIL_DIV( pci->nTotalChoice, pci->nChoicePerPage );
 	pci->pageNo = 0;
 	pci->isSymbol = WORD_CHOICE;
+	/* Candidates are listed lazily, a page ahead of the one displayed. */
+	ChoiceInfoFillPage( pgdata );
+	assert( pci->nTotalChoice > 0 );
 }
 
 /*
@@ -335,6 +562,8 @@ static int SeekPhraseHead( ChewingData *pgdata )
 {
 	int i;
 	int phoneSeq = PhoneSeqCursor( pgdata );
+
+	FlushPhrasing( pgdata );
 	for ( i = pgdata->nPrefer - 1; i >= 0; i-- ) {
 		if ( pgdata->preferInterval[ i ].from > phoneSeq
 				|| pgdata->preferInterval[ i ].to < phoneSeq )
@@ -400,7 +629,7 @@ int ChoiceNextAvail( ChewingData *pgdata )
 int ChoiceEndChoice( ChewingData *pgdata )
 {
 	pgdata->bSelect = 0;
-	pgdata->choiceInfo.nTotalChoice = 0;
+	ChoiceInfoClear( &pgdata->choiceInfo );
 	pgdata->choiceInfo.nPage = 0;
 
 	if ( pgdata->choiceInfo.isSymbol != WORD_CHOICE || pgdata->choiceInfo.isSymbol != SYMBOL_CHOICE_INSERT ) {
@@ -412,18 +641,18 @@ int ChoiceEndChoice( ChewingData *pgdata )
 	return 0;
 }
 
-static void ChangeUserData( ChewingData *pgdata, int selectNo )
+static void ChangeUserData( ChewingData *pgdata, const char *str )
 {
 	KeySeqWord userPhoneSeq[ MAX_PHONE_SEQ_LEN ];
 	int len;
 
-	len = ueStrLen( pgdata->choiceInfo.totalChoiceStr[ selectNo ] );
+	len = ueStrLen( str );
 	memcpy(
 		userPhoneSeq,
 		&( pgdata->phoneSeq[ PhoneSeqCursor( pgdata ) ] ),
 		len * sizeof( KeySeqWord ) );
 	userPhoneSeq[ len ] = 0;
-	UserUpdatePhrase( pgdata, userPhoneSeq, pgdata->choiceInfo.totalChoiceStr[ selectNo ] );
+	UserUpdatePhrase( pgdata, userPhoneSeq, str );
 }
 
 /** @brief commit the selected phrase. */
@@ -431,14 +660,14 @@ int ChoiceSelect( ChewingData *pgdata, int selectNo )
 {
 	ChoiceInfo *pci = &( pgdata->choiceInfo );
 	AvailInfo *pai = &( pgdata->availInfo );
+	const char *str = ChoiceInfoString( pci, selectNo );
 
-	ChangeUserData( pgdata, selectNo );
+	ChangeUserData( pgdata, str );
 	ChangeSelectIntervalAndBreakpoint(
 			pgdata,
 			PhoneSeqCursor( pgdata ),
 			PhoneSeqCursor( pgdata ) + pai->avail[ pai->currentAvail ].len,
-			pci->totalChoiceStr[ selectNo ] );
+			str );
 	ChoiceEndChoice( pgdata );
 	return 0;
 }
-
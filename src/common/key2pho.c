@@ -204,6 +204,14 @@ uint16_t UintFromPhoneInx( const int ph_inx[] )
 	return result;
 }
 
+void PhoneInxFromUint( int ph_inx[], uint16_t phone_num )
+{
+	int i;
+
+	for ( i = 0; i < ZUIN_SIZE; i++ )
+		ph_inx[ i ] = ( phone_num >> shift[ i ] ) & sb[ i ];
+}
+
 uint32_t EncodeZuinKey(const char *seq)
 {
 	char phone_buf[MAX_UTF8_SIZE * ZUIN_SIZE + 1];
@@ -22,37 +22,163 @@
 
 #include "global-private.h"
 #include "plat_mmap.h"
+#include "plat_thread.h"
 #include "dict-private.h"
 #include "memory-private.h"
 #include "tree-private.h"
+#include "private.h"
 
-void TerminateDict( ChewingData *pgdata )
+/*
+ * Shards of a sharded dictionary. Shard 0 is DICT_FILE mapped by InitDict(),
+ * and others are mapped on first use. The structure is shared by all contexts
+ * sharing the dictionary, so shards are mapped under lock and published
+ * atomically.
+ */
+typedef struct tag_DictShards {
+	char prefix[ PATH_MAX ];
+	int nShard;
+	plat_mutex lock;
+	void *shard[ DICT_MAX_SHARD ];
+	/* Mapped size of each shard, set before the shard is published. */
+	size_t shard_size[ DICT_MAX_SHARD ];
+	plat_mmap shard_mmap[ DICT_MAX_SHARD ];
+} DictShards;
+
+void TerminateDict( ChewingData *pgdata, int layer )
+{
+	DictLayer *dl = &pgdata->static_data.layer[ layer ];
+	DictShards *shards = dl->dict_shards;
+	int i;
+
+	if ( shards ) {
+		for ( i = 1; i < shards->nShard; i++ )
+			plat_mmap_close( &shards->shard_mmap[ i ] );
+		plat_mutex_destroy( &shards->lock );
+		free( shards );
+		dl->dict_shards = NULL;
+	}
+	dl->dict = NULL;
+	plat_mmap_close( &dl->dict_mmap );
+}
+
+static int InitDictShards( DictLayer *dl, const char *prefix, size_t file_size )
 {
-	plat_mmap_close( &pgdata->static_data.dict_mmap );
+	const char *dict = dl->dict;
+	DictShards *shards;
+	uint32_t nShard;
+	int i;
+
+	if ( file_size < DICT_SHARD_HEADER_SIZE || memcmp( dict, DICT_SHARD_MAGIC, DICT_SHARD_MAGIC_LEN ) != 0 )
+		return 0;
+	memcpy( &nShard, dict + DICT_SHARD_MAGIC_LEN, sizeof( nShard ) );
+	if ( nShard < 1 || nShard > DICT_MAX_SHARD )
+		return -1;
+
+	shards = ALC( DictShards, 1 );
+	if ( !shards )
+		return -1;
+	if ( plat_mutex_init( &shards->lock ) != 0 ) {
+		free( shards );
+		return -1;
+	}
+	strcpy( shards->prefix, prefix );
+	shards->nShard = nShard;
+	shards->shard[ 0 ] = (void *) dict;
+	shards->shard_size[ 0 ] = file_size;
+	for ( i = 1; i < shards->nShard; i++ )
+		plat_mmap_set_invalid( &shards->shard_mmap[ i ] );
+	dl->dict_shards = shards;
+	return 0;
 }
 
-int InitDict( ChewingData *pgdata, const char *prefix )
+int InitDict( ChewingData *pgdata, int layer, const char *prefix )
 {
+	DictLayer *dl = &pgdata->static_data.layer[ layer ];
 	char filename[ PATH_MAX ];
 	size_t len, offset;
 	size_t file_size, csize;
 
+	dl->dict = NULL;
+	dl->dict_size = 0;
+	dl->dict_shards = NULL;
+	plat_mmap_set_invalid( &dl->dict_mmap );
+
 	len = snprintf( filename, sizeof( filename ), "%s" PLAT_SEPARATOR "%s", prefix, DICT_FILE );
 	if ( len + 1 > sizeof( filename ) )
 		return -1;
 
-	plat_mmap_set_invalid( &pgdata->static_data.dict_mmap );
-	file_size = plat_mmap_create( &pgdata->static_data.dict_mmap, filename, FLAG_ATTRIBUTE_READ );
+	file_size = plat_mmap_create( &dl->dict_mmap, filename, FLAG_ATTRIBUTE_READ );
 	if ( file_size <= 0 )
 		return -1;
 
 	offset = 0;
 	csize = file_size;
-	pgdata->static_data.dict = (const char*)plat_mmap_set_view( &pgdata->static_data.dict_mmap, &offset, &csize );
-	if ( !pgdata->static_data.dict )
+	dl->dict = (const char*)plat_mmap_set_view( &dl->dict_mmap, &offset, &csize );
+	if ( !dl->dict )
 		return -1;
+	dl->dict_size = file_size;
 
-	return 0;
+	return InitDictShards( dl, prefix, file_size );
+}
+
+static const char *MapDictShard( DictShards *shards, int n )
+{
+	char filename[ PATH_MAX ];
+	char name[ sizeof( DICT_SHARD_FILE ) + 11 ];
+	size_t len, offset = 0;
+	size_t file_size = 0;
+	void *shard;
+
+	plat_mutex_lock( &shards->lock );
+	shard = shards->shard[ n ];
+	if ( !shard ) {
+		snprintf( name, sizeof( name ), DICT_SHARD_FILE, n );
+		len = snprintf( filename, sizeof( filename ), "%s" PLAT_SEPARATOR "%s", shards->prefix, name );
+		if ( len + 1 <= sizeof( filename ) )
+			file_size = plat_mmap_create( &shards->shard_mmap[ n ], filename, FLAG_ATTRIBUTE_READ );
+		if ( file_size > 0 )
+			shard = plat_mmap_set_view( &shards->shard_mmap[ n ], &offset, &file_size );
+		if ( shard ) {
+			shards->shard_size[ n ] = file_size;
+			plat_atomic_store_ptr( &shards->shard[ n ], shard );
+		}
+		else
+			plat_mmap_close( &shards->shard_mmap[ n ] );
+	}
+	plat_mutex_unlock( &shards->lock );
+	return (const char *) shard;
+}
+
+static const char *GetLayerPhrase( const DictLayer *dl, uint32_t pos )
+{
+	DictShards *shards = dl->dict_shards;
+	const char *shard;
+	uint32_t n;
+
+	/*
+	 * A position out of the mapped file or a missing shard reads as an
+	 * empty phrase rather than failing lookups.
+	 */
+	if ( !shards )
+		return pos < dl->dict_size ? dl->dict + pos : "";
+
+	n = DictShardOf( pos );
+	if ( n >= (uint32_t) shards->nShard )
+		return "";
+	shard = (const char *) plat_atomic_load_ptr( &shards->shard[ n ] );
+	if ( !shard )
+		shard = MapDictShard( shards, n );
+	if ( !shard || DictShardOffset( pos ) >= shards->shard_size[ n ] )
+		return "";
+	return shard + DictShardOffset( pos );
+}
+
+/* The phrase of a leaf, in the dictionary of the layer holding the leaf. */
+const char *GetDictPhrase( ChewingData *pgdata, const TreeType *leaf )
+{
+	int layer = TreeLayerOf( pgdata, leaf );
+
+	return GetLayerPhrase( &pgdata->static_data.layer[ layer ], leaf->phrase.pos );
 }
 
 /*
@@ -61,19 +187,35 @@ int InitDict( ChewingData *pgdata, const char *prefix )
  */
 static void GetVocabFromDict( ChewingData *pgdata, Phrase *phr_ptr )
 {
-	strcpy(phr_ptr->phrase, pgdata->static_data.dict + pgdata->static_data.tree_cur_pos->phrase.pos);
+	strcpy(phr_ptr->phrase, GetLayerPhrase( pgdata->static_data.tree_cur_layer,
+		pgdata->static_data.tree_cur_pos->phrase.pos ));
 	phr_ptr->freq = pgdata->static_data.tree_cur_pos->phrase.freq;
 	pgdata->static_data.tree_cur_pos++;
 }
 
+/*
+ * The first word of key is the most frequent one among the layers, ties going
+ * to the layer looked up first.
+ */
 int GetCharFirst( ChewingData *pgdata, Phrase *wrd_ptr, KeySeqWord key )
 {
-	/* &key serves as an array whose begin and end are both 0. */
-	const TreeType *pinx = TreeFindPhrase( pgdata, 0, 0, &key );
+	const TreeType *pinx, *best = NULL;
+	int i, freq, bestFreq = 0;
 
-	if ( ! pinx )
+	for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+		/* &key serves as an array whose begin and end are both 0. */
+		pinx = TreeFindPhrase( pgdata, i, 0, 0, &key );
+		if ( ! pinx )
+			continue;
+		freq = pgdata->static_data.layer[ i ].tree[ pinx->child.begin ].phrase.freq;
+		if ( ! best || freq > bestFreq ) {
+			best = pinx;
+			bestFreq = freq;
+		}
+	}
+	if ( ! best )
 		return 0;
-	TreeChildRange( pgdata, pinx );
+	TreeChildRange( pgdata, best );
 	GetVocabFromDict( pgdata, wrd_ptr );
 	return 1;
 }
@@ -66,11 +66,17 @@ static unsigned int HashFunc( const KeySeqWord phoneSeq[] )
 	return ( value & ( HASH_TABLE_SIZE - 1 ) );
 }
 
+/* Items are published by HashInsert(), possibly on another thread. */
+static HASH_ITEM *BucketHead( UserDict *dict, int hashvalue )
+{
+	return plat_atomic_load_ptr( (void * const *) &dict->hashtable[ hashvalue ] );
+}
+
 HASH_ITEM *HashFindPhonePhrase( ChewingData *pgdata, const KeySeqWord phoneSeq[], HASH_ITEM *pItemLast )
 {
 	HASH_ITEM *pNow = pItemLast ?
 			pItemLast->next :
-			pgdata->static_data.hashtable[ HashFunc( phoneSeq ) ];
+			BucketHead( pgdata->static_data.userdict, HashFunc( phoneSeq ) );
 
 	for ( ; pNow; pNow = pNow->next )
 		if ( PhoneSeqTheSame( pNow->data.phoneSeq, phoneSeq ) )
@@ -85,7 +91,7 @@ HASH_ITEM *HashFindEntry( ChewingData *pgdata, const KeySeqWord phoneSeq[], cons
 
 	hashvalue = HashFunc( phoneSeq );
 
-	for ( pItem = pgdata->static_data.hashtable[ hashvalue ]; pItem ; pItem = pItem->next ) {
+	for ( pItem = BucketHead( pgdata->static_data.userdict, hashvalue ); pItem ; pItem = pItem->next ) {
 		if (
 			! strcmp( pItem->data.wordSeq, wordSeq ) &&
 			PhoneSeqTheSame( pItem->data.phoneSeq, phoneSeq ) ) {
@@ -95,8 +101,10 @@ HASH_ITEM *HashFindEntry( ChewingData *pgdata, const KeySeqWord phoneSeq[], cons
 	return NULL;
 }
 
+/* The caller holds the lock of the user dictionary. */
 HASH_ITEM *HashInsert( ChewingData *pgdata, UserPhraseData *pData )
 {
+	UserDict *dict = pgdata->static_data.userdict;
 	int hashvalue;
 	HASH_ITEM *pItem;
 
@@ -110,13 +118,13 @@ HASH_ITEM *HashInsert( ChewingData *pgdata, UserPhraseData *pData )
 
 	hashvalue = HashFunc( pData->phoneSeq );
 	/* set the new element */
-	pItem->next = pgdata->static_data.hashtable[ hashvalue ];
+	pItem->next = dict->hashtable[ hashvalue ];
 
 	memcpy( &( pItem->data ), pData, sizeof( pItem->data ) );
 	pItem->item_index = -1;
 
-	/* set link to the new element */
-	pgdata->static_data.hashtable[ hashvalue ] = pItem;
+	/* set link to the new element, once it is complete for readers */
+	plat_atomic_store_ptr( (void **) &dict->hashtable[ hashvalue ], pItem );
 
 	return pItem;
 }
@@ -172,41 +180,227 @@ static void HashItem2Binary( char *str, HASH_ITEM *pItem )
 	/* phrase */
 	*pc = strlen( pItem->data.wordSeq );
 	strcpy( (pc + 1), pItem->data.wordSeq );
-	pItem->data.wordSeq[ (unsigned char) *pc ] = '\0';
 }
 
+static long RecordOffset( int item_index )
+{
+	return item_index * FIELD_SIZE + 4 + strlen( BIN_HASH_SIG );
+}
+
+/*
+ * Write the record of pItem. A new record is appended through a stream opened
+ * for appending, which finds the end of file at each write, so that user
+ * dictionaries opened separately on the same file never give two phrases the
+ * same slot.
+ */
+static void WriteRecord( FILE *outfile, const char *hashfilename, HASH_ITEM *pItem, const char *str )
+{
+	FILE *appendfile;
+	long end;
+
+	if ( pItem->item_index >= 0 ) {
+		fseek( outfile, RecordOffset( pItem->item_index ), SEEK_SET );
+		fwrite( str, 1, FIELD_SIZE, outfile );
+		return;
+	}
+
+	appendfile = fopen( hashfilename, "ab" );
+	if ( ! appendfile )
+		return;
+	if ( fwrite( str, 1, FIELD_SIZE, appendfile ) == FIELD_SIZE && fflush( appendfile ) == 0 ) {
+		end = ftell( appendfile );
+		if ( end >= RecordOffset( 1 ) )
+			pItem->item_index = ( end - RecordOffset( 0 ) ) / FIELD_SIZE - 1;
+	}
+	fclose( appendfile );
+}
+
+typedef struct tag_UserDictWriter {
+	UserDict *dict;
+	plat_thread thread;
+	plat_mutex lock;
+	plat_cond wake;
+	plat_cond done;
+	/* items pushed by WriterPush(), newest first */
+	HASH_ITEM *queue;
+	/* numbers of flush requests made and served */
+	int requested;
+	int served;
+	int stop;
+} UserDictWriter;
+
+/*
+ * Queue pItem for the writer without waiting for the disk. An item already
+ * queued is not queued again: it is written with its latest values, so that
+ * repeated updates of the same phrase are coalesced.
+ */
+static void WriterPush( UserDictWriter *writer, HASH_ITEM *pItem )
+{
+	HASH_ITEM *head;
+
+	if ( plat_atomic_exchange_int( &pItem->dirty, 1 ) )
+		return;
+	do {
+		head = plat_atomic_load_ptr( (void * const *) &writer->queue );
+		pItem->dirty_next = head;
+	} while ( ! plat_atomic_cas_ptr( (void **) &writer->queue, head, pItem ) );
+
+	plat_mutex_lock( &writer->lock );
+	plat_cond_signal( &writer->wake );
+	plat_mutex_unlock( &writer->lock );
+}
+
+static void WriteBatch( UserDict *dict, HASH_ITEM *batch )
+{
+	FILE *outfile;
+	HASH_ITEM *pItem, *pNext, *pFifo = NULL, item;
+	char str[ FIELD_SIZE + 1 ];
+	int lifetime;
+
+	/* write in the order of queueing, so that new records are appended in order */
+	for ( pItem = batch; pItem; pItem = pNext ) {
+		pNext = pItem->dirty_next;
+		pItem->dirty_next = pFifo;
+		pFifo = pItem;
+	}
+
+	outfile = fopen( dict->hashfilename, "r+b" );
+	if ( outfile ) {
+		lifetime = plat_atomic_load_int( &dict->chewing_lifetime );
+		fseek( outfile, strlen( BIN_HASH_SIG ), SEEK_SET );
+		fwrite( &lifetime, 1, 4, outfile );
+	}
+
+	for ( pItem = pFifo; pItem; pItem = pNext ) {
+		pNext = pItem->dirty_next;
+		/*
+		 * An update from now on queues the item again. The exchange keeps the
+		 * loads below after the clear, so that an update either is read
+		 * here or queues the item.
+		 */
+		plat_atomic_exchange_int( &pItem->dirty, 0 );
+		if ( ! outfile )
+			continue;
+
+		item.data.phoneSeq = pItem->data.phoneSeq;
+		item.data.wordSeq = pItem->data.wordSeq;
+		item.data.userfreq = plat_atomic_load_int( &pItem->data.userfreq );
+		item.data.recentTime = plat_atomic_load_int( &pItem->data.recentTime );
+		item.data.maxfreq = plat_atomic_load_int( &pItem->data.maxfreq );
+		item.data.origfreq = pItem->data.origfreq;
+
+		HashItem2Binary( str, &item );
+		WriteRecord( outfile, dict->hashfilename, pItem, str );
+	}
+
+	if ( outfile ) {
+		fflush( outfile );
+		fclose( outfile );
+	}
+}
+
+static void *WriterMain( void *arg )
+{
+	UserDictWriter *writer = (UserDictWriter *) arg;
+	HASH_ITEM *batch;
+	int requested;
+
+	plat_mutex_lock( &writer->lock );
+	for ( ; ; ) {
+		while ( ! plat_atomic_load_ptr( (void * const *) &writer->queue ) &&
+				writer->served == writer->requested && ! writer->stop )
+			plat_cond_wait( &writer->wake, &writer->lock );
+		if ( ! plat_atomic_load_ptr( (void * const *) &writer->queue ) &&
+				writer->served == writer->requested )
+			break;
+
+		requested = writer->requested;
+		plat_mutex_unlock( &writer->lock );
+
+		batch = plat_atomic_exchange_ptr( (void **) &writer->queue, NULL );
+		WriteBatch( writer->dict, batch );
+
+		plat_mutex_lock( &writer->lock );
+		writer->served = requested;
+		plat_cond_broadcast( &writer->done );
+	}
+	plat_mutex_unlock( &writer->lock );
+	return NULL;
+}
+
+static UserDictWriter *WriterStart( UserDict *dict )
+{
+	UserDictWriter *writer = ALC( UserDictWriter, 1 );
+
+	if ( ! writer )
+		return NULL;
+	writer->dict = dict;
+	if ( plat_mutex_init( &writer->lock ) != 0 )
+		goto err_mutex;
+	if ( plat_cond_init( &writer->wake ) != 0 )
+		goto err_wake;
+	if ( plat_cond_init( &writer->done ) != 0 )
+		goto err_done;
+	if ( plat_thread_create( &writer->thread, WriterMain, writer ) != 0 )
+		goto err_thread;
+	return writer;
+
+err_thread:
+	plat_cond_destroy( &writer->done );
+err_done:
+	plat_cond_destroy( &writer->wake );
+err_wake:
+	plat_mutex_destroy( &writer->lock );
+err_mutex:
+	free( writer );
+	return NULL;
+}
+
+/* Write the queued items and stop the writer thread. */
+static void WriterStop( UserDictWriter *writer )
+{
+	plat_mutex_lock( &writer->lock );
+	writer->stop = 1;
+	plat_cond_signal( &writer->wake );
+	plat_mutex_unlock( &writer->lock );
+	plat_thread_join( writer->thread );
+
+	plat_cond_destroy( &writer->done );
+	plat_cond_destroy( &writer->wake );
+	plat_mutex_destroy( &writer->lock );
+	free( writer );
+}
+
+/* The caller holds the lock of the user dictionary. */
 void HashModify( ChewingData *pgdata, HASH_ITEM *pItem )
 {
+	UserDict *dict = pgdata->static_data.userdict;
 	FILE *outfile;
 	char str[ FIELD_SIZE + 1 ];
+	int lifetime;
+
+	if ( dict->async ) {
+		WriterPush( dict->writer, pItem );
+		return;
+	}
 
-	outfile = fopen( pgdata->static_data.hashfilename, "r+b" );
+	outfile = fopen( dict->hashfilename, "r+b" );
 	if ( !outfile )
 		return;
 
 	/* update "lifetime" */
+	lifetime = plat_atomic_load_int( &dict->chewing_lifetime );
 	fseek( outfile, strlen( BIN_HASH_SIG ), SEEK_SET );
-	fwrite( &pgdata->static_data.chewing_lifetime, 1, 4, outfile );
-	sprintf( str, "%d", pgdata->static_data.chewing_lifetime );
+	fwrite( &lifetime, 1, 4, outfile );
+	sprintf( str, "%d", lifetime );
 	DEBUG_OUT( "HashModify-1: '%-75s'\n", str );
 
 	/* update record */
-	if ( pItem->item_index < 0 ) {
-		fseek( outfile, 0, SEEK_END );
-		pItem->item_index =
-			( ftell( outfile ) - 4 - strlen( BIN_HASH_SIG ) ) / FIELD_SIZE;
-	}
-	else {
-		fseek( outfile,
-			pItem->item_index * FIELD_SIZE + 4 + strlen( BIN_HASH_SIG ),
-			SEEK_SET );
-	}
-
 	HashItem2String( str, pItem );
 	DEBUG_OUT( "HashModify-2: '%-75s'\n", str );
 
 	HashItem2Binary( str, pItem );
-	fwrite( str, 1, FIELD_SIZE, outfile );
+	WriteRecord( outfile, dict->hashfilename, pItem, str );
 	fflush( outfile );
 	fclose( outfile );
 }
@@ -374,14 +568,14 @@ err_load_file:
 }
 
 /* migrate from text-based hash to binary form */
-static int migrate_hash_to_bin( ChewingData *pgdata )
+static int migrate_hash_to_bin( UserDict *dict )
 {
 	FILE *txtfile;
 	char oldname[ 256 ], *dump, *seekdump;
 	HASH_ITEM item;
 	int item_index, iret, tflen;
 	int ret;
-	const char *ofilename = pgdata->static_data.hashfilename;
+	const char *ofilename = dict->hashfilename;
 
 	/* allocate dump buffer */
 	txtfile = open_file_get_length( ofilename, "r", &tflen );
@@ -393,7 +587,7 @@ static int migrate_hash_to_bin( ChewingData *pgdata )
 		fclose( txtfile );
 		return 0;
 	}
-	ret = fscanf( txtfile, "%d", &pgdata->static_data.chewing_lifetime );
+	ret = fscanf( txtfile, "%d", &dict->chewing_lifetime );
 	if ( ret != 1 ) {
 		return 0;
 	}
@@ -402,9 +596,9 @@ static int migrate_hash_to_bin( ChewingData *pgdata )
 	seekdump = dump;
 	memcpy( seekdump, BIN_HASH_SIG, strlen( BIN_HASH_SIG ) );
 	memcpy( seekdump + strlen( BIN_HASH_SIG ),
-	        &pgdata->static_data.chewing_lifetime,
-		sizeof(pgdata->static_data.chewing_lifetime) );
-	seekdump += strlen( BIN_HASH_SIG ) + sizeof(pgdata->static_data.chewing_lifetime);
+	        &dict->chewing_lifetime,
+		sizeof(dict->chewing_lifetime) );
+	seekdump += strlen( BIN_HASH_SIG ) + sizeof(dict->chewing_lifetime);
 
 	/* migrate */
 	item_index = 0;
@@ -456,85 +650,116 @@ static void FreeHashItem( HASH_ITEM *aItem )
 	}
 }
 
-void TerminateHash( ChewingData *pgdata )
+static void UserDictFree( UserDict *dict )
 {
-	HASH_ITEM *pItem;
 	int i;
-	for ( i = 0; i < HASH_TABLE_SIZE; ++i ) {
-		pItem = pgdata->static_data.hashtable[ i ];
-		DEBUG_CHECKPOINT();
-		FreeHashItem( pItem );
+
+	if ( dict->writer )
+		WriterStop( dict->writer );
+	for ( i = 0; i < HASH_TABLE_SIZE; ++i )
+		FreeHashItem( dict->hashtable[ i ] );
+	plat_mutex_destroy( &dict->lock );
+	free( dict );
+}
+
+static UserDict *UserDictAlloc()
+{
+	UserDict *dict = ALC( UserDict, 1 );
+
+	if ( ! dict )
+		return NULL;
+	if ( plat_mutex_init( &dict->lock ) != 0 ) {
+		free( dict );
+		return NULL;
 	}
+	dict->refcount = 1;
+	return dict;
 }
 
-int InitHash( ChewingData *pgdata )
+/*
+ * Load the user phrases of the hash file in directory path, or in the
+ * directory given by CHEWING_USER_PATH or HOME when path is NULL.
+ */
+UserDict *UserDictOpen( const char *path )
 {
+	UserDict *dict;
 	HASH_ITEM item, *pItem, *pPool = NULL;
 	int item_index, hashvalue, iret, fsize, hdrlen, oldest = INT_MAX;
 	char *dump, *seekdump;
 
-	const char *path = getenv( "CHEWING_USER_PATH" );
+	dict = UserDictAlloc();
+	if ( ! dict )
+		return NULL;
 
-	/* make sure of write permission */
-	if ( path && access( path, W_OK ) == 0 ) {
-		sprintf( pgdata->static_data.hashfilename, "%s" PLAT_SEPARATOR "%s", path, HASH_FILE );
+	if ( path ) {
+		PLAT_MKDIR( path );
+	} else {
+		path = getenv( "CHEWING_USER_PATH" );
+		/* make sure of write permission */
+		if ( path && access( path, W_OK ) != 0 )
+			path = NULL;
+	}
+
+	if ( path ) {
+		sprintf( dict->hashfilename, "%s" PLAT_SEPARATOR "%s", path, HASH_FILE );
 	} else {
 		if ( getenv( "HOME" ) ) {
 			sprintf(
-				pgdata->static_data.hashfilename, "%s%s",
+				dict->hashfilename, "%s%s",
 				getenv( "HOME" ), CHEWING_HASH_PATH );
 		}
 		else {
 			sprintf(
-				pgdata->static_data.hashfilename, "%s%s",
+				dict->hashfilename, "%s%s",
 				PLAT_TMPDIR, CHEWING_HASH_PATH );
 		}
-		PLAT_MKDIR( pgdata->static_data.hashfilename );
-		strcat( pgdata->static_data.hashfilename, PLAT_SEPARATOR );
-		strcat( pgdata->static_data.hashfilename, HASH_FILE );
+		PLAT_MKDIR( dict->hashfilename );
+		strcat( dict->hashfilename, PLAT_SEPARATOR );
+		strcat( dict->hashfilename, HASH_FILE );
 	}
-	memset( pgdata->static_data.hashtable, 0, sizeof( pgdata->static_data.hashtable ) );
 
 open_hash_file:
-	dump = _load_hash_file( pgdata->static_data.hashfilename, &fsize );
-	hdrlen = strlen( BIN_HASH_SIG ) + sizeof(pgdata->static_data.chewing_lifetime);
+	dump = _load_hash_file( dict->hashfilename, &fsize );
+	hdrlen = strlen( BIN_HASH_SIG ) + sizeof(dict->chewing_lifetime);
 	item_index = 0;
 	if ( dump == NULL || fsize < hdrlen ) {
 		FILE *outfile;
-		outfile = fopen( pgdata->static_data.hashfilename, "w+b" );
+		outfile = fopen( dict->hashfilename, "w+b" );
 		if ( ! outfile ) {
 			if ( dump ) {
 				free( dump );
 			}
-			return 0;
+			UserDictFree( dict );
+			return NULL;
 		}
-		pgdata->static_data.chewing_lifetime = 0;
+		dict->chewing_lifetime = 0;
 		fwrite( BIN_HASH_SIG, 1, strlen( BIN_HASH_SIG ), outfile );
-		fwrite( &pgdata->static_data.chewing_lifetime, 1,
-		                sizeof(pgdata->static_data.chewing_lifetime), outfile );
+		fwrite( &dict->chewing_lifetime, 1,
+		                sizeof(dict->chewing_lifetime), outfile );
 		fclose( outfile );
 	}
 	else {
 		if ( memcmp(dump, BIN_HASH_SIG, strlen(BIN_HASH_SIG)) != 0 ) {
 			/* perform migrate from text-based to binary form */
 			free( dump );
-			if ( ! migrate_hash_to_bin( pgdata ) ) {
-				return  0;
+			if ( ! migrate_hash_to_bin( dict ) ) {
+				UserDictFree( dict );
+				return NULL;
 			}
 			goto open_hash_file;
 		}
 
-		pgdata->static_data.chewing_lifetime = *(int *) (dump + strlen( BIN_HASH_SIG ));
+		dict->chewing_lifetime = *(int *) (dump + strlen( BIN_HASH_SIG ));
 		seekdump = dump + hdrlen;
 		fsize -= hdrlen;
 
 		while ( fsize >= FIELD_SIZE ) {
+			/* The index is the slot in file, which illegal data still take. */
 			iret = ReadHashItem_bin( seekdump, &item, item_index++ );
 			/* Ignore illegal data */
 			if ( iret == -1 ) {
 				seekdump += FIELD_SIZE;
 				fsize -= FIELD_SIZE;
-				--item_index;
 				continue;
 			}
 			else if ( iret == 0 )
@@ -559,12 +784,78 @@ open_hash_file:
 			pPool = pItem->next;
 
 			hashvalue = HashFunc( pItem->data.phoneSeq );
-			pItem->next = pgdata->static_data.hashtable[ hashvalue ];
-			pgdata->static_data.hashtable[ hashvalue ] = pItem;
+			pItem->next = dict->hashtable[ hashvalue ];
+			dict->hashtable[ hashvalue ] = pItem;
 			pItem->data.recentTime -= oldest;
 		}
-		pgdata->static_data.chewing_lifetime -= oldest;
+		dict->chewing_lifetime -= oldest;
 	}
-	return 1;
+	return dict;
+}
+
+void UserDictRetain( UserDict *dict )
+{
+	plat_atomic_add_int( &dict->refcount, 1 );
+}
+
+/* Items are freed with the last user, so that no reader can still see them. */
+void UserDictRelease( UserDict *dict )
+{
+	if ( dict && plat_atomic_add_int( &dict->refcount, -1 ) == 0 )
+		UserDictFree( dict );
+}
+
+/*
+ * Persist learning updates on a background writer thread, so that keystrokes
+ * never wait for the disk. Return 0 on success.
+ */
+int UserDictSetAsync( UserDict *dict, int async )
+{
+	int ret = 0;
+
+	plat_mutex_lock( &dict->lock );
+	if ( async && ! dict->writer ) {
+		plat_atomic_store_ptr( (void **) &dict->writer, WriterStart( dict ) );
+		if ( ! dict->writer )
+			ret = -1;
+	}
+	if ( ret == 0 ) {
+		dict->async = async;
+		/* Updates are written directly from now on, after the queued ones. */
+		if ( ! async )
+			UserDictFlush( dict );
+	}
+	plat_mutex_unlock( &dict->lock );
+	return ret;
+}
+
+/* Wait until the updates queued so far are written. */
+void UserDictFlush( UserDict *dict )
+{
+	UserDictWriter *writer = plat_atomic_load_ptr( (void * const *) &dict->writer );
+	int ticket;
+
+	if ( ! writer )
+		return;
+	plat_mutex_lock( &writer->lock );
+	ticket = ++writer->requested;
+	plat_cond_signal( &writer->wake );
+	while ( writer->served < ticket )
+		plat_cond_wait( &writer->done, &writer->lock );
+	plat_mutex_unlock( &writer->lock );
+}
+
+void TerminateHash( ChewingData *pgdata )
+{
+	if ( pgdata->static_data.userdict )
+		UserDictFlush( pgdata->static_data.userdict );
+	UserDictRelease( pgdata->static_data.userdict );
+	pgdata->static_data.userdict = NULL;
+}
+
+int InitHash( ChewingData *pgdata )
+{
+	pgdata->static_data.userdict = UserDictOpen( NULL );
+	return pgdata->static_data.userdict != NULL;
 }
 
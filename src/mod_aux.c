@@ -19,7 +19,30 @@
 #include "global.h"
 #include "chewing-private.h"
 #include "zuin-private.h"
+#include "tree-private.h"
+#include "choice-private.h"
+#include "dict-private.h"
+#include "chewingutil.h"
 #include "chewingio.h"
+#include "mod_aux.h"
+#include "private.h"
+
+/*
+ * Concatenate "n" characters into "buf", which holds n * MAX_UTF8_SIZE + 1
+ * bytes, and return the length in bytes.
+ */
+static int RenderString( char *buf, const wch_t str[], int n )
+{
+	int i, len = 0, charLen;
+
+	for ( i = 0; i < n; i++ ) {
+		charLen = strlen( (const char *) str[ i ].s );
+		memcpy( buf + len, str[ i ].s, charLen );
+		len += charLen;
+	}
+	buf[ len ] = '\0';
+	return len;
+}
 
 /**
  * @param ctx handle to Chewing IM context
@@ -38,40 +61,55 @@ CHEWING_API int chewing_commit_Check( ChewingContext *ctx )
  */
 CHEWING_API char *chewing_commit_String( ChewingContext *ctx )
 {
-	int i;
-	char *s = (char *) calloc(
-		1 + ctx->output->nCommitStr,
-		MAX_UTF8_SIZE );
-	if ( s ) {
-		for ( i = 0; i < ctx->output->nCommitStr; i++ ) {
-			strcat( s, (char *) (ctx->output->commitStr[ i ].s) );
-		}
-	}
-	return s;
+	return strdup( chewing_commit_String_static( ctx, NULL ) );
+}
+
+/**
+ * @param ctx handle to Chewing IM context
+ * @param[out] len length of the string in bytes, if not NULL
+ *
+ * The returned string is owned by the context, see mod_aux.h.
+ */
+CHEWING_API const char *chewing_commit_String_static( ChewingContext *ctx, int *len )
+{
+	int n;
+
+	n = RenderString(
+		ctx->output->commitString,
+		ctx->output->commitStr, ctx->output->nCommitStr );
+	if ( len )
+		*len = n;
+	return ctx->output->commitString;
 }
 
 CHEWING_API int chewing_buffer_Check( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->chiSymbolBufLen != 0);
 }
 
 CHEWING_API int chewing_buffer_Len( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return ctx->output->chiSymbolBufLen;
 }
 
 CHEWING_API char *chewing_buffer_String( ChewingContext *ctx )
 {
-	int i;
-	char *s = (char *) calloc(
-		1 + ctx->output->chiSymbolBufLen,
-		MAX_UTF8_SIZE );
-	if ( s ) {
-		for ( i = 0; i < ctx->output->chiSymbolBufLen; i++ ) {
-			strcat( s, (char *) (ctx->output->chiSymbolBuf[ i ].s) );
-		}
-	}
-	return s;
+	return strdup( chewing_buffer_String_static( ctx, NULL ) );
+}
+
+CHEWING_API const char *chewing_buffer_String_static( ChewingContext *ctx, int *len )
+{
+	int n;
+
+	FlushOutput( ctx->output, ctx->data );
+	n = RenderString(
+		ctx->output->bufferString,
+		ctx->output->chiSymbolBuf, ctx->output->chiSymbolBufLen );
+	if ( len )
+		*len = n;
+	return ctx->output->bufferString;
 }
 
 /**
@@ -82,29 +120,36 @@ CHEWING_API char *chewing_buffer_String( ChewingContext *ctx )
  */
 CHEWING_API char *chewing_zuin_String( ChewingContext *ctx, int *zuin_count )
 {
-	char *s;
 	int i;
-	if ( zuin_count )
+
+	FlushOutput( ctx->output, ctx->data );
+	if ( zuin_count ) {
 		*zuin_count = 0;
-	s = (char*) calloc(
-		1 + ZUIN_SIZE,
-		sizeof(ctx->output->zuinBuf[ 0 ].s) );
-	if ( s ) {
 		for ( i = 0; i < ZUIN_SIZE; i++ ) {
-			if ( ctx->output->zuinBuf[ i ].s[ 0 ] != '\0' ) {
-				strcat( s, (char *) (ctx->output->zuinBuf[ i ].s) );
-				if ( zuin_count )
-					(*zuin_count)++;
-			}
+			if ( ctx->output->zuinBuf[ i ].s[ 0 ] != '\0' )
+				(*zuin_count)++;
 		}
 	}
-	return s;
+	return strdup( chewing_zuin_String_static( ctx, NULL ) );
+}
+
+CHEWING_API const char *chewing_zuin_String_static( ChewingContext *ctx, int *len )
+{
+	int n;
+
+	FlushOutput( ctx->output, ctx->data );
+	/* empty slots render as nothing */
+	n = RenderString( ctx->output->zuinString, ctx->output->zuinBuf, ZUIN_SIZE );
+	if ( len )
+		*len = n;
+	return ctx->output->zuinString;
 }
 
 CHEWING_API int chewing_zuin_Check( ChewingContext *ctx )
 {
 	int i;
 
+	FlushOutput( ctx->output, ctx->data );
 	for ( i = 0; i < ZUIN_SIZE; ++i ) {
 		if ( ctx->output->zuinBuf[ i ].s[ 0 ] != '\0' ) {
 			return 0;
@@ -115,50 +160,104 @@ CHEWING_API int chewing_zuin_Check( ChewingContext *ctx )
 
 CHEWING_API int chewing_cursor_Current( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->chiSymbolCursor);
 }
 
 CHEWING_API int chewing_cand_CheckDone( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (! ctx->output->pci);
 }
 
 CHEWING_API int chewing_cand_TotalPage( ChewingContext *ctx )
 {
-	return (ctx->output->pci ? ctx->output->pci->nPage : 0);
+	FlushOutput( ctx->output, ctx->data );
+	if ( ! ctx->output->pci )
+		return 0;
+	ChoiceInfoFill( ctx->data, MAX_CHOICE );
+	return ctx->output->pci->nPage;
 }
 
 CHEWING_API int chewing_cand_ChoicePerPage( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->pci ? ctx->output->pci->nChoicePerPage : 0);
 }
 
 CHEWING_API int chewing_cand_TotalChoice( ChewingContext *ctx )
 {
-	return (ctx->output->pci ? ctx->output->pci->nTotalChoice : 0);
+	FlushOutput( ctx->output, ctx->data );
+	if ( ! ctx->output->pci )
+		return 0;
+	return ChoiceInfoFill( ctx->data, MAX_CHOICE );
 }
 
 CHEWING_API int chewing_cand_CurrentPage( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->pci ? ctx->output->pci->pageNo : -1);
 }
 
 CHEWING_API void chewing_cand_Enumerate( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	ctx->cand_no = ctx->output->pci->pageNo * ctx->output->pci->nChoicePerPage;
 }
 
 CHEWING_API int chewing_cand_hasNext( ChewingContext *ctx )
 {
-	return (ctx->cand_no < ctx->output->pci->nTotalChoice);
+	/* Candidates are listed as they are walked through. */
+	return (ctx->cand_no < ChoiceInfoFill( ctx->data, ctx->cand_no + 1 ));
 }
 
 CHEWING_API char *chewing_cand_String( ChewingContext *ctx )
 {
-	char *s;
+	return strdup( chewing_cand_String_static( ctx, NULL ) );
+}
+
+CHEWING_API const char *chewing_cand_String_static( ChewingContext *ctx, int *len )
+{
+	const char *s = "";
+
 	if ( chewing_cand_hasNext( ctx ) ) {
-		s = strdup( ctx->output->pci->totalChoiceStr[ ctx->cand_no ] );
+		s = ChoiceInfoString( ctx->output->pci, ctx->cand_no );
 		ctx->cand_no++;
+	}
+	if ( len )
+		*len = strlen( s );
+	return s;
+}
+
+/**
+ * @param ctx handle to Chewing IM context
+ *
+ * Predict phrases starting with the phones at the end of preedit buffer, and
+ * start enumerating them from the most frequent one.
+ */
+CHEWING_API void chewing_predict_Enumerate( ChewingContext *ctx )
+{
+	TreePredictPhrase( ctx->data );
+	ctx->predict_no = 0;
+}
+
+CHEWING_API int chewing_predict_hasNext( ChewingContext *ctx )
+{
+	return (ctx->predict_no < ctx->data->predictInfo.nPredict);
+}
+
+CHEWING_API int chewing_predict_PrefixLen( ChewingContext *ctx )
+{
+	return ctx->data->predictInfo.nPrefix;
+}
+
+CHEWING_API char *chewing_predict_String( ChewingContext *ctx )
+{
+	char *s;
+	if ( chewing_predict_hasNext( ctx ) ) {
+		s = strdup( GetDictPhrase( ctx->data,
+			ctx->data->predictInfo.leaf[ ctx->predict_no ] ) );
+		ctx->predict_no++;
 	} else {
 		s = strdup( "" );
 	}
@@ -167,11 +266,13 @@ CHEWING_API char *chewing_cand_String( ChewingContext *ctx )
 
 CHEWING_API void chewing_interval_Enumerate( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	ctx->it_no = 0;
 }
 
 CHEWING_API int chewing_interval_hasNext( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->it_no < ctx->output->nDispInterval);
 }
 
@@ -188,26 +289,142 @@ CHEWING_API void chewing_interval_Get( ChewingContext *ctx, IntervalType *it )
 
 CHEWING_API int chewing_aux_Check( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->bShowMsg);
 }
 
 CHEWING_API int chewing_aux_Length( ChewingContext *ctx )
 {
+	FlushOutput( ctx->output, ctx->data );
 	return (ctx->output->bShowMsg ? ctx->output->showMsgLen : 0);
 }
 
 CHEWING_API char *chewing_aux_String( ChewingContext *ctx )
+{
+	return strdup( chewing_aux_String_static( ctx, NULL ) );
+}
+
+CHEWING_API const char *chewing_aux_String_static( ChewingContext *ctx, int *len )
+{
+	int n;
+
+	FlushOutput( ctx->output, ctx->data );
+	n = RenderString(
+		ctx->output->auxString,
+		ctx->output->showMsg, ctx->output->showMsgLen );
+	if ( len )
+		*len = n;
+	return ctx->output->auxString;
+}
+
+static int SameChar( const wch_t *a, const wch_t *b )
+{
+	return strcmp( (const char *) a->s, (const char *) b->s ) == 0;
+}
+
+static int SameString( const wch_t a[], int aLen, const wch_t b[], int bLen )
 {
 	int i;
-	char *msg = (char *) calloc(
-		1 + ctx->output->showMsgLen,
-		MAX_UTF8_SIZE );
-	if ( msg ) {
-		for ( i = 0; i < ctx->output->showMsgLen; ++i )
-			strcat( msg, (char *)(ctx->output->showMsg[ i ].s) );
+
+	if ( aLen != bLen )
+		return 0;
+	for ( i = 0; i < aLen; i++ ) {
+		if ( ! SameChar( &a[ i ], &b[ i ] ) )
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * @param ctx handle to Chewing IM context
+ * @param[out] diff changes since the previous call, may be NULL
+ * @retval 1 if anything changed, 0 otherwise
+ *
+ * The first call reports changes since the empty output.
+ */
+CHEWING_API int chewing_output_Diff( ChewingContext *ctx, OutputDiffType *diff )
+{
+	/* Compared with when no snapshot can be allocated, to report everything. */
+	static const OutputSnapshot emptySnapshot;
+	ChewingOutput *pgo = ctx->output;
+	const OutputSnapshot *last;
+	OutputSnapshot *snapshot;
+	const ChoiceInfo *pci = &ctx->data->choiceInfo;
+	OutputDiffType d;
+	int prefix, suffix, maxSuffix;
+
+	FlushOutput( pgo, ctx->data );
+
+	/* Most callers never ask for differences, so the snapshot is allocated here. */
+	if ( ! pgo->lastReported )
+		pgo->lastReported = ALC( OutputSnapshot, 1 );
+	snapshot = pgo->lastReported;
+	last = snapshot ? snapshot : &emptySnapshot;
+
+	/* The changed range lies between the common prefix and suffix. */
+	for ( prefix = 0;
+	      prefix < last->chiSymbolBufLen && prefix < pgo->chiSymbolBufLen &&
+	      SameChar( &last->chiSymbolBuf[ prefix ], &pgo->chiSymbolBuf[ prefix ] );
+	      prefix++ )
+		;
+	maxSuffix = ( last->chiSymbolBufLen < pgo->chiSymbolBufLen ?
+		last->chiSymbolBufLen : pgo->chiSymbolBufLen ) - prefix;
+	for ( suffix = 0;
+	      suffix < maxSuffix &&
+	      SameChar( &last->chiSymbolBuf[ last->chiSymbolBufLen - 1 - suffix ],
+	                &pgo->chiSymbolBuf[ pgo->chiSymbolBufLen - 1 - suffix ] );
+	      suffix++ )
+		;
+	d.bufferFrom = prefix;
+	d.bufferOldTo = last->chiSymbolBufLen - suffix;
+	d.bufferTo = pgo->chiSymbolBufLen - suffix;
+
+	d.intervalChanged =
+		last->nDispInterval != pgo->nDispInterval ||
+		memcmp( last->dispInterval, pgo->dispInterval,
+			sizeof( pgo->dispInterval[ 0 ] ) * pgo->nDispInterval ) ||
+		last->dispBrkpt != pgo->dispBrkpt;
+	d.cursorChanged = last->chiSymbolCursor != pgo->chiSymbolCursor;
+	d.zuinChanged = ! SameString(
+		last->zuinBuf, ZUIN_SIZE, pgo->zuinBuf, ZUIN_SIZE );
+	d.candChanged =
+		last->bSelect != ctx->data->bSelect ||
+		( ctx->data->bSelect && (
+			last->setGen != pci->setGen ||
+			last->pageNo != pci->pageNo ||
+			last->nChoicePerPage != pci->nChoicePerPage ) );
+	d.auxChanged =
+		last->bShowMsg != pgo->bShowMsg ||
+		( pgo->bShowMsg && ! SameString(
+			last->showMsg, last->showMsgLen,
+			pgo->showMsg, pgo->showMsgLen ) );
+
+	/* remember what has been reported */
+	if ( snapshot ) {
+		memcpy( snapshot->chiSymbolBuf, pgo->chiSymbolBuf,
+			sizeof( pgo->chiSymbolBuf[ 0 ] ) * pgo->chiSymbolBufLen );
+		snapshot->chiSymbolBufLen = pgo->chiSymbolBufLen;
+		snapshot->chiSymbolCursor = pgo->chiSymbolCursor;
+		memcpy( snapshot->zuinBuf, pgo->zuinBuf, sizeof( pgo->zuinBuf ) );
+		memcpy( snapshot->dispInterval, pgo->dispInterval,
+			sizeof( pgo->dispInterval[ 0 ] ) * pgo->nDispInterval );
+		snapshot->nDispInterval = pgo->nDispInterval;
+		snapshot->dispBrkpt = pgo->dispBrkpt;
+		snapshot->bSelect = ctx->data->bSelect;
+		snapshot->setGen = pci->setGen;
+		snapshot->pageNo = pci->pageNo;
+		snapshot->nChoicePerPage = pci->nChoicePerPage;
+		snapshot->bShowMsg = pgo->bShowMsg;
+		memcpy( snapshot->showMsg, pgo->showMsg,
+			sizeof( pgo->showMsg[ 0 ] ) * pgo->showMsgLen );
+		snapshot->showMsgLen = pgo->showMsgLen;
 	}
-	return msg;
 
+	if ( diff )
+		*diff = d;
+	return d.bufferFrom != d.bufferTo || d.bufferFrom != d.bufferOldTo ||
+		d.intervalChanged || d.cursorChanged || d.zuinChanged ||
+		d.candChanged || d.auxChanged;
 }
 
 CHEWING_API int chewing_keystroke_CheckIgnore( ChewingContext *ctx )
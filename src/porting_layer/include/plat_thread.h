@@ -0,0 +1,66 @@
+/**
+ * plat_thread.h
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifndef __PLAT_THREAD_H__
+#define __PLAT_THREAD_H__
+
+#include "plat_types.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* Start func( arg ) in a new thread, return 0 on success */
+int plat_thread_create( plat_thread *thread, void *(*func)( void *arg ), void *arg );
+
+/* Wait for the thread to finish */
+void plat_thread_join( plat_thread thread );
+
+/* Return the number of processors online, at least 1 */
+int plat_thread_cpu_count();
+
+/* Mutex, return 0 on success */
+int plat_mutex_init( plat_mutex *mutex );
+void plat_mutex_destroy( plat_mutex *mutex );
+void plat_mutex_lock( plat_mutex *mutex );
+void plat_mutex_unlock( plat_mutex *mutex );
+
+/* Condition variable, return 0 on success */
+int plat_cond_init( plat_cond *cond );
+void plat_cond_destroy( plat_cond *cond );
+void plat_cond_wait( plat_cond *cond, plat_mutex *mutex );
+void plat_cond_signal( plat_cond *cond );
+void plat_cond_broadcast( plat_cond *cond );
+
+/*
+ * Atomic access. A load is an acquire and a store a release, so that data
+ * written before a pointer is stored can be read through a loaded pointer.
+ */
+void *plat_atomic_load_ptr( void * const *ptr );
+void plat_atomic_store_ptr( void **ptr, void *value );
+int plat_atomic_load_int( const int *ptr );
+void plat_atomic_store_int( int *ptr, int value );
+
+/* Add value to *ptr, return the new value */
+int plat_atomic_add_int( int *ptr, int value );
+
+/* Store value to *ptr, return the old value */
+int plat_atomic_exchange_int( int *ptr, int value );
+void *plat_atomic_exchange_ptr( void **ptr, void *value );
+
+/* Store value to *ptr if it is still expected, return nonzero on success */
+int plat_atomic_cas_ptr( void **ptr, void *expected, void *value );
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __PLAT_THREAD_H__ */
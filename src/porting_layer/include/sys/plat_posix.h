@@ -18,6 +18,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 
@@ -48,6 +49,11 @@ typedef struct plat_mmap {
 	int fAccessAttr;
 } plat_mmap;
 
+/* plat_thread.h */
+typedef pthread_t plat_thread;
+typedef pthread_mutex_t plat_mutex;
+typedef pthread_cond_t plat_cond;
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
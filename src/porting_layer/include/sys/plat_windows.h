@@ -62,6 +62,11 @@ typedef struct plat_mmap
 	int fAccessAttr;
 } plat_mmap;
 
+/* plat_thread.h */
+typedef HANDLE plat_thread;
+typedef CRITICAL_SECTION plat_mutex;
+typedef CONDITION_VARIABLE plat_cond;
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,126 @@
+/**
+ * plat_thread_posix.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#ifdef UNDER_POSIX
+
+#include <unistd.h>
+#include "plat_thread.h"
+
+int plat_thread_create( plat_thread *thread, void *(*func)( void *arg ), void *arg )
+{
+	return pthread_create( thread, NULL, func, arg );
+}
+
+void plat_thread_join( plat_thread thread )
+{
+	pthread_join( thread, NULL );
+}
+
+int plat_thread_cpu_count()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	if ( n > 0 )
+		return n;
+#endif
+	return 1;
+}
+
+int plat_mutex_init( plat_mutex *mutex )
+{
+	return pthread_mutex_init( mutex, NULL );
+}
+
+void plat_mutex_destroy( plat_mutex *mutex )
+{
+	pthread_mutex_destroy( mutex );
+}
+
+void plat_mutex_lock( plat_mutex *mutex )
+{
+	pthread_mutex_lock( mutex );
+}
+
+void plat_mutex_unlock( plat_mutex *mutex )
+{
+	pthread_mutex_unlock( mutex );
+}
+
+int plat_cond_init( plat_cond *cond )
+{
+	return pthread_cond_init( cond, NULL );
+}
+
+void plat_cond_destroy( plat_cond *cond )
+{
+	pthread_cond_destroy( cond );
+}
+
+void plat_cond_wait( plat_cond *cond, plat_mutex *mutex )
+{
+	pthread_cond_wait( cond, mutex );
+}
+
+void plat_cond_signal( plat_cond *cond )
+{
+	pthread_cond_signal( cond );
+}
+
+void plat_cond_broadcast( plat_cond *cond )
+{
+	pthread_cond_broadcast( cond );
+}
+
+void *plat_atomic_load_ptr( void * const *ptr )
+{
+	return __atomic_load_n( ptr, __ATOMIC_ACQUIRE );
+}
+
+void plat_atomic_store_ptr( void **ptr, void *value )
+{
+	__atomic_store_n( ptr, value, __ATOMIC_RELEASE );
+}
+
+int plat_atomic_load_int( const int *ptr )
+{
+	return __atomic_load_n( ptr, __ATOMIC_ACQUIRE );
+}
+
+void plat_atomic_store_int( int *ptr, int value )
+{
+	__atomic_store_n( ptr, value, __ATOMIC_RELEASE );
+}
+
+int plat_atomic_add_int( int *ptr, int value )
+{
+	return __atomic_add_fetch( ptr, value, __ATOMIC_ACQ_REL );
+}
+
+int plat_atomic_exchange_int( int *ptr, int value )
+{
+	return __atomic_exchange_n( ptr, value, __ATOMIC_ACQ_REL );
+}
+
+void *plat_atomic_exchange_ptr( void **ptr, void *value )
+{
+	return __atomic_exchange_n( ptr, value, __ATOMIC_ACQ_REL );
+}
+
+int plat_atomic_cas_ptr( void **ptr, void *expected, void *value )
+{
+	return __atomic_compare_exchange_n( ptr, &expected, value, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+}
+
+#endif /* UNDER_POSIX */
@@ -0,0 +1,152 @@
+/**
+ * plat_thread_windows.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+  #include <config.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64) || defined(_WIN32_WCE)
+
+#include <stdlib.h>
+#include "plat_thread.h"
+
+typedef struct {
+	void *(*func)( void *arg );
+	void *arg;
+} ThreadStart;
+
+static DWORD WINAPI ThreadMain( LPVOID param )
+{
+	ThreadStart start = *(ThreadStart *) param;
+
+	free( param );
+	start.func( start.arg );
+	return 0;
+}
+
+int plat_thread_create( plat_thread *thread, void *(*func)( void *arg ), void *arg )
+{
+	ThreadStart *start = malloc( sizeof( ThreadStart ) );
+
+	if ( ! start )
+		return -1;
+	start->func = func;
+	start->arg = arg;
+	*thread = CreateThread( NULL, 0, ThreadMain, start, 0, NULL );
+	if ( ! *thread ) {
+		free( start );
+		return -1;
+	}
+	return 0;
+}
+
+void plat_thread_join( plat_thread thread )
+{
+	WaitForSingleObject( thread, INFINITE );
+	CloseHandle( thread );
+}
+
+int plat_thread_cpu_count()
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+int plat_mutex_init( plat_mutex *mutex )
+{
+	InitializeCriticalSection( mutex );
+	return 0;
+}
+
+void plat_mutex_destroy( plat_mutex *mutex )
+{
+	DeleteCriticalSection( mutex );
+}
+
+void plat_mutex_lock( plat_mutex *mutex )
+{
+	EnterCriticalSection( mutex );
+}
+
+void plat_mutex_unlock( plat_mutex *mutex )
+{
+	LeaveCriticalSection( mutex );
+}
+
+int plat_cond_init( plat_cond *cond )
+{
+	InitializeConditionVariable( cond );
+	return 0;
+}
+
+void plat_cond_destroy( plat_cond *cond )
+{
+}
+
+void plat_cond_wait( plat_cond *cond, plat_mutex *mutex )
+{
+	SleepConditionVariableCS( cond, mutex, INFINITE );
+}
+
+void plat_cond_signal( plat_cond *cond )
+{
+	WakeConditionVariable( cond );
+}
+
+void plat_cond_broadcast( plat_cond *cond )
+{
+	WakeAllConditionVariable( cond );
+}
+
+/* The Interlocked functions imply a full memory barrier. */
+void *plat_atomic_load_ptr( void * const *ptr )
+{
+	return InterlockedCompareExchangePointer( (PVOID volatile *) ptr, NULL, NULL );
+}
+
+void plat_atomic_store_ptr( void **ptr, void *value )
+{
+	InterlockedExchangePointer( (PVOID volatile *) ptr, value );
+}
+
+int plat_atomic_load_int( const int *ptr )
+{
+	return InterlockedCompareExchange( (LONG volatile *) ptr, 0, 0 );
+}
+
+void plat_atomic_store_int( int *ptr, int value )
+{
+	InterlockedExchange( (LONG volatile *) ptr, value );
+}
+
+int plat_atomic_add_int( int *ptr, int value )
+{
+	return InterlockedExchangeAdd( (LONG volatile *) ptr, value ) + value;
+}
+
+int plat_atomic_exchange_int( int *ptr, int value )
+{
+	return InterlockedExchange( (LONG volatile *) ptr, value );
+}
+
+void *plat_atomic_exchange_ptr( void **ptr, void *value )
+{
+	return InterlockedExchangePointer( (PVOID volatile *) ptr, value );
+}
+
+int plat_atomic_cas_ptr( void **ptr, void *expected, void *value )
+{
+	return InterlockedCompareExchangePointer(
+		(PVOID volatile *) ptr, value, expected ) == expected;
+}
+
+#endif /* defined(_WIN32) || defined(_WIN64) || defined(_WIN32_WCE) */
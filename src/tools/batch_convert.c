@@ -0,0 +1,221 @@
+/**
+ * batch_convert.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+/**
+ * @file batch_convert.c
+ *
+ * @brief Conversion of Bopomofo or key stroke corpora to text.\n
+ *
+ *	This program reads in lines of Bopomofo syllables separated by spaces,\n
+ * or of key strokes with -k, and writes their conversion line by line in the\n
+ * same order. Lines are converted in blocks by a pool of threads, each with\n
+ * its own session of one engine, so that the dictionary is loaded once.\n
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chewing.h"
+#include "plat_thread.h"
+
+#define LINES_PER_THREAD (1024)
+
+const char USAGE[] =
+	"Usage: %s [-k] [-j threads] [input [output]]\n"
+	"Convert lines of Bopomofo syllables separated by spaces to text.\n"
+	"  -k          lines are key strokes of the default keyboard layout\n"
+	"  -j threads  number of threads, the number of processors by default\n"
+	"Data files are searched in CHEWING_PATH.\n"
+;
+
+typedef struct {
+	char **line;
+	char **result;
+	int num_line;
+	int next;
+	int keystroke;
+	int error;
+} Block;
+
+typedef struct {
+	ChewingContext *ctx;
+	Block *block;
+	plat_thread thread;
+} Worker;
+
+static void *convert_lines(void *arg)
+{
+	Worker *worker = (Worker *) arg;
+	Block *block = worker->block;
+	char *result;
+	int i;
+
+	/* Take lines one by one, so that threads stay busy whatever the line lengths. */
+	while ((i = plat_atomic_add_int(&block->next, 1) - 1) < block->num_line) {
+		if (block->keystroke)
+			result = chewing_convert_Keystroke(worker->ctx, block->line[i]);
+		else
+			result = chewing_convert_Bopomofo(worker->ctx, block->line[i]);
+		if (!result)
+			plat_atomic_store_int(&block->error, 1);
+		block->result[i] = result;
+	}
+	return NULL;
+}
+
+/* Read a line without its line break, return NULL at the end of input. */
+static char *read_line(FILE *input)
+{
+	char *line = NULL, *p;
+	size_t len = 0, size = 0;
+
+	for (;;) {
+		if (size - len < 2) {
+			size = size ? size * 2 : 256;
+			p = realloc(line, size);
+			if (!p) {
+				free(line);
+				return NULL;
+			}
+			line = p;
+		}
+		if (!fgets(line + len, size - len, input))
+			break;
+		len += strlen(line + len);
+		if (len > 0 && line[len - 1] == '\n')
+			break;
+	}
+
+	if (len == 0 && (feof(input) || ferror(input))) {
+		free(line);
+		return NULL;
+	}
+	while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+		line[--len] = '\0';
+	return line;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *input = stdin;
+	FILE *output = stdout;
+	ChewingEngine *engine;
+	Worker *worker;
+	Block block;
+	int num_thread = plat_thread_cpu_count();
+	int keystroke = 0;
+	int block_size;
+	int i, started;
+	int ret = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+		if (strcmp(argv[i], "-k") == 0) {
+			keystroke = 1;
+		} else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			num_thread = atoi(argv[++i]);
+		} else {
+			fprintf(stderr, USAGE, argv[0]);
+			return -1;
+		}
+	}
+	if (num_thread < 1 || argc - i > 2) {
+		fprintf(stderr, USAGE, argv[0]);
+		return -1;
+	}
+	if (i < argc && strcmp(argv[i], "-") != 0) {
+		input = fopen(argv[i], "r");
+		if (!input) {
+			fprintf(stderr, "Cannot open %s\n", argv[i]);
+			return -1;
+		}
+	}
+	if (i + 1 < argc) {
+		output = fopen(argv[i + 1], "w");
+		if (!output) {
+			fprintf(stderr, "Cannot open %s\n", argv[i + 1]);
+			return -1;
+		}
+	}
+
+	engine = chewing_engine_new();
+	if (!engine) {
+		fprintf(stderr, "Cannot load data files\n");
+		return -1;
+	}
+
+	block_size = num_thread * LINES_PER_THREAD;
+	block.line = calloc(block_size, sizeof(*block.line));
+	block.result = calloc(block_size, sizeof(*block.result));
+	block.keystroke = keystroke;
+	block.error = 0;
+	worker = calloc(num_thread, sizeof(*worker));
+	if (!block.line || !block.result || !worker) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	for (i = 0; i < num_thread; ++i) {
+		worker[i].ctx = chewing_engine_new_session(engine, NULL);
+		worker[i].block = &block;
+		if (!worker[i].ctx) {
+			fprintf(stderr, "Cannot create session\n");
+			return -1;
+		}
+	}
+
+	for (;;) {
+		for (block.num_line = 0; block.num_line < block_size; ++block.num_line) {
+			block.line[block.num_line] = read_line(input);
+			if (!block.line[block.num_line])
+				break;
+		}
+		if (block.num_line == 0)
+			break;
+
+		/* Convert in the main thread when no thread can be started. */
+		block.next = 0;
+		for (started = 0; started < num_thread; ++started) {
+			if (plat_thread_create(&worker[started].thread, convert_lines, &worker[started]) != 0)
+				break;
+		}
+		if (started == 0)
+			convert_lines(&worker[0]);
+		for (i = 0; i < started; ++i)
+			plat_thread_join(worker[i].thread);
+
+		for (i = 0; i < block.num_line; ++i) {
+			if (block.result[i])
+				fprintf(output, "%s\n", block.result[i]);
+			chewing_free(block.result[i]);
+			free(block.line[i]);
+		}
+		if (block.error) {
+			fprintf(stderr, "Conversion failed\n");
+			ret = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < num_thread; ++i)
+		chewing_delete(worker[i].ctx);
+	chewing_engine_delete(engine);
+	free(worker);
+	free(block.result);
+	free(block.line);
+	if (input != stdin)
+		fclose(input);
+	if (output != stdout)
+		fclose(output);
+	return ret;
+}
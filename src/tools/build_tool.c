@@ -33,24 +33,195 @@
 #define END		     "end"
 
 /*
- * Please see TreeType for data field. pFirstChild points to the first of its
- * child list. pNextSibling points to its right sibling, where it and its right
- * sibling are both in the child list of its parent. However, pNextSibling will
- * become next-pointer like linked list, which makes writing of index-tree file
- * become a sequential traversal rather than BFS.
+ * A parsed cin file is cached as <basename of cin>.cache in the working
+ * directory, so that later runs map it instead of parsing the cin again. The
+ * cache is native endian, since it is only read by the tools that wrote it:
+ *   CinCacheHeader
+ *   CinRecord[num_record], in the order of word_data after read_IM_cin()
+ *   char[string_size], distinct words of records, each ended by '\0'
+ * The cache is valid for a cin of the same size and content hash, whatever its
+ * path is. Codes are stored encoded, so the cache also records the encoder.
  */
-typedef struct _tNODE {
-	TreeType data;
-	struct _tNODE *pFirstChild, *pNextSibling;
-} NODE;
+#define CIN_CACHE_SUFFIX  ".cache"
+#define CIN_CACHE_MAGIC   0x4e494342 /* "BCIN" */
+#define CIN_CACHE_VERSION 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t cin_size;  /* Size and FNV-1a hash of content of the cached cin. */
+	uint64_t cin_hash;
+	char encoding[16];  /* See encoding_name(). */
+	uint32_t num_record;
+	uint32_t string_size;
+	uint32_t has_name;
+	char name[MAX_LINE_LEN];
+} CinCacheHeader;
+
+typedef struct {
+	uint32_t phone; /* Code encoded by the encoder of the cache. */
+	uint32_t word;  /* Offset of the word in the strings of the cache. */
+	uint32_t index; /* Order in cin. */
+} CinRecord;
+
+/*
+ * A leaf of the index tree, either a word of cin or a phrase of tsi.src. After
+ * sorting entries by phone sequence, the entries below any node form a range,
+ * where leaves of the node come first and its children follow in ascending
+ * order of key. This lets the tree be laid out without building nodes.
+ */
+typedef struct {
+	const uint32_t *phone;
+	int len; /* Length of phone, which is also the depth of the leaf. */
+	int lcp; /* Length of common prefix with phone of the previous entry. */
+	uint32_t pos;
+	int32_t freq;
+	int order; /* For ordering leaves having the same phone sequence. */
+} TreeEntry;
 
 /* word_data and phrase_data can be referenced from outside (extern). */
-WordData word_data[MAX_WORD_DATA];
+WordData *word_data = NULL;
 int num_word_data = 0;
-PhraseData phrase_data[MAX_PHRASE_DATA];
+static size_t word_data_size = 0;
+PhraseData *phrase_data = NULL;
 int num_phrase_data = 0;
+static size_t phrase_data_size = 0;
 
-NODE *root;
+/* Pools of strings and phone sequences, where entries refer by offsets. */
+static char *string_pool = NULL;
+static size_t string_pool_len = 0, string_pool_size = 0;
+static uint32_t *phone_pool = NULL;
+static size_t phone_pool_len = 0, phone_pool_size = 0;
+
+/* Open addressing hash table of (offset + 1) in string_pool, 0 means empty. */
+static uint32_t *intern_table = NULL;
+static size_t intern_table_size = 0, num_interned = 0;
+
+/*
+ * This function makes room for at least need elements in the array, which
+ * grows geometrically so that appending is amortized constant time.
+ */
+void *grow_array(void *array, size_t *size, size_t need, size_t elem_size)
+{
+	size_t new_size = *size ? *size : 256;
+
+	if (need <= *size)
+		return array;
+	while (new_size < need)
+		new_size *= 2;
+	array = realloc(array, new_size * elem_size);
+	if (!array) {
+		fprintf(stderr, "Memory allocation failed on reading data.\n");
+		exit(-1);
+	}
+	memset((char *)array + *size * elem_size, 0, (new_size - *size) * elem_size);
+	*size = new_size;
+	return array;
+}
+
+static size_t hash_string(const char *str)
+{
+	size_t h = 2166136261u;
+
+	for (; *str; ++str)
+		h = (h ^ (unsigned char)*str) * 16777619u;
+	return h;
+}
+
+static void rehash_interned()
+{
+	uint32_t *old = intern_table;
+	size_t old_size = intern_table_size, i, j;
+
+	intern_table_size = old_size ? old_size * 2 : 4096;
+	intern_table = ALC(uint32_t, intern_table_size);
+	if (!intern_table) {
+		fprintf(stderr, "Memory allocation failed on reading data.\n");
+		exit(-1);
+	}
+	for (i = 0; i < old_size; ++i) {
+		if (old[i] == 0)
+			continue;
+		j = hash_string(string_pool + old[i] - 1) & (intern_table_size - 1);
+		while (intern_table[j] != 0)
+			j = (j + 1) & (intern_table_size - 1);
+		intern_table[j] = old[i];
+	}
+	free(old);
+}
+
+uint32_t intern_string(const char *str)
+{
+	size_t len = strlen(str) + 1, i;
+	uint32_t offset;
+
+	if (2 * (num_interned + 1) > intern_table_size)
+		rehash_interned();
+
+	i = hash_string(str) & (intern_table_size - 1);
+	for (; intern_table[i] != 0; i = (i + 1) & (intern_table_size - 1))
+		if (strcmp(string_pool + intern_table[i] - 1, str) == 0)
+			return intern_table[i] - 1;
+
+	string_pool = grow_array(string_pool, &string_pool_size, string_pool_len + len, 1);
+	offset = (uint32_t)string_pool_len;
+	memcpy(string_pool + offset, str, len);
+	string_pool_len += len;
+
+	intern_table[i] = offset + 1;
+	++num_interned;
+	return offset;
+}
+
+const char *string_at(uint32_t offset)
+{
+	return string_pool + offset;
+}
+
+uint32_t store_phone(const uint32_t *phone, int len)
+{
+	uint32_t offset;
+
+	phone_pool = grow_array(phone_pool, &phone_pool_size, phone_pool_len + len + 1, sizeof(phone_pool[0]));
+	offset = (uint32_t)phone_pool_len;
+	memcpy(phone_pool + offset, phone, len * sizeof(phone_pool[0]));
+	phone_pool[offset + len] = 0;
+	phone_pool_len += len + 1;
+	return offset;
+}
+
+const uint32_t *phone_at(uint32_t offset)
+{
+	return phone_pool + offset;
+}
+
+PhraseData *append_phrase_data(void)
+{
+	phrase_data = grow_array(phrase_data, &phrase_data_size, num_phrase_data + 1, sizeof(phrase_data[0]));
+	return &phrase_data[num_phrase_data++];
+}
+
+void clear_phrase_data(void)
+{
+	num_phrase_data = 0;
+}
+
+void detach_word_data(WordData **data, int *num)
+{
+	*data = word_data;
+	*num = num_word_data;
+	word_data = NULL;
+	num_word_data = 0;
+	word_data_size = 0;
+}
+
+void attach_word_data(WordData *data, int num)
+{
+	free(word_data);
+	word_data = data;
+	num_word_data = num;
+	word_data_size = num;
+}
 
 void strip(char *line)
 {
@@ -73,39 +244,29 @@ void strip(char *line)
 	}
 }
 
-/* word_data is sorted reversely, for stack-like push operation. */
-static int compare_word_by_phone(const void *x, const void *y)
-{
-	const WordData *a = (const WordData *)x;
-	const WordData *b = (const WordData *)y;
-
-	if (a->text.phone[0] != b->text.phone[0])
-		return b->text.phone[0] - a->text.phone[0];
-
-	/* Compare original index for stable sort */
-	return b->index - a->index;
-}
-
 int compare_word_by_text(const void *x, const void *y)
 {
 	const WordData *a = (const WordData *)x;
 	const WordData *b = (const WordData *)y;
 	int ret;
 
-	ret = strcmp(a->text.phrase, b->text.phrase);
+	ret = strcmp(string_at(a->text.phrase), string_at(b->text.phrase));
 	if (ret != 0)
 		return ret;
 
-	if (a->text.phone[0] != b->text.phone[0])
-		return a->text.phone[0] - b->text.phone[0];
+	if (phone_at(a->text.phone)[0] != phone_at(b->text.phone)[0])
+		return phone_at(a->text.phone)[0] - phone_at(b->text.phone)[0];
 
-	return 0;
+	/* Keep cin order of duplicates, which words read from the cache have. */
+	return a->index - b->index;
 }
 
 static void store_word(const char *line, const int line_num, EncFunct encode)
 {
 	char key_buf[ZUIN_SIZE + 1];
+	char word[MAX_UTF8_SIZE + 1] = {0};
 	char buf[MAX_LINE_LEN];
+	uint32_t phone;
 
 	strncpy(buf, line, sizeof(buf));
 
@@ -113,37 +274,246 @@ static void store_word(const char *line, const int line_num, EncFunct encode)
 	if (strlen(buf) == 0)
 		return;
 
-	if (num_word_data >= MAX_WORD_DATA) {
-		fprintf(stderr, "Need to increase MAX_WORD_DATA to process\n");
-		exit(-1);
-	}
-
 #define UTF8_FORMAT_STRING(len1, len2) \
 	"%" __stringify(len1) "[^ ]" " " \
 	"%" __stringify(len2) "[^ ]"
 	sscanf(buf, UTF8_FORMAT_STRING(ZUIN_SIZE, MAX_UTF8_SIZE),
-		key_buf, word_data[num_word_data].text.phrase);
+		key_buf, word);
 
 	if (strlen(key_buf) > ZUIN_SIZE) {
 		fprintf(stderr, "Error reading line %d, `%s'\n", line_num, line);
 		exit(-1);
 	}
-	word_data[num_word_data].text.phone[0] = encode(key_buf);
+	phone = encode(key_buf);
 
+	word_data = grow_array(word_data, &word_data_size, num_word_data + 1, sizeof(word_data[0]));
+	word_data[num_word_data].text.phrase = intern_string(word);
+	word_data[num_word_data].text.phone = store_phone(&phone, 1);
 	word_data[num_word_data].index = num_word_data;
 	++num_word_data;
 }
 
+static int cin_cache_path(const char *filename, char *path, size_t size)
+{
+	const char *name = filename;
+	const char *p;
+	int len;
+
+	for (p = filename; *p; ++p) {
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+	len = snprintf(path, size, "%s" CIN_CACHE_SUFFIX, name);
+	return len >= 0 && (size_t)len < size;
+}
+
+/*
+ * Name of an encoder recorded in caches, or NULL for an encoder unknown here,
+ * whose cin is not cached.
+ */
+static const char *encoding_name(EncFunct encode)
+{
+	if (encode == EncodeZuinKey)
+		return "zuin";
+	if (encode == EncodeKeyin)
+		return "keyin";
+	return NULL;
+}
+
+/* Size and FNV-1a hash of content of a file. Return 0 if it cannot be read. */
+static int hash_file(const char *filename, uint64_t *size, uint64_t *hash)
+{
+	plat_mmap map;
+	size_t offset = 0, len, i;
+	const unsigned char *data;
+	uint64_t h = 14695981039346656037u;
+
+	plat_mmap_set_invalid(&map);
+	len = plat_mmap_create(&map, filename, FLAG_ATTRIBUTE_READ);
+	if (len == 0) {
+		plat_mmap_close(&map);
+		return 0;
+	}
+	data = (const unsigned char *)plat_mmap_set_view(&map, &offset, &len);
+	if (!data) {
+		plat_mmap_close(&map);
+		return 0;
+	}
+	for (i = 0; i < len; ++i)
+		h = (h ^ data[i]) * 1099511628211u;
+	plat_mmap_close(&map);
+
+	*size = len;
+	*hash = h;
+	return 1;
+}
+
+/*
+ * Append words of a valid cache to word_data, in the order read_IM_cin() sorts
+ * them. Return 0 if the cache is missing, stale or broken, and word_data is
+ * intact.
+ */
+static int read_cin_cache(const char *path, uint64_t cin_size, uint64_t cin_hash,
+	const char *encoding, char *IM_name)
+{
+	plat_mmap cache;
+	size_t offset = 0, size;
+	const CinCacheHeader *header;
+	const CinRecord *record;
+	const char *strings;
+	uint32_t num, i;
+	uint32_t phone;
+	uint32_t phrase = 0;
+	int begin = num_word_data;
+	int ret = 0;
+
+	plat_mmap_set_invalid(&cache);
+	size = plat_mmap_create(&cache, path, FLAG_ATTRIBUTE_READ);
+	if (size < sizeof(CinCacheHeader))
+		goto end;
+	header = (const CinCacheHeader *)plat_mmap_set_view(&cache, &offset, &size);
+	if (!header || header->magic != CIN_CACHE_MAGIC || header->version != CIN_CACHE_VERSION ||
+			header->cin_size != cin_size || header->cin_hash != cin_hash ||
+			strncmp(header->encoding, encoding, sizeof(header->encoding)) != 0)
+		goto end;
+	num = header->num_record;
+	if (num > (size - sizeof(CinCacheHeader)) / sizeof(CinRecord) ||
+			size != sizeof(CinCacheHeader) + num * sizeof(CinRecord) + header->string_size ||
+			header->name[sizeof(header->name) - 1] != '\0')
+		goto end;
+	record = (const CinRecord *)(header + 1);
+	strings = (const char *)(record + num);
+	if (num > 0 && (header->string_size == 0 || strings[header->string_size - 1] != '\0'))
+		goto end;
+	for (i = 0; i < num; ++i) {
+		if (record[i].word >= header->string_size || record[i].index >= num)
+			goto end;
+	}
+
+	word_data = grow_array(word_data, &word_data_size, num_word_data + num, sizeof(word_data[0]));
+	for (i = 0; i < num; ++i) {
+		/* Records of the same word are adjacent and share its string. */
+		if (i == 0 || record[i].word != record[i - 1].word)
+			phrase = intern_string(strings + record[i].word);
+		phone = record[i].phone;
+		word_data[num_word_data].text.phrase = phrase;
+		word_data[num_word_data].text.phone = store_phone(&phone, 1);
+		word_data[num_word_data].index = begin + record[i].index;
+		++num_word_data;
+	}
+
+	if (IM_name && header->has_name)
+		strcpy(IM_name, header->name);
+	ret = 1;
+
+end:
+	plat_mmap_close(&cache);
+	return ret;
+}
+
+/*
+ * Write words of cin appended to word_data since begin to the cache. Failures
+ * are ignored, since the cache is only an acceleration.
+ */
+static void write_cin_cache(const char *path, uint64_t cin_size, uint64_t cin_hash,
+	const char *encoding, const char *name, int begin)
+{
+	char tmp_path[PATH_MAX];
+	CinCacheHeader *header;
+	CinRecord *record;
+	char *strings = NULL;
+	size_t strings_len = 0, strings_size = 0, len;
+	int num = num_word_data - begin;
+	int i, k, n;
+	FILE *output;
+	int ok;
+
+	header = ALC(CinCacheHeader, 1);
+	record = ALC(CinRecord, num + 1);
+	if (!header || !record)
+		goto end;
+
+	header->magic = CIN_CACHE_MAGIC;
+	header->version = CIN_CACHE_VERSION;
+	header->cin_size = cin_size;
+	header->cin_hash = cin_hash;
+	strcpy(header->encoding, encoding);
+	header->num_record = num;
+	if (name) {
+		len = strlen(name);
+		if (len >= sizeof(header->name)) {
+			fprintf(stderr, "IM name `%s' is too long to be cached.\n", name);
+			goto end;
+		}
+		header->has_name = 1;
+		memcpy(header->name, name, len + 1);
+	}
+
+	for (i = begin, k = 0; i < num_word_data; ++i, ++k) {
+		/* Words are sorted, so equal words are adjacent and stored once. */
+		if (k == 0 || word_data[i].text.phrase != word_data[i - 1].text.phrase) {
+			len = strlen(string_at(word_data[i].text.phrase)) + 1;
+			strings = grow_array(strings, &strings_size, strings_len + len, 1);
+			memcpy(strings + strings_len, string_at(word_data[i].text.phrase), len);
+			record[k].word = (uint32_t)strings_len;
+			strings_len += len;
+		}
+		else
+			record[k].word = record[k - 1].word;
+		record[k].phone = phone_at(word_data[i].text.phone)[0];
+		record[k].index = word_data[i].index - begin;
+	}
+	header->string_size = (uint32_t)strings_len;
+
+	/* Write to a temporary file first, so that no reader sees a partial cache. */
+	n = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	if (n < 0 || (size_t)n >= sizeof(tmp_path))
+		goto end;
+	output = fopen(tmp_path, "wb");
+	if (!output)
+		goto end;
+	ok = fwrite(header, sizeof(*header), 1, output) == 1 &&
+		fwrite(record, sizeof(record[0]), num, output) == (size_t)num &&
+		fwrite(strings, 1, strings_len, output) == strings_len;
+	if (fclose(output) != 0)
+		ok = 0;
+	if (ok && rename(tmp_path, path) != 0) {
+		/* rename() does not replace an existing file on Windows. */
+		remove(path);
+		ok = rename(tmp_path, path) == 0;
+	}
+	if (!ok)
+		remove(tmp_path);
+
+end:
+	free(strings);
+	free(record);
+	free(header);
+}
+
 void read_IM_cin(const char *filename, char *IM_name, EncFunct encode)
 {
 	FILE *phone_cin;
 	char buf[MAX_LINE_LEN];
+	char name[MAX_LINE_LEN];
+	char cache_path[PATH_MAX];
+	const char *encoding;
+	uint64_t cin_size = 0, cin_hash = 0;
+	int has_name = 0;
+	int cached;
+	int begin = num_word_data;
 	char *ret;
 	int line_num = 0;
 	enum{INIT, HAS_CHARDEF_BEGIN, HAS_CHARDEF_END} status;
 
 	assert( encode );
 
+	encoding = encoding_name(encode);
+	cached = encoding && cin_cache_path(filename, cache_path, sizeof(cache_path)) &&
+		hash_file(filename, &cin_size, &cin_hash);
+	if (cached && read_cin_cache(cache_path, cin_size, cin_hash, encoding, IM_name))
+		return;
+
 	phone_cin = fopen(filename, "r");
 	if (!phone_cin) {
 		fprintf(stderr, "Error opening the file %s\n", filename);
@@ -163,9 +533,10 @@ void read_IM_cin(const char *filename, char *IM_name, EncFunct encode)
 		if( buf[0]=='%') {
 			ret = strtok(buf, " \t");
 			if(!strcmp(ret, ENAME)) {
-				if( IM_name ) {
-					ret = strtok(NULL, " \t");
-					if(ret) strcpy(IM_name, ret);
+				ret = strtok(NULL, " \t");
+				if(ret) {
+					strcpy(name, ret);
+					has_name = 1;
 				}
 			}
 			else if(!strcmp(ret, CHARDEF)) {
@@ -199,109 +570,182 @@ void read_IM_cin(const char *filename, char *IM_name, EncFunct encode)
 	}
 	fclose(phone_cin);
 
-	qsort(word_data, num_word_data, sizeof(word_data[0]), compare_word_by_text);
+	if (IM_name && has_name)
+		strcpy(IM_name, name);
+	qsort(word_data + begin, num_word_data - begin, sizeof(word_data[0]), compare_word_by_text);
+	if (cached)
+		write_cin_cache(cache_path, cin_size, cin_hash, encoding, has_name ? name : NULL, begin);
 }
 
-static NODE *new_node( uint32_t key )
+WordData *find_word(WordData *words, int num_words, const char *word)
 {
-	NODE *pnew = ALC(NODE, 1);
-
-	if(pnew == NULL){
-		fprintf(stderr, "Memory allocation failed on constructing phrase tree.\n");
-		exit(-1);
+	int low = 0, high = num_words, mid;
+
+	/* Binary search for the lower bound, which is the first match if any. */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (strcmp(string_at(words[mid].text.phrase), word) < 0)
+			low = mid + 1;
+		else
+			high = mid;
 	}
-
-	memset(&pnew->data, 0, sizeof(pnew->data));
-	pnew->data.key = key;
-	pnew->pFirstChild = NULL;
-	pnew->pNextSibling=NULL;
-	return pnew;
+	if (low < num_words && strcmp(string_at(words[low].text.phrase), word) == 0)
+		return &words[low];
+	return NULL;
 }
 
 /*
- * This function puts FindKey() and Insert() together. It first searches for the
- * specified key and performs FindKey() on hit. Otherwise, it inserts a new node
- * at proper position and returns the newly inserted child.
+ * Words keep their order in cin. Phrases are ordered by descending frequency,
+ * and the later one goes first for equal frequency. Both never share the same
+ * phone sequence since words have exactly one phone and phrases have more.
  */
-static NODE *find_or_insert(NODE *parent, uint32_t key)
+static int compare_entry(const void *x, const void *y)
 {
-	NODE *prev=NULL, *p, *pnew;
-
-	for(p=parent->pFirstChild; p!=NULL && p->data.key <= key; prev = p, p = p->pNextSibling)
-		if(p->data.key == key) return p;
-	pnew = new_node( key );
-	pnew->pNextSibling = p;
-	if(prev == NULL)
-		parent->pFirstChild = pnew;
-	else
-		prev->pNextSibling = pnew;
-	pnew->pNextSibling = p;
-	return pnew;
+	const TreeEntry *a = (const TreeEntry *)x;
+	const TreeEntry *b = (const TreeEntry *)y;
+	int i;
+
+	for (i = 0; a->phone[i] != 0 && a->phone[i] == b->phone[i]; ++i)
+		;
+	if (a->phone[i] != b->phone[i])
+		return a->phone[i] > b->phone[i] ? 1 : -1;
+
+	if (a->len > 1 && a->freq != b->freq)
+		return b->freq > a->freq ? 1 : -1;
+	return a->order - b->order;
 }
 
-static void insert_leaf(NODE *parent, long phr_pos, int freq)
+/* This function collects word_data and phrase_data as sorted entries. */
+static TreeEntry *collect_entries(int *num_entry)
 {
-	NODE *prev=NULL, *p, *pnew;
-
-	for(p=parent->pFirstChild; p!=NULL && p->data.key == 0; prev = p, p = p->pNextSibling)
-		if(p->data.phrase.freq <= freq) break;
-
-	pnew = new_node(0);
-	pnew->data.phrase.pos = (uint32_t)phr_pos;
-	pnew->data.phrase.freq = freq;
-	if(prev == NULL)
-		parent->pFirstChild = pnew;
-	else
-		prev->pNextSibling = pnew;
-	pnew->pNextSibling = p;
+	TreeEntry *entry;
+	int i, j, n = 0;
+
+	entry = ALC(TreeEntry, num_word_data + num_phrase_data + 1);
+	if (!entry) {
+		fprintf(stderr, "Memory allocation failed on constructing phrase tree.\n");
+		exit(-1);
+	}
+
+	for (i = 0; i < num_word_data; ++i, ++n) {
+		entry[n].phone = phone_at(word_data[i].text.phone);
+		entry[n].pos = (uint32_t)word_data[i].text.pos;
+		entry[n].freq = word_data[i].text.freq;
+		entry[n].order = word_data[i].index;
+	}
+	for (i = 0; i < num_phrase_data; ++i, ++n) {
+		entry[n].phone = phone_at(phrase_data[i].phone);
+		entry[n].pos = (uint32_t)phrase_data[i].pos;
+		entry[n].freq = phrase_data[i].freq;
+		entry[n].order = num_phrase_data - i;
+	}
+	for (i = 0; i < n; ++i)
+		for (entry[i].len = 0; entry[i].phone[entry[i].len] != 0; ++entry[i].len)
+			;
+
+	qsort(entry, n, sizeof(entry[0]), compare_entry);
+
+	for (i = 0; i < n; ++i) {
+		for (j = 0; i > 0 && j < entry[i].len && entry[i].phone[j] == entry[i-1].phone[j]; ++j)
+			;
+		entry[i].lcp = j;
+	}
+
+	*num_entry = n;
+	return entry;
 }
 
-static void construct_phrase_tree()
+/* Leaves are ordered by descending frequency, then by position. */
+static int compare_leaf_by_freq(const void *x, const void *y)
 {
-	NODE *levelPtr;
-	int i, j;
+	const TreeType *a = *(const TreeType * const *)x;
+	const TreeType *b = *(const TreeType * const *)y;
 
-	/* First, assume that words are in order of their phones and indices. */
-	qsort(word_data, num_word_data, sizeof(word_data[0]), compare_word_by_phone);
+	if (a->phrase.freq != b->phrase.freq)
+		return b->phrase.freq > a->phrase.freq ? 1 : -1;
+	if (a->phrase.pos != b->phrase.pos)
+		return a->phrase.pos > b->phrase.pos ? 1 : -1;
+	return 0;
+}
 
-	/* Key value of root will become tree_size later. */
-	root = new_node( 1 );
+/*
+ * This function collects the most frequent distinct phrases below each node.
+ * Children are stored after their parent in BFS order, so nodes are visited
+ * backward and every child list is ready when its parent merges them. A phrase
+ * in the top list of a node must also be in the top list of the child holding
+ * it, hence merging truncated child lists is exact.
+ */
+static void write_predict_section(const TreeType *tree, int tree_size, FILE *output)
+{
+	const TreeType **cand;
+	int32_t *predict, *offset, *leaf;
+	int *num_predict;
+	int i, j, k, c, num_cand, max_cand = 0;
+
+	predict = ALC(int32_t, (size_t)tree_size * MAX_PREDICT_NUM);
+	num_predict = ALC(int, tree_size);
+	offset = ALC(int32_t, tree_size + 1);
+	if (!predict || !num_predict || !offset) {
+		fprintf(stderr, "Memory allocation failed on constructing prediction.\n");
+		exit(-1);
+	}
 
-	/* Second, insert word_data as the first level of children. */
-	for(i = 0; i < num_word_data; i++) {
-		if(i == 0 || word_data[i].text.phone[0] != word_data[i-1].text.phone[0]) {
-			levelPtr = new_node(word_data[i].text.phone[0]);
-			levelPtr->pNextSibling = root->pFirstChild;
-			root->pFirstChild = levelPtr;
+	for (i = 0; i < tree_size; i++)
+		if (tree[i].key != 0 && tree[i].child.end - tree[i].child.begin > max_cand)
+			max_cand = tree[i].child.end - tree[i].child.begin;
+	cand = ALC(const TreeType*, (size_t)max_cand * MAX_PREDICT_NUM + 1);
+	assert(cand);
+
+	for (i = tree_size - 1; i >= 0; i--) {
+		num_predict[i] = 0;
+		if (tree[i].key == 0)
+			continue;
+
+		num_cand = 0;
+		for (c = tree[i].child.begin; c < tree[i].child.end; c++) {
+			if (tree[c].key == 0)
+				cand[num_cand++] = &tree[c];
+			else
+				for (j = 0; j < num_predict[c]; j++)
+					cand[num_cand++] = &tree[predict[(size_t)c * MAX_PREDICT_NUM + j]];
 		}
-		levelPtr = new_node( 0 );
-		levelPtr->data.phrase.pos = (uint32_t)word_data[i].text.pos;
-		levelPtr->data.phrase.freq = word_data[i].text.freq;
-		levelPtr->pNextSibling = root->pFirstChild->pFirstChild;
-		root->pFirstChild->pFirstChild = levelPtr;
-	}
+		qsort(cand, num_cand, sizeof(cand[0]), compare_leaf_by_freq);
 
-	/* Third, insert phrases having length at least 2. */
-	for(i = 0; i < num_phrase_data; ++i)
-	{
-		levelPtr=root;
-		for(j=0; phrase_data[i].phone[j]!=0; ++j)
-			levelPtr=find_or_insert(levelPtr, phrase_data[i].phone[j]);
-		insert_leaf(levelPtr, phrase_data[i].pos, phrase_data[i].freq);
+		leaf = &predict[(size_t)i * MAX_PREDICT_NUM];
+		for (j = 0; j < num_cand && num_predict[i] < MAX_PREDICT_NUM; j++) {
+			for (k = 0; k < num_predict[i]; k++)
+				if (tree[leaf[k]].phrase.pos == cand[j]->phrase.pos)
+					break;
+			if (k == num_predict[i])
+				leaf[num_predict[i]++] = cand[j] - tree;
+		}
 	}
+
+	offset[0] = 0;
+	for (i = 0; i < tree_size; i++)
+		offset[i + 1] = offset[i] + num_predict[i];
+	fwrite(offset, sizeof(int32_t), tree_size + 1, output);
+	for (i = 0; i < tree_size; i++)
+		fwrite(&predict[(size_t)i * MAX_PREDICT_NUM], sizeof(int32_t), num_predict[i], output);
+
+	free(cand);
+	free(offset);
+	free(num_predict);
+	free(predict);
 }
 
 /*
- * This function performs BFS to compute child.begin and child.end of each node.
- * It sponteneously converts tree structure into a linked list. Writing the tree
- * into index file is then implemented by pure sequential traversal.
+ * This function lays out the tree in BFS order directly from sorted entries.
+ * The tree array itself serves as the queue. Until a node is dequeued, its
+ * child.begin and child.end keep its range of entries, which are replaced by
+ * the positions of its children once they are appended.
  */
 void write_index_tree(const char *filename)
 {
-	/* (Circular) queue implementation is hidden within this function. */
-	NODE **queue, *p, *pNext;
-	int head=0, tail=0, tree_size=1;
-	size_t q_len = num_word_data + num_phrase_data;
+	TreeEntry *entry;
+	TreeType *tree;
+	int num_entry, tree_size, size, level_end, depth;
+	int i, p, begin, end;
 	assert( filename );
 	FILE *output = fopen(filename, "wb");
 
@@ -310,48 +754,135 @@ void write_index_tree(const char *filename)
 		exit( 1 );
 	}
 
-	construct_phrase_tree();
-
-	queue = ALC(NODE*, q_len+1);
-	assert( queue );
-
-	queue[head++]=root;
-	while(head!=tail){
-		p = queue[tail++];
-		if(tail >= q_len) tail = 0;
-		if(p->data.key != 0) {
-			p->data.child.begin = tree_size;
-
-			/*
-			 * The latest inserted element must have a NULL
-			 * pNextSibling value, and the following code let
-			 * it point to the next child list to serialize
-			 * them.
-			 */
-			if(head == 0)
-				queue[q_len-1]->pNextSibling = p->pFirstChild;
-			else
-				queue[head-1]->pNextSibling = p->pFirstChild;
+	entry = collect_entries(&num_entry);
 
-			for(pNext=p->pFirstChild; pNext!=NULL; pNext=pNext->pNextSibling)
-			{
-				queue[head++]=pNext;
-				if(head == q_len) head = 0;
-				tree_size++;
-			}
+	/* Every entry brings its leaf and the nodes not shared with the previous one. */
+	tree_size = 1;
+	for (i = 0; i < num_entry; ++i)
+		tree_size += 1 + entry[i].len - entry[i].lcp;
 
-			p->data.child.end = tree_size;
-		}
+	tree = ALC(TreeType, tree_size);
+	if (!tree) {
+		fprintf(stderr, "Memory allocation failed on constructing phrase tree.\n");
+		exit(-1);
 	}
-	root->data.key = tree_size;
 
-	for(p=root; p!=NULL; p=pNext)
-	{
-		fwrite(&p->data, sizeof(TreeType), 1, output);
-		pNext = p->pNextSibling;
-		free(p);
+	/* Key value of root is tree_size. */
+	tree[0].key = tree_size;
+	tree[0].child.begin = 0;
+	tree[0].child.end = num_entry;
+	size = 1;
+	level_end = 1;
+	depth = 0;
+	for (p = 0; p < size; ++p) {
+		if (p == level_end) {
+			++depth;
+			level_end = size;
+		}
+		if (tree[p].key == 0)
+			continue;
+
+		begin = tree[p].child.begin;
+		end = tree[p].child.end;
+		tree[p].child.begin = size;
+		for (i = begin; i < end && entry[i].len == depth; ++i, ++size) {
+			tree[size].key = 0;
+			tree[size].phrase.pos = entry[i].pos;
+			tree[size].phrase.freq = entry[i].freq;
+		}
+		while (i < end) {
+			tree[size].key = entry[i].phone[depth];
+			tree[size].child.begin = i;
+			for (++i; i < end && entry[i].lcp > depth; ++i)
+				;
+			tree[size].child.end = i;
+			++size;
+		}
+		tree[p].child.end = size;
 	}
-	free(queue);
+	assert(size == tree_size);
+	free(entry);
+
+	fwrite(tree, sizeof(TreeType), tree_size, output);
+	write_predict_section(tree, tree_size, output);
+	free(tree);
 
 	fclose( output );
 }
+
+int open_dict_file(DictFile *dict, const char *filename)
+{
+	char path[PATH_MAX];
+	size_t offset;
+	uint32_t num_shard;
+	int i;
+
+	memset(dict, 0, sizeof(*dict));
+	for (i = 0; i < DICT_MAX_SHARD; ++i)
+		plat_mmap_set_invalid(&dict->map[i]);
+
+	dict->num_shard = 1;
+	for (i = 0; i < dict->num_shard; ++i) {
+		if (i == 0)
+			snprintf(path, sizeof(path), "%s", filename);
+		else
+			snprintf(path, sizeof(path), "%s.%d", filename, i);
+		offset = 0;
+		dict->size[i] = plat_mmap_create(&dict->map[i], path, FLAG_ATTRIBUTE_READ);
+		if (dict->size[i] == 0)
+			goto error;
+		dict->shard[i] = (const char *)plat_mmap_set_view(&dict->map[i], &offset, &dict->size[i]);
+		if (!dict->shard[i])
+			goto error;
+
+		if (i == 0 && dict->size[0] >= DICT_SHARD_HEADER_SIZE &&
+				memcmp(dict->shard[0], DICT_SHARD_MAGIC, DICT_SHARD_MAGIC_LEN) == 0) {
+			memcpy(&num_shard, dict->shard[0] + DICT_SHARD_MAGIC_LEN, sizeof(num_shard));
+			if (num_shard < 1 || num_shard > DICT_MAX_SHARD)
+				goto error;
+			dict->num_shard = num_shard;
+			dict->sharded = 1;
+		}
+		if (dict->sharded && dict->size[i] > DICT_SHARD_SIZE)
+			goto error;
+	}
+	return 0;
+
+error:
+	close_dict_file(dict);
+	return -1;
+}
+
+size_t dict_shard_begin(const DictFile *dict, int shard)
+{
+	return dict->sharded && shard == 0 ? DICT_SHARD_HEADER_SIZE : 0;
+}
+
+uint32_t dict_pos(const DictFile *dict, int shard, size_t offset)
+{
+	return dict->sharded ? DictShardPos(shard, offset) : (uint32_t)offset;
+}
+
+const char *dict_phrase_at(const DictFile *dict, uint32_t pos)
+{
+	uint32_t shard = 0, offset = pos;
+
+	if (dict->sharded) {
+		shard = DictShardOf(pos);
+		offset = DictShardOffset(pos);
+	}
+	if (shard >= (uint32_t)dict->num_shard || offset < dict_shard_begin(dict, shard) ||
+			offset >= dict->size[shard] ||
+			!memchr(dict->shard[shard] + offset, '\0', dict->size[shard] - offset))
+		return NULL;
+	return dict->shard[shard] + offset;
+}
+
+void close_dict_file(DictFile *dict)
+{
+	int i;
+
+	for (i = 0; i < DICT_MAX_SHARD; ++i)
+		plat_mmap_close(&dict->map[i]);
+	dict->num_shard = 0;
+}
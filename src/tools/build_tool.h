@@ -5,33 +5,108 @@
 #include "chewing-utf8-util.h"
 #include "global-private.h"
 #include "key2pho-private.h"
+#include "plat_mmap.h"
 #include "zuin-private.h"
 
 #define MAX_LINE_LEN        (1024)
-#define MAX_WORD_DATA      (60000)
-#define MAX_PHRASE_BUF_LEN      (149)
-#define MAX_PHRASE_DATA  (420000)
 
-/* An additional pos helps avoid duplicate Chinese strings. */
+/*
+ * Strings and phone sequences are kept in growable pools and referenced by
+ * offsets, so that entries stay small and remain valid when pools grow. Equal
+ * strings are interned to the same offset.
+ */
 typedef struct {
-	char phrase[MAX_PHRASE_BUF_LEN];
+	uint32_t phrase; /* Offset of the phrase, see string_at(). */
 	int freq;
-	uint32_t phone[MAX_PHRASE_LEN + 1];
-	long pos;
+	uint32_t phone; /* Offset of the phone sequence ended by 0, see phone_at(). */
+	long pos; /* An additional pos helps avoid duplicate Chinese strings. */
 } PhraseData;
 typedef struct {
-	PhraseData text; // Common part shared with PhraseData. */
+	PhraseData text; /* Common part shared with PhraseData. */
 	int index; /* For stable sorting. */
 } WordData;
 
 typedef uint32_t (*EncFunct)( const char* );
 
-extern WordData word_data[MAX_WORD_DATA];
+/*
+ * A system dictionary written by init_database, either a single file or
+ * shards described by DICT_SHARD_MAGIC, with all of its files mapped.
+ */
+typedef struct {
+	plat_mmap map[DICT_MAX_SHARD];
+	const char *shard[DICT_MAX_SHARD];
+	size_t size[DICT_MAX_SHARD];
+	int num_shard;
+	int sharded;
+} DictFile;
+
+extern WordData *word_data;
 extern int num_word_data;
 
-extern PhraseData phrase_data[MAX_PHRASE_DATA];
+extern PhraseData *phrase_data;
 extern int num_phrase_data;
 
+/**
+ * @brief Make room for at least need elements in a growable array.
+ * @param array     The array, can be NULL when empty.
+ * @param size      Number of allocated elements, updated on growth.
+ * @param need      Number of elements required.
+ * @param elem_size Size of an element.
+ * @retval The array, maybe moved. Grown elements are zeroed.
+ */
+void *grow_array(void *array, size_t *size, size_t need, size_t elem_size);
+
+/**
+ * @brief Store a string once and return its offset. Equal strings share it.
+ * @param str The string to be stored.
+ */
+uint32_t intern_string(const char *str);
+
+/**
+ * @brief The string stored at the given offset.
+ * @param offset Offset returned by intern_string().
+ */
+const char *string_at(uint32_t offset);
+
+/**
+ * @brief Store a phone sequence followed by 0 and return its offset.
+ * @param phone The phone sequence.
+ * @param len   Number of phones.
+ */
+uint32_t store_phone(const uint32_t *phone, int len);
+
+/**
+ * @brief The phone sequence stored at the given offset.
+ * @param offset Offset returned by store_phone().
+ * @retval Pointer valid until the next store_phone() call.
+ */
+const uint32_t *phone_at(uint32_t offset);
+
+/**
+ * @brief Append a zeroed entry to phrase_data.
+ * @retval The new entry, valid until the next call.
+ */
+PhraseData *append_phrase_data(void);
+
+/**
+ * @brief Empty phrase_data. Stored strings and phone sequences are kept.
+ */
+void clear_phrase_data(void);
+
+/**
+ * @brief Move words out of word_data, leaving it empty for the next cin.
+ * @param data Receives the words, which the caller owns.
+ * @param num  Receives the number of words.
+ */
+void detach_word_data(WordData **data, int *num);
+
+/**
+ * @brief Make the given words word_data again, which takes the ownership.
+ * @param data Words returned by detach_word_data().
+ * @param num  Number of words.
+ */
+void attach_word_data(WordData *data, int num);
+
 /**
  * @brief Strip reading whitespace and trailing comment / whitespace.
  * @param line A buffer containing the line.
@@ -46,6 +121,10 @@ int compare_word_by_text( const void *x, const void *y );
 
 /**
  * @brief IM cin reader. Note that word_data is sorted by strcmp after the call.
+ *
+ * The parsed cin is cached as <basename of cin>.cache in the working directory,
+ * which is used instead of the cin as long as the content of cin and the
+ * encoder are the same.
  * @param filename The path of cin file.
  * @param IM_name  Buffer for name of the IM, can be NULL.
  * @param encode   The way encoding keyin sequence into uint32_t, non-NULL.
@@ -53,9 +132,50 @@ int compare_word_by_text( const void *x, const void *y );
 void read_IM_cin(const char *filename, char *IM_name, EncFunct encode);
 
 /**
- * @brief Index tree writer.
+ * @brief Find the first of words equal to the given one in words sorted by text.
+ * @param words     Words sorted by compare_word_by_text(), such as word_data.
+ * @param num_words Number of words.
+ * @param word      A word of one character.
+ * @retval The first match, followed by other matches in words. NULL if not found.
+ */
+WordData *find_word(WordData *words, int num_words, const char *word);
+
+/**
+ * @brief Index tree writer. Top phrases below each node are appended for prediction.
  * @param filename Path for output file.
  */
 void write_index_tree( const char *filename );
 
+/**
+ * @brief Map a system dictionary and its shards if any.
+ * @param dict     Receives the mapped dictionary.
+ * @param filename Path of the dictionary, shards are filename.n.
+ * @retval 0 on success, -1 if a file cannot be mapped or the header is broken.
+ */
+int open_dict_file(DictFile *dict, const char *filename);
+
+/**
+ * @brief Offset of the first phrase in a shard, which follows the header in shard 0.
+ */
+size_t dict_shard_begin(const DictFile *dict, int shard);
+
+/**
+ * @brief Position of a phrase as stored in index trees.
+ * @param dict   The dictionary.
+ * @param shard  Shard of the phrase, 0 for a single file.
+ * @param offset Offset of the phrase in the shard.
+ */
+uint32_t dict_pos(const DictFile *dict, int shard, size_t offset);
+
+/**
+ * @brief Phrase at a position stored in index trees.
+ * @retval The phrase. NULL if the position is out of the dictionary.
+ */
+const char *dict_phrase_at(const DictFile *dict, uint32_t pos);
+
+/**
+ * @brief Unmap a dictionary mapped by open_dict_file().
+ */
+void close_dict_file(DictFile *dict);
+
 #endif
@@ -11,13 +11,15 @@
 /**
  * @file gen_IM_data.c
  *
- * @brief Generation of index tree for given non-zhuin IM.\n
+ * @brief Generation of index tree for given non-zhuin IMs.\n
  *
- *      This program reads in an IM definition cin file.\n
- *      Output a database file containing a key-in index tree.\n
+ *      This program reads in one or more IM definition cin files.\n
+ *      Output a database file containing a key-in index tree for each IM,\n
+ * where the system dictionary is scanned once for all of them.\n
  *      For details of structure, see init_database.c
  */
 
+#include <assert.h>
 #include <dirent.h> /* For chdir(). */
 #include <libgen.h> /* For basename(). */
 #include <stdio.h>
@@ -25,72 +27,277 @@
 #include <string.h>
 
 #include "build_tool.h"
+#include "plat_thread.h"
 #include "private.h"
 
 #define CIN_EXTENSION ".cin"
 
+/* Number of phrases in a chunk of dictionary, which a thread takes at once. */
+#define PHRASES_PER_CHUNK (4096)
+
 /* Setting flag for warnings. */
 static int show_warning = 0;
 
+/* Number of threads enumerating keyin sequences, 0 for number of processors. */
+static int num_thread = 0;
+
+/* Maximum number of keyin sequences of a phrase, 0 for no limit. */
+static int max_keyin = 0;
+
+/* A keyin sequence of a phrase, whose phones are in the phone buffer. */
+typedef struct {
+	long pos;
+	int32_t freq;
+	size_t phone;
+} KeyinData;
+
+/* Keyin sequences enumerated for an IM. */
+typedef struct {
+	KeyinData *keyin;
+	size_t num_keyin, keyin_size;
+	uint32_t *phone;
+	size_t num_phone, phone_size;
+} KeyinBuffer;
+
+/*
+ * A combination of codes of words in a phrase, where rank[i] is the rank of
+ * the code chosen for the i-th word. Only ranks from position last on are
+ * increased to reach other combinations, so every combination is reached once.
+ */
+typedef struct {
+	int cost;
+	int last;
+	int rank[MAX_PHRASE_LEN];
+} KeyinCombination;
+
+/* An IM defined by a cin file, which keeps its own words. */
+typedef struct {
+	char name[PATH_MAX];
+	WordData *word_data;
+	int num_word_data;
+} InputMethod;
+
+/*
+ * A range of phrases in dictionary. Threads enumerate keyin sequences of a
+ * chunk into its own buffers, one for each IM, and chunks are merged into
+ * phrase_data in their order afterward. The result is thus the same for any
+ * number of threads.
+ */
+typedef struct {
+	const char *begin, *end; /* Chunks do not cross shards of dictionary. */
+	uint32_t pos; /* Position of the first phrase in index trees. */
+	const int32_t *freq; /* Total frequency of the first phrase in the chunk. */
+	KeyinBuffer *buffer;
+} Chunk;
+
+typedef struct {
+	InputMethod *im;
+	int num_im;
+	Chunk *chunk;
+	int num_chunk;
+	int next;
+} ChunkQueue;
+
 /**
  * @brief Scan and configuration by arguments.
- * @retval Index to the path of cin file. On failure, it returns -1.
+ * @param cin_path_id Receives indices to the paths of cin files, at most argc.
+ * @retval Number of cin files.
  */
-int scan_arguments( int argc, char* argv[] )
+int scan_arguments( int argc, char* argv[], int cin_path_id[] )
 {
-	int cin_path_id = -1, i;
+	int num_cin = 0, i;
 	size_t l;
 
 	for(i = 1; i < argc; i++) {
 		l = strlen( argv[i] );
 		if( !strcmp( argv[i], "-w") || !strcmp( argv[i], "--show-warning") )
 			show_warning = 1;
-		else if( l>4 && !strcmp( &argv[i][l-4], CIN_EXTENSION ) ) {
-			if( cin_path_id < 0 ) cin_path_id = i;
-			else {
-				fprintf(stderr, "%s: Multiple cin specifications, stop.\n", argv[0]);
+		else if( !strcmp( argv[i], "-j") && i + 1 < argc ) {
+			num_thread = atoi( argv[++i] );
+			if( num_thread < 1 ) {
+				fprintf(stderr, "%s: Invalid number of threads `%s', stop.\n", argv[0], argv[i]);
 				exit(-1);
 			}
 		}
+		else if( (!strcmp( argv[i], "-n") || !strcmp( argv[i], "--max-keyin")) && i + 1 < argc ) {
+			max_keyin = atoi( argv[++i] );
+			if( max_keyin < 1 ) {
+				fprintf(stderr, "%s: Invalid number of keyin sequences `%s', stop.\n", argv[0], argv[i]);
+				exit(-1);
+			}
+		}
+		else if( l>4 && !strcmp( &argv[i][l-4], CIN_EXTENSION ) )
+			cin_path_id[num_cin++] = i;
 		else {
 			fprintf(stderr, "%s: Unrecognized option `%s', stop.\n", argv[0], argv[i]);
 			exit(-1);
 		}
 	}
 
-	return cin_path_id;
+	return num_cin;
 }
 
-/* Compare words by string only. */
-int compare_word_by_str(const void *x, const void *y)
+/* Append a keyin sequence of the given width to the buffer. */
+static void append_keyin(KeyinBuffer *buffer, const uint32_t keyin_buf[], int width)
 {
-	return strcmp( ((const WordData*)x)->text.phrase, ((const WordData*)y)->text.phrase);
+	buffer->keyin = grow_array(buffer->keyin, &buffer->keyin_size, buffer->num_keyin + 1, sizeof(KeyinData));
+	buffer->phone = grow_array(buffer->phone, &buffer->phone_size, buffer->num_phone + width + 1, sizeof(uint32_t));
+	buffer->keyin[buffer->num_keyin++].phone = buffer->num_phone;
+	memcpy(&buffer->phone[buffer->num_phone], keyin_buf, width * sizeof(uint32_t));
+	buffer->phone[buffer->num_phone + width] = 0;
+	buffer->num_phone += width + 1;
 }
 
 /**
- * Find all probabilities of keyin sequences using given range in word_data for
- * each word. Note that width refers to the n-th enumerated word. The recursion
+ * Find all probabilities of keyin sequences using given range in words of the IM
+ * for each word. Note that width refers to the n-th enumerated word. The recursion
  * stops when the end of phrase is reached, whose interval has the same value in
  * "from" and "to" fields.
  */
-void find_keyin_sequence(const IntervalType range[], uint32_t keyin_buf[], int width)
+void find_keyin_sequence(const InputMethod *im, KeyinBuffer *buffer, const IntervalType range[], uint32_t keyin_buf[], int width)
 {
 	if( range[width].from < range[width].to) {
 		int i;
 
 		for(i = range[width].from; i < range[width].to; i++) {
-			keyin_buf[width] = word_data[i].text.phone[0];
-			find_keyin_sequence(range, keyin_buf, width+1);
+			keyin_buf[width] = phone_at(im->word_data[i].text.phone)[0];
+			find_keyin_sequence(im, buffer, range, keyin_buf, width+1);
 		}
 		keyin_buf[width] = 0;
 	}
 	/* A keyin sequence is determined when end of string is found. */
 	else {
 		if( width == 0 ) return;
-		memcpy(phrase_data[num_phrase_data].phone, keyin_buf,
-			sizeof(phrase_data[num_phrase_data].phone));
-		++num_phrase_data;
+		append_keyin(buffer, keyin_buf, width);
+	}
+}
+
+/*
+ * Combinations are ordered by cost, then by the order in which
+ * find_keyin_sequence() enumerates them, i.e. by word positions in ranges.
+ */
+static int compare_combination(const KeyinCombination *a, const KeyinCombination *b,
+	int * const by_rank[], int len)
+{
+	int i;
+
+	if (a->cost != b->cost)
+		return a->cost - b->cost;
+	for (i = 0; i < len; i++)
+		if (by_rank[i][a->rank[i]] != by_rank[i][b->rank[i]])
+			return by_rank[i][a->rank[i]] - by_rank[i][b->rank[i]];
+	return 0;
+}
+
+static void push_combination(KeyinCombination heap[], int *num_heap, const KeyinCombination *comb,
+	int * const by_rank[], int len)
+{
+	int i = (*num_heap)++, parent;
+
+	for (; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (compare_combination(&heap[parent], comb, by_rank, len) <= 0)
+			break;
+		heap[i] = heap[parent];
+	}
+	heap[i] = *comb;
+}
+
+static void pop_combination(KeyinCombination heap[], int *num_heap, int * const by_rank[], int len)
+{
+	KeyinCombination last = heap[--(*num_heap)];
+	int i = 0, child;
+
+	for (; (child = 2 * i + 1) < *num_heap; i = child) {
+		if (child + 1 < *num_heap && compare_combination(&heap[child + 1], &heap[child], by_rank, len) < 0)
+			child++;
+		if (compare_combination(&last, &heap[child], by_rank, len) <= 0)
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = last;
+}
+
+/* Kept combinations hold word positions in rank, and unused ranks are 0. */
+static int compare_kept_combination(const void *x, const void *y)
+{
+	const KeyinCombination *a = (const KeyinCombination *) x;
+	const KeyinCombination *b = (const KeyinCombination *) y;
+	int i;
+
+	for (i = 0; i < MAX_PHRASE_LEN; i++)
+		if (a->rank[i] != b->rank[i])
+			return a->rank[i] - b->rank[i];
+	return 0;
+}
+
+/*
+ * Keep only max_keyin keyin sequences of a phrase, whose codes have the least
+ * total rank. The rank of a code is its order among codes of the same word in
+ * cin, as cin files list the usual code of a word first. Combinations are
+ * visited from the cheapest by a binary heap, where each visited combination
+ * adds those having one rank increased by one. Kept sequences are appended in
+ * the order find_keyin_sequence() would use.
+ */
+static void find_top_keyin_sequence(const InputMethod *im, KeyinBuffer *buffer, const IntervalType range[], int len)
+{
+	int *by_rank[MAX_PHRASE_LEN];
+	int *words;
+	KeyinCombination *heap, *kept, next;
+	uint32_t keyin_buf[MAX_PHRASE_LEN + 1];
+	int num_heap, num_kept = 0, total = 0;
+	int i, j, r;
+
+	for (i = 0; i < len; i++)
+		total += range[i].to - range[i].from;
+	words = ALC(int, total);
+	heap = ALC(KeyinCombination, (size_t)max_keyin * len + 1);
+	kept = ALC(KeyinCombination, max_keyin);
+	if (!words || !heap || !kept) {
+		fprintf(stderr, "Memory allocation failed on enumerating keyin sequences.\n");
+		exit(-1);
+	}
+
+	/* by_rank[i][r] is the word of rank r at position i, sorted by insertion. */
+	for (i = 0, total = 0; i < len; total += range[i].to - range[i].from, i++) {
+		by_rank[i] = words + total;
+		for (j = range[i].from; j < range[i].to; j++) {
+			for (r = j - range[i].from; r > 0 && im->word_data[by_rank[i][r - 1]].index > im->word_data[j].index; r--)
+				by_rank[i][r] = by_rank[i][r - 1];
+			by_rank[i][r] = j;
+		}
 	}
+
+	/* Each visited combination adds at most len ones, which bounds the heap. */
+	memset(heap, 0, sizeof(heap[0]));
+	num_heap = 1;
+	while (num_heap > 0 && num_kept < max_keyin) {
+		kept[num_kept] = heap[0];
+		pop_combination(heap, &num_heap, by_rank, len);
+		for (i = kept[num_kept].last; i < len; i++) {
+			if (kept[num_kept].rank[i] + 1 >= range[i].to - range[i].from)
+				continue;
+			next = kept[num_kept];
+			next.rank[i]++;
+			next.cost++;
+			next.last = i;
+			push_combination(heap, &num_heap, &next, by_rank, len);
+		}
+		for (i = 0; i < len; i++)
+			kept[num_kept].rank[i] = by_rank[i][kept[num_kept].rank[i]];
+		num_kept++;
+	}
+
+	qsort(kept, num_kept, sizeof(kept[0]), compare_kept_combination);
+	for (j = 0; j < num_kept; j++) {
+		for (i = 0; i < len; i++)
+			keyin_buf[i] = phone_at(im->word_data[kept[j].rank[i]].text.phone)[0];
+		append_keyin(buffer, keyin_buf, len);
+	}
+
+	free(kept);
+	free(heap);
+	free(words);
 }
 
 /**
@@ -98,35 +305,36 @@ void find_keyin_sequence(const IntervalType range[], uint32_t keyin_buf[], int w
  * each word.  Considering that there may be many keyin methods for a word,
  * IntervalType is used to handle this circumstance. The return value indicates
  * position of '\0', satisfying the least access to the mmap for dictionary.
+ * Keyin sequences of the IM are appended to the given buffer.
  */
-const char *enumerate_keyin_sequence(const char *phrase, long phr_pos, int32_t total_freq)
+const char *enumerate_keyin_sequence(InputMethod *im, KeyinBuffer *buffer, const char *phrase, long phr_pos, int32_t total_freq)
 {
 	IntervalType range[MAX_PHRASE_LEN + 1] = {0};
 	uint32_t keyin_buf[MAX_PHRASE_LEN + 1] = {0};
+	char word[MAX_LINE_LEN];
 	const char *p = phrase;
-	WordData tmpWord, *q, *r;
-	int old_num_phrase_data = num_phrase_data, b, i;
+	WordData *q, *r;
+	size_t old_num_keyin = buffer->num_keyin, k, num;
+	int b, i, len;
 
 	/* Null phrases are rejected. */
 	if( *p == '\0') return p;
 
-	/* Set up range of each word in word_data. */
+	/* Set up range of each word in words of the IM. */
 	for(i = 0; *p; i++) {
 		b = ueBytesFromChar(*p);
-		memcpy(tmpWord.text.phrase, p, b);
-		tmpWord.text.phrase[b] = '\0';
-		q = (WordData*)bsearch(&tmpWord, word_data, num_word_data,
-			sizeof(tmpWord), compare_word_by_str);
+		memcpy(word, p, b);
+		word[b] = '\0';
+		q = find_word(im->word_data, im->num_word_data, word);
 		if( q ) {
-			for (r = q - 1; r >= word_data && !strcmp(r->text.phrase, q->text.phrase); r--);
-			range[i].from = (r - word_data) + 1;
-			for (r = q + 1; r < word_data + num_word_data && !strcmp(r->text.phrase, q->text.phrase); r++);
-			range[i].to = r-word_data;
+			range[i].from = q - im->word_data;
+			for (r = q + 1; r < im->word_data + im->num_word_data && r->text.phrase == q->text.phrase; r++);
+			range[i].to = r - im->word_data;
 			p += b;
 		}
 		else {
 			if( show_warning )
-				fprintf(stderr, "Warning: `%s' cannot be input from cin.\n", phrase);
+				fprintf(stderr, "Warning: `%s' cannot be input from %s.\n", phrase, im->name);
 			while( *p ) p++;
 			return p;
 		}
@@ -134,41 +342,188 @@ const char *enumerate_keyin_sequence(const char *phrase, long phr_pos, int32_t t
 	/* Length-one phrases. */
 	if (range[1].from == range[1].to) {
 		for (i = range[0].from; i < range[0].to; i++) {
-			word_data[i].text.pos = phr_pos;
-			word_data[i].text.freq = CEIL_DIV(total_freq, range[0].to - range[0].from);
+			im->word_data[i].text.pos = phr_pos;
+			im->word_data[i].text.freq = CEIL_DIV(total_freq, range[0].to - range[0].from);
 		}
 	}
 	else {
-		/* Note: 0 means the first (0th) word is referenced. */
-		find_keyin_sequence( range, keyin_buf, 0);
-
-		/* Set all data in phrase_data. */
-		for( i = old_num_phrase_data; i < num_phrase_data; i++) {
-			strcpy(phrase_data[i].phrase, phrase);
-			phrase_data[i].pos = phr_pos;
-			phrase_data[i].freq = CEIL_DIV(total_freq, num_phrase_data - old_num_phrase_data);
+		/* Count keyin sequences, up to just exceeding max_keyin. */
+		for (len = i, num = 1, i = 0; i < len && (max_keyin == 0 || num <= (size_t)max_keyin); i++)
+			num *= range[i].to - range[i].from;
+
+		if (max_keyin > 0 && num > (size_t)max_keyin)
+			find_top_keyin_sequence( im, buffer, range, len);
+		else
+			/* Note: 0 means the first (0th) word is referenced. */
+			find_keyin_sequence( im, buffer, range, keyin_buf, 0);
+
+		/* Set all data of the new keyin sequences. */
+		for( k = old_num_keyin; k < buffer->num_keyin; k++) {
+			buffer->keyin[k].pos = phr_pos;
+			buffer->keyin[k].freq = CEIL_DIV(total_freq, (int)(buffer->num_keyin - old_num_keyin));
 		}
 	}
 	return p;
 }
 
+/*
+ * Threads take chunks one by one, and every phrase of a chunk is enumerated for
+ * all IMs at once. Besides its own chunk, a thread only writes pos and freq of
+ * words of length-one phrases, which are distinct in dictionary.
+ */
+static void *enumerate_chunks(void *arg)
+{
+	ChunkQueue *queue = (ChunkQueue *) arg;
+	Chunk *chunk;
+	const char *p, *end;
+	const int32_t *freq;
+	int i, k;
+
+	while ((i = plat_atomic_add_int(&queue->next, 1) - 1) < queue->num_chunk) {
+		chunk = &queue->chunk[i];
+		for (p = chunk->begin, freq = chunk->freq; p < chunk->end; p = end + 1, freq++)
+			for (k = 0, end = p; k < queue->num_im; k++)
+				end = enumerate_keyin_sequence(&queue->im[k], &chunk->buffer[k],
+					p, chunk->pos + (p - chunk->begin), *freq);
+	}
+	return NULL;
+}
+
+/* Move keyin sequences of a chunk into phrase_data. */
+static void merge_keyin(KeyinBuffer *buffer, const Chunk *chunk)
+{
+	PhraseData *data;
+	const uint32_t *phone;
+	uint32_t interned = 0;
+	long last_pos = -1;
+	size_t i;
+	int len;
+
+	for (i = 0; i < buffer->num_keyin; i++) {
+		/* Sequences of the same phrase are adjacent, so its string is interned once. */
+		if (buffer->keyin[i].pos != last_pos) {
+			last_pos = buffer->keyin[i].pos;
+			interned = intern_string(chunk->begin + (last_pos - chunk->pos));
+		}
+		phone = &buffer->phone[buffer->keyin[i].phone];
+		for (len = 0; phone[len] != 0; len++);
+
+		data = append_phrase_data();
+		data->phrase = interned;
+		data->phone = store_phone(phone, len);
+		data->pos = buffer->keyin[i].pos;
+		data->freq = buffer->keyin[i].freq;
+	}
+	free(buffer->keyin);
+	free(buffer->phone);
+}
+
+/*
+ * Enumerate keyin sequences of all phrases in dictionary on threads, for all
+ * IMs in one pass, and then write an index tree for each IM.
+ */
+static void generate_index_trees(const DictFile *dict, const int32_t *freq,
+	InputMethod *im, int num_im)
+{
+	ChunkQueue queue;
+	plat_thread *thread;
+	size_t chunk_size = 0;
+	const char *p, *shard_end;
+	int phr_id = 0, started, i, k, s;
+
+	memset(&queue, 0, sizeof(queue));
+	queue.im = im;
+	queue.num_im = num_im;
+	for (s = 0; s < dict->num_shard; s++) {
+		shard_end = dict->shard[s] + dict->size[s];
+		for (p = dict->shard[s] + dict_shard_begin(dict, s); p < shard_end; queue.num_chunk++) {
+			queue.chunk = grow_array(queue.chunk, &chunk_size, queue.num_chunk + 1, sizeof(Chunk));
+			queue.chunk[queue.num_chunk].begin = p;
+			queue.chunk[queue.num_chunk].pos = dict_pos(dict, s, p - dict->shard[s]);
+			queue.chunk[queue.num_chunk].freq = freq + phr_id;
+			queue.chunk[queue.num_chunk].buffer = ALC(KeyinBuffer, num_im);
+			if (!queue.chunk[queue.num_chunk].buffer) {
+				fprintf(stderr, "Memory allocation failed on enumerating keyin sequences.\n");
+				exit(-1);
+			}
+			for (i = 0; i < PHRASES_PER_CHUNK && p < shard_end; i++, phr_id++)
+				p += strlen(p) + 1;
+			queue.chunk[queue.num_chunk].end = p;
+		}
+	}
+
+	if (num_thread < 1)
+		num_thread = plat_thread_cpu_count();
+	if (num_thread > queue.num_chunk)
+		num_thread = queue.num_chunk;
+	thread = ALC(plat_thread, num_thread + 1);
+	if (!thread) {
+		fprintf(stderr, "Memory allocation failed on starting threads.\n");
+		exit(-1);
+	}
+
+	/* Enumerate in the main thread when no thread can be started. */
+	for (started = 0; started < num_thread; started++)
+		if (plat_thread_create(&thread[started], enumerate_chunks, &queue) != 0)
+			break;
+	if (started == 0)
+		enumerate_chunks(&queue);
+	for (i = 0; i < started; i++)
+		plat_thread_join(thread[i]);
+	free(thread);
+
+	for (k = 0; k < num_im; k++) {
+		attach_word_data(im[k].word_data, im[k].num_word_data);
+		im[k].word_data = NULL;
+		clear_phrase_data();
+		for (i = 0; i < queue.num_chunk; i++)
+			merge_keyin(&queue.chunk[i].buffer[k], &queue.chunk[i]);
+
+		strcat(im[k].name, "_" PHONE_TREE_FILE);
+		printf("Writing `%s', this is your index file.\n", im[k].name);
+		write_index_tree( im[k].name );
+	}
+
+	for (i = 0; i < queue.num_chunk; i++)
+		free(queue.chunk[i].buffer);
+	free(queue.chunk);
+}
+
 int main(int argc, char *argv[])
 {
-	plat_mmap dict_map, freq_map;
-	long dict_size, freq_size;
+	plat_mmap freq_map;
+	DictFile dict;
+	long freq_size;
 	size_t offset=0, csize;
-	char IM_name[PATH_MAX];
-	const char *dict, *p, *prefix;
+	InputMethod *im;
+	const char *prefix;
 	const int32_t *freq;
-	int cin_path_id, phr_id = 0;
+	int *cin_path_id;
+	int num_im, i, j;
 
-	cin_path_id = scan_arguments( argc, argv );
-	if( cin_path_id < 0 ) {
-		fprintf(stderr, "Usage: %s <cin_filename>\n", argv[0]);
+	cin_path_id = ALC(int, argc);
+	assert( cin_path_id );
+	num_im = scan_arguments( argc, argv, cin_path_id );
+	if( num_im == 0 ) {
+		fprintf(stderr, "Usage: %s [-w] [-j threads] [-n max_keyin] <cin_filename>...\n", argv[0]);
 		exit(-1);
 	}
 
-	read_IM_cin( argv[cin_path_id], IM_name, EncodeKeyin );
+	/* Words of each IM are kept aside, since read_IM_cin() reads into word_data. */
+	im = ALC(InputMethod, num_im);
+	assert( im );
+	for( i = 0; i < num_im; i++ ) {
+		read_IM_cin( argv[cin_path_id[i]], im[i].name, EncodeKeyin );
+		detach_word_data( &im[i].word_data, &im[i].num_word_data );
+		for( j = 0; j < i; j++ ) {
+			if( !strcmp( im[i].name, im[j].name ) ) {
+				fprintf(stderr, "%s: IM `%s' is defined in both %s and %s, stop.\n",
+					argv[0], im[i].name, argv[cin_path_id[j]], argv[cin_path_id[i]]);
+				exit(-1);
+			}
+		}
+	}
+	free(cin_path_id);
 
 	/* Go to data/, where the exe is. */
 	prefix = dirname( argv[0] );
@@ -179,12 +534,7 @@ int main(int argc, char *argv[])
 	else printf("Entering directory `%s'\n", prefix);
 
 	printf("Opening system dictionary (%s)... ", DICT_FILE);
-	plat_mmap_set_invalid(&dict_map);
-	dict_size = plat_mmap_create(&dict_map, DICT_FILE, FLAG_ATTRIBUTE_READ);
-	csize = dict_size;
-	dict=(const char*)plat_mmap_set_view(&dict_map, &offset, &csize);
-
-	if( !dict ) {
+	if( open_dict_file(&dict, DICT_FILE) != 0 ) {
 		putchar('\n');
 		fprintf(stderr, "%s: Error reading system dictionary.\n", argv[0]);
 		exit(-1);
@@ -205,14 +555,10 @@ int main(int argc, char *argv[])
 	puts("done.");
 
 	puts("Enumerating input methods for each phrase in system dictionary.");
-	for(p = dict; p < dict+dict_size; p++)
-		p = enumerate_keyin_sequence(p, p - dict, freq[phr_id++]);
-
-	strcat(IM_name, "_" PHONE_TREE_FILE);
-	printf("Writing `%s', this is your index file.\n", IM_name);
-	write_index_tree( IM_name );
+	generate_index_trees(&dict, freq, im, num_im);
+	free(im);
 
-	plat_mmap_close(&dict_map);
+	close_dict_file(&dict);
 	plat_mmap_close(&freq_map);
 
 	printf("Leaving directory `%s'\n", prefix);
@@ -27,6 +27,13 @@
  *	       uint32_t phrase.pos; for leaf nodes (key == 0), position of phrase in dictionary
  *	       int32_t phrase.freq; for leaf nodes (key == 0), frequency of the phrase
  *	}\endcode
+ *	The array is followed by a prediction section listing the most frequent\n
+ * phrases below each node. See TreeType for its layout.\n
+ *	With -s, the dictionary is split into shards of limited size, and positions\n
+ * in the tree refer to a shard and an offset in it. See DICT_SHARD_MAGIC.\n
+ *	With -d, words and phrases are recovered from the files of a previous run\n
+ * instead of parsing phone.cin and tsi.src, and a delta of tsi.src is applied\n
+ * before writing the files again.\n
  */
 
 #include <errno.h>
@@ -37,41 +44,47 @@
 #include "build_tool.h"
 
 const char USAGE[] =
-	"Usage: %s <phone.cin> <tsi.src>\n"
+	"Usage: %s [-s <shard size>] <phone.cin> <tsi.src>\n"
+	"       %s [-s <shard size>] -d <delta>\n"
 	"This program creates the following new files:\n"
 	"* " PHONE_TREE_FILE "\n\tindex to phrase file (dictionary)\n"
 	"* " DICT_FILE "\n\tmain phrase file\n"
 	"* " FREQ_FILE "\n\tlog of total frequency\n"
+	"With -s, the phrase file is split into shards of at most the given bytes,\n"
+	"which are " DICT_FILE " and " DICT_FILE ".1, " DICT_FILE ".2 and so on.\n"
+	"Shards are at most 16777216 bytes, and there are at most 256 of them.\n"
+	"With -d, these files of a previous run are updated by a delta, whose\n"
+	"lines are lines of tsi.src to add after `+' or to remove after `-',\n"
+	"such as the output of `diff -u old/tsi.src tsi.src'. A sharded phrase\n"
+	"file stays sharded, in shards of the largest size by default.\n"
 ;
 
-void store_phrase(const char *line, int line_num)
+/* Maximal size of shards of dictionary, 0 for a single file. */
+static long shard_size = 0;
+
+/*
+ * Parse a line of tsi.src into buf, where phrase points to. It returns the
+ * number of phones, or 0 for an empty line.
+ */
+static size_t parse_phrase(const char *line, int line_num, char *buf, size_t buf_size,
+	char **phrase, int *freq_value, uint32_t phone[])
 {
 	const char DELIM[] = " \t\n";
-	char buf[MAX_LINE_LEN];
-	char *phrase;
 	char *freq;
-	char *bopomofo, bopomofo_buf[MAX_UTF8_SIZE*ZUIN_SIZE+1];
+	char *bopomofo;
 	size_t phrase_len;
-	WordData word, *pWord;
-	int i;
 
-	strncpy(buf, line, sizeof(buf));
+	strncpy(buf, line, buf_size);
 	strip(buf);
 	if (strlen(buf) == 0)
-		return;
-
-	if (num_phrase_data >= MAX_PHRASE_DATA) {
-		fprintf(stderr, "Need to increase MAX_PHRASE_DATA to process\n");
-		exit(-1);
-	}
+		return 0;
 
 	/* read phrase */
-	phrase = strtok(buf, DELIM);
-	if (!phrase) {
+	*phrase = strtok(buf, DELIM);
+	if (!*phrase) {
 		fprintf(stderr, "Error reading line %d, `%s'\n", line_num, line);
 		exit(-1);
 	}
-	strncpy(phrase_data[num_phrase_data].phrase, phrase, sizeof(phrase_data[0].phrase));
 
 	/* read frequency */
 	freq = strtok(NULL, DELIM);
@@ -81,7 +94,7 @@ void store_phrase(const char *line, int line_num)
 	}
 
 	errno = 0;
-	phrase_data[num_phrase_data].freq = strtol(freq, 0, 0);
+	*freq_value = strtol(freq, 0, 0);
 	if (errno) {
 		fprintf(stderr, "Error reading frequency `%s' in line %d, `%s'\n", freq, line_num, line);
 		exit(-1);
@@ -92,50 +105,99 @@ void store_phrase(const char *line, int line_num)
 		bopomofo && phrase_len < MAX_PHRASE_LEN;
 		bopomofo = strtok(NULL, DELIM), ++phrase_len) {
 
-		phrase_data[num_phrase_data].phone[phrase_len] = UintFromPhone(bopomofo);
-		if (phrase_data[num_phrase_data].phone[phrase_len] == 0) {
+		phone[phrase_len] = UintFromPhone(bopomofo);
+		if (phone[phrase_len] == 0) {
 			fprintf(stderr, "Error reading bopomofo `%s' in line %d, `%s'\n", bopomofo, line_num, line);
 			exit(-1);
 		}
 	}
 	if (bopomofo) {
-		fprintf(stderr, "Phrase `%s' too long in line %d\n", phrase, line_num);
+		fprintf(stderr, "Phrase `%s' too long in line %d\n", *phrase, line_num);
 	}
 
 	/* check phrase length & bopomofo length */
-	if ((size_t)ueStrLen(phrase_data[num_phrase_data].phrase) != phrase_len) {
+	if ((size_t)ueStrLen(*phrase) != phrase_len) {
 		fprintf(stderr, "Phrase length and bopomofo length mismatch in line %d, `%s'\n", line_num, line);
 		exit(-1);
 	}
+	return phrase_len;
+}
+
+/* Find the word of the given phone in word_data. */
+static WordData *find_word_phone(const char *word, uint32_t phone)
+{
+	WordData *pWord;
+
+	for (pWord = find_word(word_data, num_word_data, word); pWord && pWord < word_data + num_word_data
+		&& !strcmp(string_at(pWord->text.phrase), word); ++pWord)
+		if (phone_at(pWord->text.phone)[0] == phone)
+			return pWord;
+	return NULL;
+}
+
+void store_phrase(const char *line, int line_num)
+{
+	char buf[MAX_LINE_LEN];
+	char *phrase;
+	uint32_t phone[MAX_PHRASE_LEN + 1];
+	int freq_value;
+	size_t phrase_len;
+	PhraseData *data;
+	WordData *pWord;
 
-	/* Please delete this #if after resoving exception phrase cases. It causes some unused variables. */
+	phrase_len = parse_phrase(line, line_num, buf, sizeof(buf), &phrase, &freq_value, phone);
+	if (phrase_len == 0)
+		return;
+
+	/* Please delete this #if after resoving exception phrase cases. */
 #if 0
-	/* Check that each word in phrase can be found in word list. */
-	for (i = 0; i < phrase_len; ++i) {
-		ueStrNCpy(word.text.phrase, ueStrSeek(phrase_data[num_phrase_data].phrase, i), 1, 1);
-		word.text.phone[0] = phrase_data[num_phrase_data].phone[i];
-		if (bsearch(&word, word_data, num_word_data, sizeof(word), compare_word_by_text) == NULL) {
-			PhoneFromUint(bopomofo_buf, sizeof(bopomofo_buf), word.text.phone[0]);
-			fprintf(stderr, "Phrase:%d:error:`%s': `%s' has no phone `%s'\n", line_num, phrase_data[num_phrase_data].phrase, word.text.phrase, bopomofo_buf);
-			exit(-1);
+	{
+		char bopomofo_buf[MAX_UTF8_SIZE*ZUIN_SIZE+1];
+		char word[MAX_UTF8_SIZE + 1];
+		size_t i;
+
+		/* Check that each word in phrase can be found in word list. */
+		for (i = 0; i < phrase_len; ++i) {
+			ueStrNCpy(word, ueStrSeek(phrase, i), 1, 1);
+			if (!find_word_phone(word, phone[i])) {
+				PhoneFromUint(bopomofo_buf, sizeof(bopomofo_buf), phone[i]);
+				fprintf(stderr, "Phrase:%d:error:`%s': `%s' has no phone `%s'\n", line_num, phrase, word, bopomofo_buf);
+				exit(-1);
+			}
 		}
 	}
 #endif
 
-	if(phrase_len >= 2) ++num_phrase_data;
+	if (phrase_len >= 2) {
+		data = append_phrase_data();
+		data->phrase = intern_string(phrase);
+		data->phone = store_phone(phone, phrase_len);
+		data->freq = freq_value;
+	}
 	/* Please rewrite it when check is runnable. */
 	else {
-strcpy(word.text.phrase, phrase_data[num_phrase_data].phrase);
-		word.text.phone[0] = phrase_data[num_phrase_data].phone[0];
-		pWord = bsearch(&word, word_data, num_word_data, sizeof(word), compare_word_by_text);
-		if (pWord != NULL) pWord->text.freq = phrase_data[num_phrase_data].freq;
+		pWord = find_word_phone(phrase, phone[0]);
+		if (pWord != NULL) pWord->text.freq = freq_value;
 	}
 }
 
+/* Compare two phone sequences ended by 0. */
+static int compare_phone(uint32_t x, uint32_t y)
+{
+	const uint32_t *phone_a = phone_at(x), *phone_b = phone_at(y);
+	int i;
+
+	for (i = 0; phone_a[i] != 0 && phone_a[i] == phone_b[i]; ++i)
+		;
+	if (phone_a[i] == phone_b[i])
+		return 0;
+	return phone_a[i] > phone_b[i] ? 1 : -1;
+}
+
 int compare_phrase(const void *x, const void *y)
 {
 	const PhraseData *a = (const PhraseData *) x, *b = (const PhraseData *) y;
-	int cmp=strcmp(a->phrase, b->phrase);
+	int cmp = a->phrase == b->phrase ? 0 : strcmp(string_at(a->phrase), string_at(b->phrase));
 
 	/* If phrases are different, it returns the result of strcmp(); else it
 	 * reports an error when the same phone sequence is found.
@@ -143,9 +205,9 @@ int compare_phrase(const void *x, const void *y)
 	if (cmp) return cmp;
 	else
 	{
-		if(!memcmp(a->phone, b->phone, sizeof(a->phone)))
+		if (compare_phone(a->phone, b->phone) == 0)
 		{
-			fprintf(stderr, "Duplicated phrase `%s' found.\n", a->phrase);
+			fprintf(stderr, "Duplicated phrase `%s' found.\n", string_at(a->phrase));
 			exit(-1);
 		}
 		else return b->freq - a->freq;
@@ -174,9 +236,12 @@ void read_tsi_src(const char *filename)
 
 void write_phrase_data()
 {
-	FILE *dict_file, *freq_file;
+	FILE *dict_file, *shard_file, *freq_file;
+	char shard_name[sizeof(DICT_SHARD_FILE) + 11];
 	PhraseData *cur_phr, *last_phr = NULL;
 	int32_t total_freq = 0, i, j;
+	uint32_t num_shard = 1;
+	size_t len;
 
 	dict_file = fopen(DICT_FILE, "wb");
 	freq_file = fopen(FREQ_FILE, "wb");
@@ -185,6 +250,12 @@ void write_phrase_data()
 		fprintf(stderr, "Cannot open output file.\n");
 		exit(-1);
 	}
+	shard_file = dict_file;
+	if (shard_size > 0) {
+		fwrite(DICT_SHARD_MAGIC, 1, DICT_SHARD_MAGIC_LEN, dict_file);
+		/* The number of shards is updated at the end. */
+		fwrite(&num_shard, 1, sizeof(num_shard), dict_file);
+	}
 
 	/*
 	 * Duplicate Chinese strings are detected and not written into system
@@ -194,15 +265,34 @@ void write_phrase_data()
 	for(i = j = 0; i < num_word_data || j < num_phrase_data; last_phr = cur_phr){
 		if(i == num_word_data) cur_phr = &phrase_data[j++];
 		else if(j == num_phrase_data) cur_phr = &word_data[i++].text;
-		else cur_phr = strcmp(word_data[i].text.phrase, phrase_data[j].phrase)<0 ? &word_data[i++].text : &phrase_data[j++];
+		else cur_phr = strcmp(string_at(word_data[i].text.phrase), string_at(phrase_data[j].phrase))<0 ? &word_data[i++].text : &phrase_data[j++];
 
-		if(last_phr && !strcmp(cur_phr->phrase, last_phr->phrase)) {
+		/* Interned phrases are equal if and only if their offsets are. */
+		if(last_phr && cur_phr->phrase == last_phr->phrase) {
 			cur_phr->pos = last_phr->pos;
 			total_freq += cur_phr->freq;
 		}
 		else {
-			cur_phr->pos = ftell(dict_file);
-			fwrite(cur_phr->phrase, strlen(cur_phr->phrase)+1, 1, dict_file);
+			len = strlen(string_at(cur_phr->phrase)) + 1;
+			if (shard_size > 0 && ftell(shard_file) + (long)len > shard_size) {
+				if (num_shard == DICT_MAX_SHARD) {
+					fprintf(stderr, "More than %d shards are required.\n", DICT_MAX_SHARD);
+					exit(-1);
+				}
+				if (shard_file != dict_file)
+					fclose(shard_file);
+				snprintf(shard_name, sizeof(shard_name), DICT_SHARD_FILE, (int)num_shard++);
+				shard_file = fopen(shard_name, "wb");
+				if (!shard_file) {
+					fprintf(stderr, "Cannot open output file %s.\n", shard_name);
+					exit(-1);
+				}
+			}
+			if (shard_size > 0)
+				cur_phr->pos = DictShardPos(num_shard - 1, ftell(shard_file));
+			else
+				cur_phr->pos = ftell(dict_file);
+			fwrite(string_at(cur_phr->phrase), len, 1, shard_file);
 			if( last_phr ){
 				fwrite(&total_freq, 1, sizeof(total_freq), freq_file);
 				total_freq = cur_phr->freq;
@@ -212,19 +302,262 @@ void write_phrase_data()
 	/* The last unwritten total_freq. */
 	fwrite(&total_freq, 1, sizeof(total_freq), freq_file);
 
+	if (shard_file != dict_file)
+		fclose(shard_file);
+	if (shard_size > 0) {
+		fseek(dict_file, DICT_SHARD_MAGIC_LEN, SEEK_SET);
+		fwrite(&num_shard, 1, sizeof(num_shard), dict_file);
+	}
 	fclose(dict_file);
 	fclose(freq_file);
+
+	/* Remove shards left by a previous run with more shards. */
+	for (i = num_shard; i < DICT_MAX_SHARD; i++) {
+		snprintf(shard_name, sizeof(shard_name), DICT_SHARD_FILE, (int)i);
+		if (remove(shard_name) != 0)
+			break;
+	}
+}
+
+/* Read a whole file of a previous run. */
+static char *read_previous_file(const char *filename, long *size)
+{
+	FILE *file;
+	char *buf;
+
+	file = fopen(filename, "rb");
+	if (!file || fseek(file, 0, SEEK_END) != 0 || (*size = ftell(file)) < 0) {
+		fprintf(stderr, "Cannot read previous %s.\n", filename);
+		exit(-1);
+	}
+	buf = malloc(*size + 1);
+	if (!buf) {
+		fprintf(stderr, "Memory allocation failed on reading %s.\n", filename);
+		exit(-1);
+	}
+	rewind(file);
+	if (fread(buf, 1, *size, file) != (size_t)*size) {
+		fprintf(stderr, "Cannot read previous %s.\n", filename);
+		exit(-1);
+	}
+	buf[*size] = '\0';
+	fclose(file);
+	return buf;
+}
+
+typedef struct {
+	const TreeType *tree;
+	int32_t tree_size;
+	DictFile dict;
+	uint32_t phone[MAX_PHRASE_LEN + 1];
+	WordData *words;
+	size_t words_size;
+	int num_words;
+} PreviousData;
+
+/*
+ * Leaves at depth 1 are words of phone.cin, and deeper ones are phrases of
+ * tsi.src. Words of the same phone are visited in the order of phone.cin,
+ * which is all that their index needs to keep.
+ */
+static void read_previous_node(PreviousData *prev, int32_t node, int depth)
+{
+	const TreeType *child;
+	PhraseData *data;
+	const char *phrase;
+	int32_t i;
+
+	if (prev->tree[node].child.begin < 1 || prev->tree[node].child.end > prev->tree_size) {
+		fprintf(stderr, "Previous " PHONE_TREE_FILE " is corrupted.\n");
+		exit(-1);
+	}
+	for (i = prev->tree[node].child.begin; i < prev->tree[node].child.end; ++i) {
+		child = &prev->tree[i];
+		if (child->key != 0) {
+			if (depth >= MAX_PHRASE_LEN || i <= node) {
+				fprintf(stderr, "Previous " PHONE_TREE_FILE " is corrupted.\n");
+				exit(-1);
+			}
+			prev->phone[depth] = child->key;
+			read_previous_node(prev, i, depth + 1);
+			continue;
+		}
+
+		phrase = dict_phrase_at(&prev->dict, child->phrase.pos);
+		if (depth == 0 || !phrase) {
+			fprintf(stderr, "Previous " PHONE_TREE_FILE " does not match " DICT_FILE ".\n");
+			exit(-1);
+		}
+		if (depth == 1) {
+			prev->words = grow_array(prev->words, &prev->words_size, prev->num_words + 1, sizeof(WordData));
+			prev->words[prev->num_words].text.phrase = intern_string(phrase);
+			prev->words[prev->num_words].text.phone = store_phone(prev->phone, 1);
+			prev->words[prev->num_words].text.freq = child->phrase.freq;
+			prev->words[prev->num_words].index = prev->num_words;
+			++prev->num_words;
+		}
+		else {
+			data = append_phrase_data();
+			data->phrase = intern_string(phrase);
+			data->phone = store_phone(prev->phone, depth);
+			data->freq = child->phrase.freq;
+		}
+	}
+}
+
+/*
+ * Rebuild word_data and phrase_data from the files written by a previous run,
+ * as if phone.cin and tsi.src were read again.
+ */
+void read_previous_data()
+{
+	PreviousData prev;
+	char *tree;
+	long tree_bytes;
+
+	memset(&prev, 0, sizeof(prev));
+	if (open_dict_file(&prev.dict, DICT_FILE) != 0) {
+		fprintf(stderr, "Cannot read previous %s.\n", DICT_FILE);
+		exit(-1);
+	}
+	if (prev.dict.sharded && shard_size == 0)
+		shard_size = DICT_SHARD_SIZE;
+	tree = read_previous_file(PHONE_TREE_FILE, &tree_bytes);
+	prev.tree = (const TreeType *)tree;
+	if (tree_bytes < (long)sizeof(TreeType)
+		|| (prev.tree_size = prev.tree[0].key) > tree_bytes / (long)sizeof(TreeType)) {
+		fprintf(stderr, "Previous " PHONE_TREE_FILE " is corrupted.\n");
+		exit(-1);
+	}
+
+	read_previous_node(&prev, 0, 0);
+
+	qsort(prev.words, prev.num_words, sizeof(prev.words[0]), compare_word_by_text);
+	attach_word_data(prev.words, prev.num_words);
+	free(tree);
+	/* Unmapped before the dictionary is written again. */
+	close_dict_file(&prev.dict);
+}
+
+/* Phrases are looked up by string and then phones. */
+static int compare_phrase_key(const void *x, const void *y)
+{
+	const PhraseData *a = (const PhraseData *) x, *b = (const PhraseData *) y;
+
+	if (a->phrase != b->phrase)
+		return strcmp(string_at(a->phrase), string_at(b->phrase));
+	return compare_phone(a->phone, b->phone);
+}
+
+/*
+ * Apply a delta to word_data and phrase_data. Removals are applied before
+ * additions, so that a phrase removed and added again gets the new frequency,
+ * wherever the lines are in the delta. Adding an existing phrase changes its
+ * frequency. Words of length-one phrases stay, only their frequency changes.
+ */
+void apply_delta(const char *filename)
+{
+	FILE *delta;
+	char line[MAX_LINE_LEN];
+	char buf[MAX_LINE_LEN];
+	char *phrase;
+	uint32_t phone[MAX_PHRASE_LEN + 1];
+	PhraseData key, *data;
+	WordData *pWord;
+	int num_previous = num_phrase_data;
+	int line_num, freq_value, pass, i, j;
+	size_t phrase_len;
+	const char op[] = "-+";
+
+	delta = fopen(filename, "r");
+	if (!delta) {
+		fprintf(stderr, "Error opening the file %s\n", filename);
+		exit(-1);
+	}
+
+	/* Removed phrases are marked by a negative pos until compaction. */
+	qsort(phrase_data, num_phrase_data, sizeof(phrase_data[0]), compare_phrase_key);
+	for (i = 0; i < num_phrase_data; ++i)
+		phrase_data[i].pos = 0;
+
+	for (pass = 0; pass < 2; ++pass) {
+		rewind(delta);
+		for (line_num = 1; fgets(line, sizeof(line), delta); ++line_num) {
+			/* Other lines, including headers "---" and "+++" of diff, are ignored. */
+			if (line[0] != op[pass] || line[1] == op[pass])
+				continue;
+			phrase_len = parse_phrase(line + 1, line_num, buf, sizeof(buf), &phrase, &freq_value, phone);
+			if (phrase_len == 0)
+				continue;
+
+			if (phrase_len == 1) {
+				pWord = find_word_phone(phrase, phone[0]);
+				if (!pWord) {
+					fprintf(stderr, "Word `%s' in line %d is not in phone.cin\n", phrase, line_num);
+					continue;
+				}
+				pWord->text.freq = pass == 0 ? 0 : freq_value;
+				continue;
+			}
+
+			key.phrase = intern_string(phrase);
+			key.phone = store_phone(phone, phrase_len);
+			data = bsearch(&key, phrase_data, num_previous, sizeof(key), compare_phrase_key);
+			if (pass == 0) {
+				if (data)
+					data->pos = -1;
+				else
+					fprintf(stderr, "Phrase `%s' to remove in line %d is not found\n", phrase, line_num);
+			}
+			else {
+				if (!data) {
+					data = append_phrase_data();
+					data->phrase = key.phrase;
+					data->phone = key.phone;
+				}
+				data->pos = 0;
+				data->freq = freq_value;
+			}
+		}
+	}
+	fclose(delta);
+
+	for (i = j = 0; i < num_phrase_data; ++i)
+		if (phrase_data[i].pos >= 0)
+			phrase_data[j++] = phrase_data[i];
+	num_phrase_data = j;
+
+	qsort(phrase_data, num_phrase_data, sizeof(phrase_data[0]), compare_phrase);
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 3) {
-		printf(USAGE, argv[0]);
+	int i = 1;
+
+	if (argc > 2 && !strcmp(argv[1], "-s")) {
+		shard_size = atol(argv[2]);
+		i = 3;
+		/* A shard holds at least the header and the longest phrase. */
+		if (shard_size < DICT_SHARD_HEADER_SIZE + MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1 ||
+				shard_size > DICT_SHARD_SIZE) {
+			fprintf(stderr, "Shard size must be between %d and %d.\n",
+				DICT_SHARD_HEADER_SIZE + MAX_PHRASE_LEN * MAX_UTF8_SIZE + 1, DICT_SHARD_SIZE);
+			return -1;
+		}
+	}
+	if (argc - i != 2) {
+		printf(USAGE, argv[0], argv[0]);
 		return -1;
 	}
 
-	read_IM_cin(argv[1], NULL, EncodeZuinKey);
-	read_tsi_src(argv[2]);
+	if (!strcmp(argv[i], "-d")) {
+		read_previous_data();
+		apply_delta(argv[i + 1]);
+	}
+	else {
+		read_IM_cin(argv[i], NULL, EncodeZuinKey);
+		read_tsi_src(argv[i + 1]);
+	}
 	write_phrase_data();
 	write_index_tree(PHONE_TREE_FILE);
 	return 0;
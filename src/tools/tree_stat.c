@@ -0,0 +1,504 @@
+/**
+ * tree_stat.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+/**
+ * @file tree_stat.c
+ *
+ * @brief Statistics and validation of an index tree.\n
+ *
+ *	This program maps an index tree, and optionally the dictionary it refers\n
+ * to, checks the child.begin/child.end invariants relied on by TreeFindPhrase(),\n
+ * and reports the shape of the tree: nodes and bytes per depth, histograms of\n
+ * fan-out and of leaves per internal node, and the longest runs of leaves.\n
+ *	The cost of lookups is estimated by replaying TreeFindPhrase() and the\n
+ * following reading of leaves for phone sequences of randomly sampled leaves,\n
+ * counting distinct cache lines touched in the tree and in the dictionary.\n
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "build_tool.h"
+
+#define NUM_BUCKET (32)
+#define NUM_LONGEST_RUN (10)
+
+const char USAGE[] =
+	"Usage: %s [-n samples] [-s seed] [-l line size] <index_tree.dat> [dictionary.dat]\n"
+	"Validate an index tree and report statistics of its layout.\n"
+	"  -n samples    number of sampled lookups, 10000 by default\n"
+	"  -s seed       seed of sampling, 1 by default\n"
+	"  -l line size  size of a cache line in bytes, 64 by default\n"
+;
+
+typedef struct {
+	const TreeType *tree;
+	int tree_size;
+	const DictFile *dict;
+	int *parent;
+	int *depth;
+	int max_depth;
+	int num_leaf;
+	int num_error;
+} TreeInfo;
+
+/* Distinct cache lines touched by one lookup. */
+typedef struct {
+	size_t *line;
+	int num, size;
+	size_t line_size;
+} LineSet;
+
+static void report_error(TreeInfo *info, int node, const char *message)
+{
+	if (info->num_error < 20)
+		fprintf(stderr, "Node %d: %s\n", node, message);
+	++info->num_error;
+}
+
+/* Map a whole file, return its address or NULL. */
+static const void *map_file(plat_mmap *map, const char *filename, size_t *size)
+{
+	size_t offset = 0;
+
+	plat_mmap_set_invalid(map);
+	*size = plat_mmap_create(map, filename, FLAG_ATTRIBUTE_READ);
+	if (*size == 0)
+		return NULL;
+	return plat_mmap_set_view(map, &offset, size);
+}
+
+/*
+ * Walk the tree in index order, which is breadth first order for trees written
+ * by the build tools, so that parents are visited before their children.
+ */
+static void validate_tree(TreeInfo *info)
+{
+	const TreeType *tree = info->tree;
+	int p, c;
+	uint32_t last_key;
+
+	for (p = 0; p < info->tree_size; ++p) {
+		info->parent[p] = -1;
+		info->depth[p] = 0;
+	}
+
+	for (p = 0; p < info->tree_size; ++p) {
+		if (p != 0 && info->parent[p] == -1) {
+			report_error(info, p, "not reachable from the root");
+			continue;
+		}
+		if (p != 0 && tree[p].key == 0) {
+			++info->num_leaf;
+			if (info->dict && !dict_phrase_at(info->dict, tree[p].phrase.pos))
+				report_error(info, p, "phrase.pos is out of the dictionary");
+			if (tree[p].phrase.freq < 0)
+				report_error(info, p, "phrase.freq is negative");
+			continue;
+		}
+
+		if (tree[p].child.begin <= p || tree[p].child.end <= tree[p].child.begin ||
+				tree[p].child.end > info->tree_size) {
+			report_error(info, p, "child.begin and child.end are not a range after the node");
+			continue;
+		}
+		last_key = 0;
+		for (c = tree[p].child.begin; c < tree[p].child.end; ++c) {
+			if (info->parent[c] != -1) {
+				report_error(info, c, "has more than one parent");
+				continue;
+			}
+			info->parent[c] = p;
+			info->depth[c] = info->depth[p] + 1;
+			if (info->depth[c] > info->max_depth)
+				info->max_depth = info->depth[c];
+
+			/* Leaves come first, and then keys ascend for bsearch(). */
+			if (tree[c].key == 0 && last_key != 0)
+				report_error(info, c, "leaf follows an internal node");
+			else if (tree[c].key != 0 && tree[c].key <= last_key)
+				report_error(info, c, "key is not in ascending order");
+			if (tree[c].key != 0)
+				last_key = tree[c].key;
+		}
+	}
+}
+
+static int bucket_of(int n)
+{
+	int b = 0;
+
+	while (n > 0 && b < NUM_BUCKET - 1) {
+		n >>= 1;
+		++b;
+	}
+	return b;
+}
+
+static void print_histogram(const char *title, const int *count)
+{
+	int b, last;
+
+	printf("\n%s\n", title);
+	for (last = NUM_BUCKET - 1; last > 0 && count[last] == 0; --last)
+		;
+	for (b = 0; b <= last; ++b) {
+		if (b <= 1)
+			printf("  %10d  %10d\n", b, count[b]);
+		else
+			printf("  %4d-%-5d  %10d\n", 1 << (b - 1), (1 << b) - 1, count[b]);
+	}
+}
+
+static void print_path(const TreeInfo *info, int node)
+{
+	uint32_t key[MAX_PHRASE_LEN + 1];
+	int len = 0, i;
+
+	for (; node > 0 && len < MAX_PHRASE_LEN + 1; node = info->parent[node])
+		key[len++] = info->tree[node].key;
+	for (i = len - 1; i >= 0; --i)
+		printf(" %u", key[i]);
+}
+
+static void report_shape(const TreeInfo *info)
+{
+	const TreeType *tree = info->tree;
+	int *internal, *leaf, *first, *last;
+	int fanout[NUM_BUCKET] = {0}, leaves[NUM_BUCKET] = {0};
+	int longest[NUM_LONGEST_RUN], run[NUM_LONGEST_RUN];
+	int num_longest = 0;
+	int p, c, d, i, n, num_child, num_leaf;
+
+	internal = calloc(info->max_depth + 1, sizeof(*internal));
+	leaf = calloc(info->max_depth + 1, sizeof(*leaf));
+	first = calloc(info->max_depth + 1, sizeof(*first));
+	last = calloc(info->max_depth + 1, sizeof(*last));
+	if (!internal || !leaf || !first || !last) {
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	for (d = 0; d <= info->max_depth; ++d)
+		first[d] = -1;
+
+	for (p = 0; p < info->tree_size; ++p) {
+		if (p != 0 && info->parent[p] == -1)
+			continue;
+		d = info->depth[p];
+		if (first[d] == -1)
+			first[d] = p;
+		last[d] = p;
+		if (p != 0 && tree[p].key == 0) {
+			++leaf[d];
+			continue;
+		}
+		++internal[d];
+
+		num_child = num_leaf = 0;
+		if (tree[p].child.begin > p && tree[p].child.end <= info->tree_size) {
+			for (c = tree[p].child.begin; c < tree[p].child.end; ++c) {
+				if (tree[c].key == 0)
+					++num_leaf;
+				else
+					++num_child;
+			}
+		}
+		++fanout[bucket_of(num_child)];
+		++leaves[bucket_of(num_leaf)];
+
+		/* Keep the longest runs of leaves sorted in descending order. */
+		for (i = num_longest; i > 0 && run[i - 1] < num_leaf; --i) {
+			if (i < NUM_LONGEST_RUN) {
+				run[i] = run[i - 1];
+				longest[i] = longest[i - 1];
+			}
+		}
+		if (i < NUM_LONGEST_RUN) {
+			run[i] = num_leaf;
+			longest[i] = p;
+			if (num_longest < NUM_LONGEST_RUN)
+				++num_longest;
+		}
+	}
+
+	printf("\ndepth    internal      leaves       bytes  index range\n");
+	for (d = 0; d <= info->max_depth; ++d) {
+		n = internal[d] + leaf[d];
+		printf("%5d  %10d  %10d  %10lu  [%d, %d]\n", d, internal[d], leaf[d],
+			(unsigned long)n * sizeof(TreeType), first[d], last[d] + 1);
+	}
+
+	print_histogram("internal children  internal nodes", fanout);
+	print_histogram("leaf children      internal nodes", leaves);
+
+	printf("\nlongest leaf runs\n");
+	for (i = 0; i < num_longest; ++i) {
+		printf("  %6d leaves at node %d, keys", run[i], longest[i]);
+		print_path(info, longest[i]);
+		if (info->dict && run[i] > 0 && dict_phrase_at(info->dict, tree[tree[longest[i]].child.begin].phrase.pos))
+			printf(", first `%s'", dict_phrase_at(info->dict, tree[tree[longest[i]].child.begin].phrase.pos));
+		printf("\n");
+	}
+
+	free(last);
+	free(first);
+	free(leaf);
+	free(internal);
+}
+
+static void touch(LineSet *set, size_t addr, size_t len)
+{
+	size_t line;
+
+	for (line = addr / set->line_size; line <= (addr + len - 1) / set->line_size; ++line) {
+		if (set->num == set->size) {
+			set->size = set->size ? set->size * 2 : 64;
+			set->line = realloc(set->line, set->size * sizeof(set->line[0]));
+			if (!set->line) {
+				fprintf(stderr, "Out of memory\n");
+				exit(-1);
+			}
+		}
+		set->line[set->num++] = line;
+	}
+}
+
+static int compare_line(const void *x, const void *y)
+{
+	size_t a = *(const size_t *)x;
+	size_t b = *(const size_t *)y;
+
+	return a < b ? -1 : a > b;
+}
+
+static int count_lines(LineSet *set)
+{
+	int i, n = 0;
+
+	qsort(set->line, set->num, sizeof(set->line[0]), compare_line);
+	for (i = 0; i < set->num; ++i) {
+		if (i == 0 || set->line[i] != set->line[i - 1])
+			++n;
+	}
+	set->num = 0;
+	return n;
+}
+
+static void touch_node(LineSet *set, int node)
+{
+	touch(set, (size_t)node * sizeof(TreeType), sizeof(TreeType));
+}
+
+/*
+ * Replay TreeFindPhrase() for the phone sequence leading to leaf, including the
+ * probes of bsearch(), and GetPhraseFirst()/GetVocabNext() reading its leaves.
+ */
+static void replay_lookup(const TreeInfo *info, int leaf, LineSet *tree_set, LineSet *dict_set)
+{
+	const TreeType *tree = info->tree;
+	uint32_t key[MAX_PHRASE_LEN + 1];
+	int len = 0, i, node, low, high, mid = 0;
+
+	for (node = info->parent[leaf]; node > 0 && len < MAX_PHRASE_LEN + 1; node = info->parent[node])
+		key[len++] = tree[node].key;
+
+	node = 0;
+	touch_node(tree_set, node);
+	for (i = len - 1; i >= 0; --i) {
+		/* Same probes as bsearch() of glibc. */
+		low = tree[node].child.begin;
+		high = tree[node].child.end;
+		while (low < high) {
+			mid = (low + high) / 2;
+			touch_node(tree_set, mid);
+			if (key[i] < tree[mid].key)
+				high = mid;
+			else if (key[i] > tree[mid].key)
+				low = mid + 1;
+			else
+				break;
+		}
+		node = mid;
+	}
+
+	for (i = tree[node].child.begin; i < tree[node].child.end; ++i) {
+		touch_node(tree_set, i);
+		if (tree[i].key != 0)
+			break;
+		if (info->dict)
+			touch(dict_set, tree[i].phrase.pos, strlen(dict_phrase_at(info->dict, tree[i].phrase.pos)) + 1);
+	}
+}
+
+/* xorshift32, so that samples do not depend on rand() of the platform. */
+static uint32_t next_random(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void report_lookup(const TreeInfo *info, int num_sample, uint32_t seed, size_t line_size)
+{
+	LineSet tree_set = {NULL, 0, 0, 0}, dict_set = {NULL, 0, 0, 0};
+	long tree_lines[MAX_PHRASE_LEN + 1] = {0}, dict_lines[MAX_PHRASE_LEN + 1] = {0};
+	int count[MAX_PHRASE_LEN + 1] = {0}, max_tree[MAX_PHRASE_LEN + 1] = {0};
+	long total_tree = 0, total_dict = 0;
+	int *leaf;
+	int num_leaf = 0;
+	int p, i, n, len;
+	uint32_t state = seed ? seed : 1;
+
+	leaf = calloc(info->num_leaf + 1, sizeof(*leaf));
+	if (!leaf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	for (p = 1; p < info->tree_size; ++p) {
+		if (info->parent[p] != -1 && info->tree[p].key == 0)
+			leaf[num_leaf++] = p;
+	}
+	if (num_leaf == 0 || num_sample <= 0) {
+		free(leaf);
+		return;
+	}
+
+	tree_set.line_size = dict_set.line_size = line_size;
+	for (i = 0; i < num_sample; ++i) {
+		p = leaf[next_random(&state) % num_leaf];
+		len = info->depth[p] - 1;
+		if (len > MAX_PHRASE_LEN)
+			len = MAX_PHRASE_LEN;
+		replay_lookup(info, p, &tree_set, &dict_set);
+
+		n = count_lines(&tree_set);
+		++count[len];
+		tree_lines[len] += n;
+		total_tree += n;
+		if (n > max_tree[len])
+			max_tree[len] = n;
+		n = count_lines(&dict_set);
+		dict_lines[len] += n;
+		total_dict += n;
+	}
+
+	printf("\ncache lines of %lu bytes per lookup, %d sampled leaves\n", (unsigned long)line_size, num_sample);
+	printf("length     samples   tree avg   tree max   dict avg\n");
+	for (len = 0; len <= MAX_PHRASE_LEN; ++len) {
+		if (count[len] == 0)
+			continue;
+		printf("%6d  %10d  %9.2f  %9d  %9.2f\n", len, count[len],
+			(double)tree_lines[len] / count[len], max_tree[len],
+			(double)dict_lines[len] / count[len]);
+	}
+	printf("   all  %10d  %9.2f             %9.2f\n", num_sample,
+		(double)total_tree / num_sample, (double)total_dict / num_sample);
+
+	free(dict_set.line);
+	free(tree_set.line);
+	free(leaf);
+}
+
+int main(int argc, char *argv[])
+{
+	plat_mmap tree_map;
+	DictFile dict;
+	size_t dict_bytes = 0;
+	TreeInfo info;
+	size_t tree_bytes, nodes_bytes;
+	const int32_t *offset;
+	int num_sample = 10000;
+	uint32_t seed = 1;
+	long line_size = 64;
+	int i, j;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			num_sample = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			line_size = atol(argv[++i]);
+		} else {
+			fprintf(stderr, USAGE, argv[0]);
+			return -1;
+		}
+	}
+	if (argc - i < 1 || argc - i > 2 || num_sample < 0 || line_size <= 0) {
+		fprintf(stderr, USAGE, argv[0]);
+		return -1;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.tree = map_file(&tree_map, argv[i], &tree_bytes);
+	if (!info.tree || tree_bytes < sizeof(TreeType)) {
+		fprintf(stderr, "Cannot map %s\n", argv[i]);
+		return -1;
+	}
+	/* Key of root is the number of nodes. */
+	info.tree_size = info.tree[0].key;
+	nodes_bytes = (size_t)info.tree_size * sizeof(TreeType);
+	if (info.tree_size <= 0 || nodes_bytes > tree_bytes) {
+		fprintf(stderr, "%s has %d nodes, which do not fit in %lu bytes\n",
+			argv[i], info.tree_size, (unsigned long)tree_bytes);
+		return -1;
+	}
+	if (i + 1 < argc) {
+		if (open_dict_file(&dict, argv[i + 1]) != 0) {
+			fprintf(stderr, "Cannot map %s\n", argv[i + 1]);
+			return -1;
+		}
+		info.dict = &dict;
+	}
+
+	info.parent = calloc(info.tree_size, sizeof(*info.parent));
+	info.depth = calloc(info.tree_size, sizeof(*info.depth));
+	if (!info.parent || !info.depth) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	validate_tree(&info);
+
+	printf("nodes               %d\n", info.tree_size);
+	printf("leaves              %d\n", info.num_leaf);
+	printf("node bytes          %lu\n", (unsigned long)nodes_bytes);
+	offset = (const int32_t *)((const char *)info.tree + nodes_bytes);
+	if (tree_bytes >= nodes_bytes + (info.tree_size + 1) * sizeof(int32_t) && offset[info.tree_size] >= 0 &&
+			tree_bytes == nodes_bytes + (info.tree_size + 1 + offset[info.tree_size]) * sizeof(int32_t))
+		printf("prediction bytes    %lu\n", (unsigned long)(tree_bytes - nodes_bytes));
+	else if (tree_bytes != nodes_bytes)
+		printf("trailing bytes      %lu, not a prediction section\n", (unsigned long)(tree_bytes - nodes_bytes));
+	if (info.dict) {
+		for (j = 0; j < dict.num_shard; ++j)
+			dict_bytes += dict.size[j];
+		printf("dictionary bytes    %lu\n", (unsigned long)dict_bytes);
+		if (dict.sharded)
+			printf("dictionary shards   %d\n", dict.num_shard);
+	}
+	printf("errors              %d\n", info.num_error);
+
+	report_shape(&info);
+	/* Lookups follow child ranges, which are only meaningful in a valid tree. */
+	if (info.num_error == 0)
+		report_lookup(&info, num_sample, seed, line_size);
+
+	free(info.depth);
+	free(info.parent);
+	if (info.dict)
+		close_dict_file(&dict);
+	plat_mmap_close(&tree_map);
+	return info.num_error ? 1 : 0;
+}
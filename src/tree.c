@@ -27,7 +27,9 @@
 #include "global.h"
 #include "global-private.h"
 #include "dict-private.h"
+#include "chewingutil.h"
 #include "tree-private.h"
+#include "zuin-private.h"
 #include "private.h"
 #include "plat_mmap.h"
 
@@ -74,54 +76,84 @@ static int PhraseIntervalIntersect(PhraseIntervalType in1, PhraseIntervalType in
 	return ( max( in1.from, in2.from ) < min( in1.to, in2.to ) );
 }
 
-void TerminateTree( ChewingData *pgdata )
+void TerminateTree( ChewingData *pgdata, int layer )
 {
-		pgdata->static_data.tree = NULL;
-		plat_mmap_close( &pgdata->static_data.tree_mmap );
+		DictLayer *dl = &pgdata->static_data.layer[ layer ];
+
+		dl->tree = NULL;
+		dl->predict_offset = NULL;
+		dl->predict_leaf = NULL;
+		plat_mmap_close( &dl->tree_mmap );
+}
+
+/*
+ * Locate the optional prediction section following the tree nodes. Older index
+ * files do not have it, and prediction is simply unavailable for them.
+ */
+static void InitPredict( DictLayer *dl )
+{
+	size_t tree_num = dl->tree->key;
+	size_t nodes_size = tree_num * sizeof( TreeType );
+	const int32_t *offset;
+
+	dl->predict_offset = NULL;
+	dl->predict_leaf = NULL;
+
+	if ( dl->tree_size < nodes_size + ( tree_num + 1 ) * sizeof( int32_t ) )
+		return;
+	offset = (const int32_t *) ( (const char *) dl->tree + nodes_size );
+	if ( offset[ tree_num ] < 0 || dl->tree_size !=
+			nodes_size + ( tree_num + 1 + offset[ tree_num ] ) * sizeof( int32_t ) )
+		return;
+
+	dl->predict_offset = offset;
+	dl->predict_leaf = offset + tree_num + 1;
 }
 
-int InitTree( ChewingData *pgdata, const char * prefix )
+int InitTree( ChewingData *pgdata, int layer, const char * prefix )
 {
+	DictLayer *dl = &pgdata->static_data.layer[ layer ];
 	char filename[ PATH_MAX ];
 	size_t len;
 	size_t offset;
 
+	dl->tree = NULL;
+	dl->predict_offset = NULL;
+	dl->predict_leaf = NULL;
+	plat_mmap_set_invalid( &dl->tree_mmap );
+
 	len = snprintf( filename, sizeof( filename ), "%s" PLAT_SEPARATOR "%s%s", prefix, pgdata->static_data.IM_name, PHONE_TREE_FILE );
 	if ( len + 1 > sizeof( filename ) )
 		return -1;
 
-	plat_mmap_set_invalid( &pgdata->static_data.tree_mmap );
-	pgdata->static_data.tree_size = plat_mmap_create( &pgdata->static_data.tree_mmap, filename, FLAG_ATTRIBUTE_READ );
-	if ( pgdata->static_data.tree_size <= 0 )
+	dl->tree_size = plat_mmap_create( &dl->tree_mmap, filename, FLAG_ATTRIBUTE_READ );
+	if ( dl->tree_size <= 0 )
 		return -1;
 
 	offset = 0;
-	pgdata->static_data.tree = (const TreeType *) plat_mmap_set_view( &pgdata->static_data.tree_mmap, &offset, &pgdata->static_data.tree_size );
-	if ( !pgdata->static_data.tree )
+	dl->tree = (const TreeType *) plat_mmap_set_view( &dl->tree_mmap, &offset, &dl->tree_size );
+	if ( !dl->tree )
 		return -1;
 
+	InitPredict( dl );
 	return 0;
 }
 
-static int CheckBreakpoint( int from, int to, int bArrBrkpt[] )
+static int CheckBreakpoint( int from, int to, SeqBits bArrBrkpt )
 {
-	int i;
-	for ( i = from + 1; i < to; i++ )
-		if ( bArrBrkpt[ i ] )
-			return 0;
-	return 1;
+	return ! ( bArrBrkpt & SeqBitRange( from + 1, to ) );
 }
 
 static int CheckUserChoose(
 		ChewingData *pgdata,
 		KeySeqWord *new_phoneSeq, int from , int to,
 		Phrase **pp_phr,
-		char selectStr[][ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ],
 		IntervalType selectInterval[], int nSelect )
 {
 	IntervalType inte, c;
-	int chno, len;
+	int chno;
 	int user_alloc;
+	int userfreq;
 	UserPhraseData *pUserPhraseData;
 	Phrase *p_phr = ALC( Phrase, 1 );
 
@@ -157,24 +189,24 @@ static int CheckUserChoose(
 				 * find a phrase of ph_id where the text contains
 				 * 'selectStr[chno]' test if not ok then return 0,
 				 * if ok then continue to test. */
-				len = c.to - c.from;
 				if ( memcmp(
 					ueStrSeek( pUserPhraseData->wordSeq, c.from - from ),
-					selectStr[ chno ],
-					ueStrNBytes( selectStr[ chno ], len ) ) )
+					SelectStr( pgdata, chno ),
+					pgdata->selectStr[ chno ].len ) )
 					break;
 			}
 
 		}
 		if ( chno == nSelect ) {
 			/* save phrase data to "pp_phr" */
-			if ( pUserPhraseData->userfreq > p_phr->freq ) {
+			userfreq = plat_atomic_load_int( &pUserPhraseData->userfreq );
+			if ( userfreq > p_phr->freq ) {
 				if ( ( user_alloc = ( to - from ) ) > 0 ) {
 					ueStrNCpy( p_phr->phrase,
 							pUserPhraseData->wordSeq,
 							user_alloc, 1);
 				}
-				p_phr->freq = pUserPhraseData->userfreq;
+				p_phr->freq = userfreq;
 				*pp_phr = p_phr;
 			}
 		}
@@ -193,11 +225,10 @@ static int CheckUserChoose(
 static int CheckChoose(
 		ChewingData *pgdata,
 		const TreeType *phrase_parent, int from, int to, Phrase **pp_phr,
-		char selectStr[][ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ],
 		IntervalType selectInterval[], int nSelect )
 {
 	IntervalType inte, c;
-	int chno, len;
+	int chno;
 	Phrase *phrase = ALC( Phrase, 1 );
 
 	assert( phrase );
@@ -216,11 +247,10 @@ static int CheckChoose(
 				 * 'selectStr[chno]' test if not ok then return 0, if ok
 				 * then continue to test
 				 */
-				len = c.to - c.from;
 				if ( memcmp(
 					ueStrSeek( phrase->phrase, c.from - from ),
-					selectStr[ chno ],
-					ueStrNBytes( selectStr[ chno ], len ) ) )
+					SelectStr( pgdata, chno ),
+					pgdata->selectStr[ chno ].len ) )
 					break;
 			}
 			else if ( IsIntersect( inte, selectInterval[ chno ] ) ) {
@@ -243,37 +273,168 @@ static int CompTreeType( const void *a, const void *b )
 }
 
 /**
- * @brief search for phrases with the same input keys.
- * if phoneSeq[begin] ~ phoneSeq[end] is a phrase, then add an interval
- * from (begin) to (end+1)
+ * @brief find the dictionary layer whose tree holds the node.
+ * The last layer is not checked, since the node must be there otherwise.
+ */
+int TreeLayerOf( ChewingData *pgdata, const TreeType *node )
+{
+	const DictLayer *dl;
+	int i;
+
+	for ( i = 0; i < pgdata->static_data.nLayer - 1; i++ ) {
+		dl = &pgdata->static_data.layer[ i ];
+		if ( node >= dl->tree && node < dl->tree + dl->tree->key )
+			break;
+	}
+	return i;
+}
+
+/**
+ * @brief search for the child of a node by key in a layer.
  */
-const TreeType *TreeFindPhrase( ChewingData *pgdata, int begin, int end, const KeySeqWord *phoneSeq )
+const TreeType *TreeFindChild( ChewingData *pgdata, int layer, const TreeType *parent, KeySeqWord key )
 {
 	TreeType target;
-	const TreeType *tree_p = pgdata->static_data.tree;
+
+	target.key = key;
+	return (const TreeType *) bsearch( &target,
+		pgdata->static_data.layer[ layer ].tree + parent->child.begin,
+		parent->child.end - parent->child.begin, sizeof( TreeType ), CompTreeType );
+}
+
+/**
+ * @brief whether some phrase ends at the node of a layer.
+ */
+int TreeHasPhrase( ChewingData *pgdata, int layer, const TreeType *node )
+{
+	/* If its child has no key value of 0, then it is only a "half" phrase. */
+	return pgdata->static_data.layer[ layer ].tree[ node->child.begin ].key == 0;
+}
+
+/**
+ * @brief search for the node reached by the input keys in a layer.
+ * The node may not have any phrase ending at it.
+ */
+const TreeType *TreeFindPrefix( ChewingData *pgdata, int layer, int begin, int end, const KeySeqWord *phoneSeq )
+{
+	const TreeType *tree_p = pgdata->static_data.layer[ layer ].tree;
 	int i;
 
 	for ( i = begin; i <= end; i++ ) {
-		target.key = phoneSeq[i];
-		tree_p = (const TreeType*)bsearch(&target, pgdata->static_data.tree + tree_p->child.begin, 
-						  tree_p->child.end - tree_p->child.begin, sizeof(TreeType), CompTreeType);
+		tree_p = TreeFindChild( pgdata, layer, tree_p, phoneSeq[ i ] );
 
 		/* if not found any word then fail. */
 		if( !tree_p ) return NULL;
 	}
+	return tree_p;
+}
 
-	/* If its child has no key value of 0, then it is only a "half" phrase. */
-	if( pgdata->static_data.tree[ tree_p->child.begin ].key != 0) return NULL;
+/**
+ * @brief search for phrases with the same input keys in a layer.
+ * if phoneSeq[begin] ~ phoneSeq[end] is a phrase, then add an interval
+ * from (begin) to (end+1)
+ */
+const TreeType *TreeFindPhrase( ChewingData *pgdata, int layer, int begin, int end, const KeySeqWord *phoneSeq )
+{
+	const TreeType *tree_p = TreeFindPrefix( pgdata, layer, begin, end, phoneSeq );
+
+	if( !tree_p || !TreeHasPhrase( pgdata, layer, tree_p ) ) return NULL;
 	else return tree_p;
 }
 
+/* Whether another layer already predicts the phrase of leaf. */
+static int IsPredicted( ChewingData *pgdata, const TreeType *leaf, int layer )
+{
+	PredictInfo *ppi = &pgdata->predictInfo;
+	const char *phrase = NULL;
+	int i;
+
+	for ( i = 0; i < ppi->nPredict; i++ ) {
+		if ( TreeLayerOf( pgdata, ppi->leaf[ i ] ) == layer )
+			continue;
+		if ( ! phrase )
+			phrase = GetDictPhrase( pgdata, leaf );
+		if ( ! strcmp( GetDictPhrase( pgdata, ppi->leaf[ i ] ), phrase ) )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief predict phrases starting with the trailing phones of phoneSeq.
+ *
+ * The longest suffix of phoneSeq, not crossing any breakpoint, which has
+ * phrases below its node in some layer is used. Predictions of the layers
+ * are merged by frequency. Results are stored in predictInfo.
+ */
+int TreePredictPhrase( ChewingData *pgdata )
+{
+	PredictInfo *ppi = &pgdata->predictInfo;
+	const DictLayer *dl;
+	const TreeType *node, *leaf, *best;
+	int next[ MAX_DICT_LAYER ], end[ MAX_DICT_LAYER ];
+	int len, begin, i, inx, bestLayer;
+
+	ppi->nPredict = 0;
+	ppi->nPrefix = 0;
+
+	for ( len = min( pgdata->nPhoneSeq, MAX_PHRASE_LEN ); len > 0; len-- ) {
+		begin = pgdata->nPhoneSeq - len;
+		if ( ! CheckBreakpoint( begin, pgdata->nPhoneSeq, pgdata->bArrBrkpt ) )
+			continue;
+
+		/* the range of predicted leaves of each layer */
+		for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+			dl = &pgdata->static_data.layer[ i ];
+			next[ i ] = end[ i ] = 0;
+			if ( !dl->predict_offset )
+				continue;
+			node = TreeFindPrefix( pgdata, i, begin, pgdata->nPhoneSeq - 1, pgdata->phoneSeq );
+			if ( !node )
+				continue;
+			inx = node - dl->tree;
+			next[ i ] = dl->predict_offset[ inx ];
+			end[ i ] = dl->predict_offset[ inx + 1 ];
+		}
+
+		/* each range is in descending frequency, so merge them */
+		while ( ppi->nPredict < MAX_PREDICT_NUM ) {
+			best = NULL;
+			bestLayer = 0;
+			for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+				if ( next[ i ] >= end[ i ] )
+					continue;
+				dl = &pgdata->static_data.layer[ i ];
+				leaf = dl->tree + dl->predict_leaf[ next[ i ] ];
+				if ( ! best || leaf->phrase.freq > best->phrase.freq ) {
+					best = leaf;
+					bestLayer = i;
+				}
+			}
+			if ( ! best )
+				break;
+			next[ bestLayer ]++;
+			if ( ! IsPredicted( pgdata, best, bestLayer ) )
+				ppi->leaf[ ppi->nPredict++ ] = best;
+		}
+		if ( ppi->nPredict > 0 ) {
+			ppi->nPrefix = len;
+			break;
+		}
+	}
+	return ppi->nPredict;
+}
+
 /**
  * @brief get child range of a given parent node.
  */
 void TreeChildRange( ChewingData *pgdata, const TreeType *parent )
 {
-	pgdata->static_data.tree_cur_pos = pgdata->static_data.tree + parent->child.begin;
-	pgdata->static_data.tree_end_pos = pgdata->static_data.tree + parent->child.end;
+	const DictLayer *dl = &pgdata->static_data.layer[ TreeLayerOf( pgdata, parent ) ];
+
+	pgdata->static_data.tree_cur_layer = dl;
+	pgdata->static_data.tree_cur_pos = dl->tree + parent->child.begin;
+	pgdata->static_data.tree_end_pos = dl->tree + parent->child.end;
 }
 
 static void AddInterval(
@@ -315,18 +476,157 @@ static void internal_release_Phrase( UsedPhraseMode mode, Phrase *pUser, Phrase
 	}
 }
 
+/*
+ * A path from the root of the phrase tree of a layer, possibly through
+ * confusable phones.
+ */
+typedef struct {
+	const TreeType *node;
+	int cost;
+	int layer;
+} FuzzyPathType;
+
+static int CompFuzzyPath( const void *a, const void *b )
+{
+	const FuzzyPathType *pa = (const FuzzyPathType *) a;
+	const FuzzyPathType *pb = (const FuzzyPathType *) b;
+
+	if ( pa->cost != pb->cost )
+		return pa->cost - pb->cost;
+	if ( pa->layer != pb->layer )
+		return pa->layer - pb->layer;
+	return ( pa->node > pb->node ) - ( pa->node < pb->node );
+}
+
+/* Group paths by layer, each ordered as CompFuzzyPath() does. */
+static int CompFuzzyPathByLayer( const void *a, const void *b )
+{
+	const FuzzyPathType *pa = (const FuzzyPathType *) a;
+	const FuzzyPathType *pb = (const FuzzyPathType *) b;
+
+	if ( pa->layer != pb->layer )
+		return pa->layer - pb->layer;
+	return CompFuzzyPath( a, b );
+}
+
+static int IsFuzzyEnabled( ChewingData *pgdata )
+{
+	return pgdata->fuzzyData.bFuzzy && pgdata->static_data.IM_name[ 0 ] == '\0';
+}
+
+/*
+ * Extend every path by one phone. Without fuzzy matching, there is at most one
+ * path per layer, which is the exact one, so that the layers are walked in
+ * lock-step. Otherwise each confusable phone opens a branch, and only
+ * FUZZY_BEAM_WIDTH paths of each layer, those with the least replacements,
+ * survive, so the work per level stays bounded however many classes are
+ * configured. The limit is kept per layer, so that paths of layers in front
+ * never crowd out those of the system dictionary. Exact paths sort first and
+ * are never dropped.
+ */
+static int ExtendFuzzyPath( ChewingData *pgdata, FuzzyPathType path[], int nPath, KeySeqWord phone )
+{
+	FuzzyPathType next[ FUZZY_BEAM_WIDTH * MAX_DICT_LAYER * MAX_FUZZY_ALT ];
+	KeySeqWord alt[ MAX_FUZZY_ALT ];
+	int cost[ MAX_FUZZY_ALT ];
+	int nAlt = 1, nNext = 0, nKept, nLayerKept, i, j;
+	const TreeType *child;
+
+	alt[ 0 ] = phone;
+	cost[ 0 ] = 0;
+	if ( IsFuzzyEnabled( pgdata ) )
+		nAlt = FuzzyPhoneAlt( &pgdata->fuzzyData, phone, alt, cost );
+
+	for ( i = 0; i < nPath; i++ ) {
+		for ( j = 0; j < nAlt; j++ ) {
+			child = TreeFindChild( pgdata, path[ i ].layer, path[ i ].node, alt[ j ] );
+			if ( child ) {
+				next[ nNext ].node = child;
+				next[ nNext ].cost = path[ i ].cost + cost[ j ];
+				next[ nNext ].layer = path[ i ].layer;
+				nNext++;
+			}
+		}
+	}
+
+	if ( nNext <= FUZZY_BEAM_WIDTH ) {
+		memcpy( path, next, sizeof( next[ 0 ] ) * nNext );
+		return nNext;
+	}
+
+	qsort( next, nNext, sizeof( next[ 0 ] ), CompFuzzyPathByLayer );
+	for ( i = nKept = nLayerKept = 0; i < nNext; i++ ) {
+		if ( i > 0 && next[ i ].layer != next[ i - 1 ].layer )
+			nLayerKept = 0;
+		if ( nLayerKept < FUZZY_BEAM_WIDTH ) {
+			path[ nKept++ ] = next[ i ];
+			nLayerKept++;
+		}
+	}
+	/* Ties in ChooseFuzzyPhrase() go to fewer replacements, then to the front layer. */
+	qsort( path, nKept, sizeof( path[ 0 ] ), CompFuzzyPath );
+	return nKept;
+}
+
+/*
+ * Find the dict phrase of the paths. An exact path wins whenever it has a
+ * phrase; otherwise fuzzy paths are considered. Among either, the most
+ * frequent phrase is taken, ties going to the path listed first.
+ */
+static Phrase *ChooseFuzzyPhrase(
+		ChewingData *pgdata, const FuzzyPathType path[], int nPath, int from, int to )
+{
+	Phrase *p_phrase, *best = NULL;
+	int bestExact = 0;
+	int i;
+
+	for ( i = 0; i < nPath; i++ ) {
+		if ( bestExact && path[ i ].cost != 0 )
+			continue;
+		if ( ! TreeHasPhrase( pgdata, path[ i ].layer, path[ i ].node ) )
+			continue;
+		if ( ! CheckChoose(
+				pgdata,
+				path[ i ].node, from, to,
+				&p_phrase,
+				pgdata->selectInterval, pgdata->nSelect ) )
+			continue;
+
+		if ( best == NULL || ( path[ i ].cost == 0 && ! bestExact ) ||
+				p_phrase->freq > best->freq ) {
+			free( best );
+			best = p_phrase;
+			bestExact = ( path[ i ].cost == 0 );
+		}
+		else
+			free( p_phrase );
+	}
+	return best;
+}
+
 static void FindInterval( ChewingData *pgdata, TreeDataType *ptd )
 {
-	int end, begin;
-	const TreeType *phrase_parent;
+	int end, begin, nPath, i;
+	FuzzyPathType path[ FUZZY_BEAM_WIDTH * MAX_DICT_LAYER * MAX_FUZZY_ALT ];
 	Phrase *p_phrase, *puserphrase, *pdictphrase;
 	UsedPhraseMode i_used_phrase;
 	KeySeqWord new_phoneSeq[ MAX_PHONE_SEQ_LEN ];
 
 	for ( begin = 0; begin < pgdata->nPhoneSeq; begin++ ) {
+		/*
+		 * Paths are extended along with end, instead of searching from root,
+		 * starting with one at the root of each layer.
+		 */
+		for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+			path[ i ].node = pgdata->static_data.layer[ i ].tree;
+			path[ i ].cost = 0;
+			path[ i ].layer = i;
+		}
+		nPath = pgdata->static_data.nLayer;
+
 		for ( end = begin; end < pgdata->nPhoneSeq; end++ ) {
 			if ( ! CheckBreakpoint( begin, end + 1, pgdata->bArrBrkpt ) )
-				continue;
+				break;
 
 			/* set new_phoneSeq */
 			memcpy(
@@ -340,21 +640,15 @@ static void FindInterval( ChewingData *pgdata, TreeDataType *ptd )
 			/* check user phrase */
 			if ( UserGetPhraseFirst( pgdata, new_phoneSeq ) &&
 					CheckUserChoose( pgdata, new_phoneSeq, begin, end + 1,
-					&p_phrase, pgdata->selectStr, pgdata->selectInterval, pgdata->nSelect ) ) {
+					&p_phrase, pgdata->selectInterval, pgdata->nSelect ) ) {
 				puserphrase = p_phrase;
 			}
 
 			/* check dict phrase */
-			phrase_parent = TreeFindPhrase( pgdata, begin, end, pgdata->phoneSeq );
-			if (
-				phrase_parent &&
-				CheckChoose(
-					pgdata,
-					phrase_parent, begin, end + 1,
-					&p_phrase, pgdata->selectStr,
-					pgdata->selectInterval, pgdata->nSelect ) ) {
-				pdictphrase = p_phrase;
-			}
+			if ( nPath > 0 )
+				nPath = ExtendFuzzyPath( pgdata, path, nPath, pgdata->phoneSeq[ end ] );
+			if ( nPath > 0 )
+				pdictphrase = ChooseFuzzyPhrase( pgdata, path, nPath, begin, end + 1 );
 
 			/* add only one interval, which has the largest freqency
 			 * but when the phrase is the same, the user phrase overrides
@@ -563,7 +857,6 @@ static void OutputRecordStr(
 		char *out_buf, int out_buf_len,
 		const int *record, int nRecord,
 		KeySeqWord phoneSeq[], int nPhoneSeq,
-		char selectStr[][ MAX_PHONE_SEQ_LEN * MAX_UTF8_SIZE + 1 ],
 		IntervalType selectInterval[],
 		int nSelect, const TreeDataType *ptd )
 {
@@ -583,7 +876,7 @@ static void OutputRecordStr(
 		inter.to = selectInterval[ i ].to ;
 		ueStrNCpy(
 				ueStrSeek( out_buf, inter.from ),
-				selectStr[ i ], ( inter.to - inter.from ), -1);
+				SelectStr( pgdata, i ), ( inter.to - inter.from ), -1);
 	}
 }
 
@@ -823,25 +1116,21 @@ static void CleanUpMem( TreeDataType *ptd )
 	}
 }
 
-static void CountMatchCnnct( TreeDataType *ptd, const int *bUserArrCnnct, int nPhoneSeq )
+static void CountMatchCnnct( TreeDataType *ptd, SeqBits bUserArrCnnct, int nPhoneSeq )
 {
 	RecordNode *p;
-	int i, k, sum;
+	int k, sum;
+	SeqBits cnnct = bUserArrCnnct & SeqBitRange( 1, nPhoneSeq );
 
 	for ( p = ptd->phList; p; p = p->next ) {
-		/* for each record, count its 'nMatchCnnct' */
-		for ( sum = 0, i = 1; i < nPhoneSeq; i++ ) {
-			if ( !bUserArrCnnct[ i ] )
-				continue;
-			/* check if matching 'cnnct' */
-			for ( k = 0; k < p->nInter; k++ ) {
-				if (
-					ptd->interval[ p->arrIndex[ k ] ].from < i &&
-					ptd->interval[ p->arrIndex[ k ] ].to > i ) {
-					sum++;
-					break;
-				}
-			}
+		/*
+		 * for each record, count its 'nMatchCnnct': the 'cnnct' inside its
+		 * intervals, which do not overlap
+		 */
+		for ( sum = 0, k = 0; cnnct && k < p->nInter; k++ ) {
+			sum += SeqBitCount( cnnct & SeqBitRange(
+				ptd->interval[ p->arrIndex[ k ] ].from + 1,
+				ptd->interval[ p->arrIndex[ k ] ].to ) );
 		}
 		p->nMatchCnnct = sum;
 	}
@@ -926,7 +1215,7 @@ int Phrasing( ChewingData *pgdata )
 		( treeData.phList )->nInter,
 		pgdata->phoneSeq,
 		pgdata->nPhoneSeq,
-		pgdata->selectStr, pgdata->selectInterval, pgdata->nSelect, &treeData );
+		pgdata->selectInterval, pgdata->nSelect, &treeData );
 	SaveDispInterval( &pgdata->phrOut, &treeData );
 
 	/* free "phrase" */
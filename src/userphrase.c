@@ -26,11 +26,14 @@
 static int LoadOriginalFreq( ChewingData *pgdata, const KeySeqWord phoneSeq[], const char wordSeq[], int len )
 {
 	const TreeType *tree_pos;
-	int retval;
+	int retval, i;
 	Phrase *phrase = ALC( Phrase, 1 );
 
-	tree_pos = TreeFindPhrase( pgdata, 0, len - 1, phoneSeq );
-	if ( tree_pos ) {
+	/* The first layer having the phrase gives its frequency. */
+	for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+		tree_pos = TreeFindPhrase( pgdata, i, 0, len - 1, phoneSeq );
+		if ( ! tree_pos )
+			continue;
 		GetPhraseFirst( pgdata, phrase, tree_pos );
 		do {
 			/* find the same phrase */
@@ -55,9 +58,12 @@ static int LoadMaxFreq( ChewingData *pgdata, const KeySeqWord phoneSeq[], int le
 	Phrase *phrase = ALC( Phrase, 1 );
 	int maxFreq = FREQ_INIT_VALUE;
 	UserPhraseData *uphrase;
+	int i;
 
-	tree_pos = TreeFindPhrase( pgdata, 0, len - 1, phoneSeq );
-	if ( tree_pos ) {
+	for ( i = 0; i < pgdata->static_data.nLayer; i++ ) {
+		tree_pos = TreeFindPhrase( pgdata, i, 0, len - 1, phoneSeq );
+		if ( ! tree_pos )
+			continue;
 		GetPhraseFirst( pgdata, phrase, tree_pos );
 		do {
 			if ( phrase->freq > maxFreq )
@@ -110,16 +116,25 @@ static int UpdateFreq( int freq, int maxfreq, int origfreq, int deltatime )
 	}
 }
 
+/*
+ * Learning updates of a user dictionary shared by several sessions are
+ * serialized. Frequencies are stored atomically, since sessions on other
+ * threads may be reading them meanwhile.
+ */
 int UserUpdatePhrase( ChewingData *pgdata, const KeySeqWord phoneSeq[], const char wordSeq[] )
 {
+	UserDict *dict = pgdata->static_data.userdict;
 	HASH_ITEM *pItem;
 	UserPhraseData data;
-	int len;
+	int len, lifetime, ret;
 
 	len = ueStrLen( wordSeq );
+	plat_mutex_lock( &dict->lock );
+	lifetime = plat_atomic_load_int( &dict->chewing_lifetime );
 	pItem = HashFindEntry( pgdata, phoneSeq, wordSeq );
 	if ( ! pItem ) {
 		if ( ! AlcUserPhraseSeq( &data, len, strlen( wordSeq ) ) ) {
+			plat_mutex_unlock( &dict->lock );
 			return USER_UPDATE_FAIL;
 		}
 
@@ -132,22 +147,25 @@ int UserUpdatePhrase( ChewingData *pgdata, const KeySeqWord phoneSeq[], const ch
 		data.maxfreq = LoadMaxFreq( pgdata, phoneSeq, len );
 
 		data.userfreq = data.origfreq;
-		data.recentTime = pgdata->static_data.chewing_lifetime;
+		data.recentTime = lifetime;
 		pItem = HashInsert( pgdata, &data );
 		HashModify( pgdata, pItem );
-		return USER_UPDATE_INSERT;
+		ret = USER_UPDATE_INSERT;
 	}
 	else {
-		pItem->data.maxfreq = LoadMaxFreq( pgdata, phoneSeq, len );
-		pItem->data.userfreq = UpdateFreq(
+		plat_atomic_store_int( &pItem->data.maxfreq,
+			LoadMaxFreq( pgdata, phoneSeq, len ) );
+		plat_atomic_store_int( &pItem->data.userfreq, UpdateFreq(
 			pItem->data.userfreq,
 			pItem->data.maxfreq,
 			pItem->data.origfreq,
-			pgdata->static_data.chewing_lifetime - pItem->data.recentTime );
-		pItem->data.recentTime = pgdata->static_data.chewing_lifetime;
+			lifetime - pItem->data.recentTime ) );
+		plat_atomic_store_int( &pItem->data.recentTime, lifetime );
 		HashModify( pgdata, pItem );
-		return USER_UPDATE_MODIFY;
+		ret = USER_UPDATE_MODIFY;
 	}
+	plat_mutex_unlock( &dict->lock );
+	return ret;
 }
 
 UserPhraseData *UserGetPhraseFirst( ChewingData *pgdata, const KeySeqWord phoneSeq[] )
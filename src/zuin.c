@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "zuin-private.h"
+#include "chewing-utf8-util.h"
 #include "dict-private.h"
 #include "key2pho-private.h"
 #include "pinyin-private.h"
@@ -743,3 +744,104 @@ int ZuinIsEntering( ZuinData *pZuin )
 	}
 	return 0;
 }
+
+/*
+ * Add a confusion class given by a string of zuin symbols of the same kind,
+ * such as initials or finals. Classes sharing a symbol are merged.
+ */
+int FuzzyAddPhoneClass( FuzzyData *pFuzzy, const char *zuin )
+{
+	char buf[ MAX_UTF8_SIZE + 1 ];
+	int ph_inx[ ZUIN_SIZE ];
+	int sym[ 32 ];
+	int nSym = 0, type = -1, cls = 0, old, i, j;
+	const char *p;
+
+	for ( p = zuin; *p; p += ueBytesFromChar( *p ) ) {
+		ueStrNCpy( buf, p, 1, STRNCPY_CLOSE );
+		PhoneInxFromUint( ph_inx, UintFromPhone( buf ) );
+		for ( i = 0; i < ZUIN_SIZE && ph_inx[ i ] == 0; i++ )
+			;
+		if ( i == ZUIN_SIZE || ( type >= 0 && type != i ) || nSym >= 32 )
+			return -1;
+		type = i;
+		sym[ nSym++ ] = ph_inx[ i ];
+	}
+	if ( nSym < 2 )
+		return -1;
+
+	for ( i = 0; i < nSym && !cls; i++ )
+		cls = pFuzzy->phoneClass[ type ][ sym[ i ] ];
+	if ( !cls ) {
+		if ( pFuzzy->nClass >= 255 )
+			return -1;
+		cls = ++pFuzzy->nClass;
+	}
+
+	for ( i = 0; i < nSym; i++ ) {
+		old = pFuzzy->phoneClass[ type ][ sym[ i ] ];
+		if ( old && old != cls ) {
+			for ( j = 0; j < 32; j++ )
+				if ( pFuzzy->phoneClass[ type ][ j ] == old )
+					pFuzzy->phoneClass[ type ][ j ] = cls;
+		}
+		pFuzzy->phoneClass[ type ][ sym[ i ] ] = cls;
+	}
+	return 0;
+}
+
+void FuzzyClearPhoneClass( FuzzyData *pFuzzy )
+{
+	memset( pFuzzy->phoneClass, 0, sizeof( pFuzzy->phoneClass ) );
+	pFuzzy->nClass = 0;
+}
+
+/* Default classes are ㄣ/ㄥ, ㄓ/ㄗ, ㄔ/ㄘ and ㄕ/ㄙ. Fuzzy matching is off. */
+void InitFuzzyPhone( FuzzyData *pFuzzy )
+{
+	static const char * const DEFAULT_CLASS[] = {
+		"\xE3\x84\xA3\xE3\x84\xA5",	/* ㄣㄥ */
+		"\xE3\x84\x93\xE3\x84\x97",	/* ㄓㄗ */
+		"\xE3\x84\x94\xE3\x84\x98",	/* ㄔㄘ */
+		"\xE3\x84\x95\xE3\x84\x99",	/* ㄕㄙ */
+	};
+	size_t i;
+
+	pFuzzy->bFuzzy = 0;
+	FuzzyClearPhoneClass( pFuzzy );
+	for ( i = 0; i < ARRAY_SIZE( DEFAULT_CLASS ); i++ )
+		FuzzyAddPhoneClass( pFuzzy, DEFAULT_CLASS[ i ] );
+}
+
+/*
+ * Enumerate phones confusable with the given one. The phone itself always
+ * comes first, and cost[] gives how many symbols are replaced.
+ */
+int FuzzyPhoneAlt( const FuzzyData *pFuzzy, KeySeqWord phone, KeySeqWord alt[], int cost[] )
+{
+	int ph_inx[ ZUIN_SIZE ], alt_inx[ ZUIN_SIZE ];
+	int nAlt = 1, nPrev, i, j, k, cls;
+
+	alt[ 0 ] = phone;
+	cost[ 0 ] = 0;
+	PhoneInxFromUint( ph_inx, phone );
+
+	for ( i = 0; i < ZUIN_SIZE; i++ ) {
+		cls = ph_inx[ i ] ? pFuzzy->phoneClass[ i ][ ph_inx[ i ] ] : 0;
+		if ( !cls )
+			continue;
+		nPrev = nAlt;
+		for ( j = 0; j < 32; j++ ) {
+			if ( j == ph_inx[ i ] || pFuzzy->phoneClass[ i ][ j ] != cls )
+				continue;
+			for ( k = 0; k < nPrev && nAlt < MAX_FUZZY_ALT; k++ ) {
+				PhoneInxFromUint( alt_inx, alt[ k ] );
+				alt_inx[ i ] = j;
+				alt[ nAlt ] = UintFromPhoneInx( alt_inx );
+				cost[ nAlt ] = cost[ k ] + 1;
+				nAlt++;
+			}
+		}
+	}
+	return nAlt;
+}
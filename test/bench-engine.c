@@ -0,0 +1,119 @@
+/**
+ * bench-engine.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+/**
+ * Measure how keystroke throughput scales with the number of sessions of one
+ * engine handled on separated threads.
+ *
+ * Usage: bench-engine [max thread number] [loops per thread]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "chewing.h"
+#include "plat_thread.h"
+
+/* 中文輸入法 */
+static const char KEYS[] = "5j/ jp6j/4u04cj8 ";
+
+typedef struct {
+	ChewingContext *ctx;
+	int loop;
+} BenchThread;
+
+static double Now()
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *TypeKeys( void *arg )
+{
+	BenchThread *bt = (BenchThread *) arg;
+	int i;
+
+	for ( i = 0; i < bt->loop; i++ ) {
+		chewing_handle_String( bt->ctx, KEYS );
+		chewing_handle_Enter( bt->ctx );
+	}
+	return NULL;
+}
+
+int main( int argc, char *argv[] )
+{
+	ChewingEngine *engine;
+	BenchThread *bt;
+	plat_thread *thread;
+	int max_thread;
+	int loop;
+	int n;
+	int i;
+	double begin;
+	double elapsed;
+	double rate;
+	double base = 0;
+
+	max_thread = argc > 1 ? atoi( argv[ 1 ] ) : plat_thread_cpu_count();
+	loop = argc > 2 ? atoi( argv[ 2 ] ) : 2000;
+	if ( max_thread < 1 || loop < 1 ) {
+		fprintf( stderr, "Usage: %s [max thread number] [loops per thread]\n", argv[ 0 ] );
+		return 1;
+	}
+
+	engine = chewing_engine_new();
+	if ( !engine ) {
+		fprintf( stderr, "Cannot create engine\n" );
+		return 1;
+	}
+
+	bt = calloc( max_thread, sizeof( *bt ) );
+	thread = calloc( max_thread, sizeof( *thread ) );
+	if ( !bt || !thread ) {
+		fprintf( stderr, "Out of memory\n" );
+		return 1;
+	}
+
+	printf( "threads  keys/s        speedup\n" );
+	for ( n = 1; n <= max_thread; n++ ) {
+		for ( i = 0; i < n; i++ ) {
+			bt[ i ].ctx = chewing_engine_new_session( engine, NULL );
+			bt[ i ].loop = loop;
+		}
+
+		begin = Now();
+		for ( i = 0; i < n; i++ )
+			plat_thread_create( &thread[ i ], TypeKeys, &bt[ i ] );
+		for ( i = 0; i < n; i++ )
+			plat_thread_join( thread[ i ] );
+		elapsed = Now() - begin;
+
+		rate = (double) n * loop * ( sizeof( KEYS ) - 1 ) / elapsed;
+		if ( n == 1 )
+			base = rate;
+		printf( "%7d  %12.0f  %7.2f\n", n, rate, rate / base );
+
+		for ( i = 0; i < n; i++ )
+			chewing_delete( bt[ i ].ctx );
+	}
+
+	free( thread );
+	free( bt );
+	chewing_engine_delete( engine );
+	return 0;
+}
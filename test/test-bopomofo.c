@@ -134,10 +134,96 @@ void test_select_candidate_4_bytes_utf8()
 	chewing_delete( ctx );
 }
 
+void test_select_candidate_no_duplicate()
+{
+	ChewingContext *ctx;
+	char *buf;
+	int count;
+
+	remove( TEST_HASH_DIR PLAT_SEPARATOR HASH_FILE );
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	/* Selecting 中國 stores it as a user phrase beside the dict one. */
+	type_keystroke_by_string( ctx, "5j/ eji6<H><D>1" ); /* ㄓㄨㄥ ㄍㄨㄛˊ */
+	ok_preedit_buffer( ctx, "\xE4\xB8\xAD\xE5\x9C\x8B" /* 中國 */ );
+
+	type_keystroke_by_string( ctx, "<D>" );
+	count = 0;
+	chewing_cand_Enumerate( ctx );
+	while ( chewing_cand_hasNext( ctx ) ) {
+		buf = chewing_cand_String( ctx );
+		if ( ! strcmp( buf, "\xE4\xB8\xAD\xE5\x9C\x8B" ) )
+			count++;
+		chewing_free( buf );
+	}
+	ok( count == 1, "`\xE4\xB8\xAD\xE5\x9C\x8B' shall be listed once, but listed %d times", count );
+
+	chewing_delete( ctx );
+}
+
+void test_select_candidate_repeatedly()
+{
+	ChewingContext *ctx;
+	int i;
+
+	remove( TEST_HASH_DIR PLAT_SEPARATOR HASH_FILE );
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	type_keystroke_by_string( ctx, "5j/ eji6<H>" ); /* ㄓㄨㄥ ㄍㄨㄛˊ */
+	/* Every selection replaces the previous one of the same interval. */
+	for ( i = 0; i < 64; i++ )
+		type_keystroke_by_string( ctx, "<D>1" );
+	ok_preedit_buffer( ctx, "\xE4\xB8\xAD\xE5\x9C\x8B" /* 中國 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_select_candidate_stream()
+{
+	ChewingContext *ctx;
+	char *buf;
+	int count, total, page;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+	chewing_set_candPerPage( ctx, 2 );
+
+	type_keystroke_by_string( ctx, "5j/ <D>" ); /* ㄓㄨㄥ */
+
+	/* Walking from the first page lists every candidate. */
+	count = 0;
+	chewing_cand_Enumerate( ctx );
+	while ( chewing_cand_hasNext( ctx ) ) {
+		buf = chewing_cand_String( ctx );
+		chewing_free( buf );
+		count++;
+	}
+	total = chewing_cand_TotalChoice( ctx );
+	ok( count == total, "enumerated `%d' shall be `%d'", count, total );
+	page = chewing_cand_TotalPage( ctx );
+	ok( page == ( total + 1 ) / 2, "total page `%d' shall be `%d'", page, ( total + 1 ) / 2 );
+
+	type_keystroke_by_string( ctx, "<L>" );
+	page = chewing_cand_CurrentPage( ctx );
+	ok( page == chewing_cand_TotalPage( ctx ) - 1, "current page `%d' shall be the last page", page );
+	type_keystroke_by_string( ctx, "<R>" );
+	page = chewing_cand_CurrentPage( ctx );
+	ok( page == 0, "current page `%d' shall be 0", page );
+
+	chewing_delete( ctx );
+}
+
 void test_select_candidate() {
 	test_select_candidate_no_phrase_choice_rearward();
 	test_select_candidate_phrase_choice_rearward();
 	test_select_candidate_4_bytes_utf8();
+	test_select_candidate_no_duplicate();
+	test_select_candidate_repeatedly();
+	test_select_candidate_stream();
 }
 
 void test_Esc_not_entering_chewing()
@@ -656,6 +742,326 @@ void test_zuin_buffer()
 	chewing_delete( ctx );
 }
 
+void test_predict()
+{
+	ChewingContext *ctx;
+	char *buf;
+	int found = 0;
+
+	ctx = chewing_new();
+
+	chewing_predict_Enumerate( ctx );
+	ok( !chewing_predict_hasNext( ctx ), "empty buffer shall have no prediction" );
+
+	type_keystroke_by_string( ctx, "hk4g4" ); /* ㄘㄜˋㄕˋ */
+	chewing_predict_Enumerate( ctx );
+	ok( chewing_predict_PrefixLen( ctx ) == 2, "prediction prefix shall be `2'" );
+	while ( chewing_predict_hasNext( ctx ) ) {
+		buf = chewing_predict_String( ctx );
+		if ( !strcmp( buf, "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ ) )
+			found = 1;
+		chewing_free( buf );
+	}
+	ok( found, "prediction shall contain `\xE6\xB8\xAC\xE8\xA9\xA6'" );
+
+	chewing_delete( ctx );
+}
+
+void test_fuzzy_phone()
+{
+	ChewingContext *ctx;
+	char *buf;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	ok( chewing_get_fuzzyPhone( ctx ) == 0, "fuzzy phone shall be disabled by default" );
+	ok( chewing_add_fuzzyPhoneClass( ctx, "\xE3\x84\x88\xE3\x84\x8F" /* ㄈㄏ */ ) == 0,
+		"class of initials shall be accepted" );
+	ok( chewing_add_fuzzyPhoneClass( ctx, "\xE3\x84\x88\xE3\x84\xA5" /* ㄈㄥ */ ) == -1,
+		"class of mixed kinds shall be rejected" );
+	ok( chewing_add_fuzzyPhoneClass( ctx, "\xE3\x84\x88" /* ㄈ */ ) == -1,
+		"class of one symbol shall be rejected" );
+
+	chewing_set_fuzzyPhone( ctx, 1 );
+	type_keystroke_by_string( ctx, "yj/ jp6" ); /* ㄗㄨㄥ ㄨㄣˊ */
+	ok_preedit_buffer( ctx, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ );
+
+	chewing_Reset( ctx );
+	ok( chewing_get_fuzzyPhone( ctx ) == 1, "fuzzy phone shall be kept after reset" );
+
+	chewing_clear_fuzzyPhoneClass( ctx );
+	type_keystroke_by_string( ctx, "yj/ jp6" ); /* ㄗㄨㄥ ㄨㄣˊ */
+	buf = chewing_buffer_String( ctx );
+	ok( strcmp( buf, "\xE4\xB8\xAD\xE6\x96\x87" ) != 0,
+		"preedit shall not be `\xE4\xB8\xAD\xE6\x96\x87' without classes" );
+	chewing_free( buf );
+
+	chewing_delete( ctx );
+}
+
+void test_handle_String()
+{
+	ChewingContext *ctx;
+	IntervalType it;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	ok( chewing_handle_String( ctx, "hk4g4" ) == 5, "all keys shall be handled" );
+	ok_preedit_buffer( ctx, "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ );
+
+	/* inserts a breakpoint between 測 and 試 */
+	ok( chewing_handle_String( ctx, "<L><T>" ) == 6, "all keys shall be handled" );
+	chewing_interval_Enumerate( ctx );
+	ok( chewing_interval_hasNext( ctx ) == 1, "shall have next interval" );
+	chewing_interval_Get( ctx, &it );
+	ok( it.from == 0 && it.to == 1, "interval (%d, %d) shall be (0, 1)",
+		it.from, it.to );
+	ok( chewing_interval_hasNext( ctx ) == 1, "shall have next interval" );
+	chewing_interval_Get( ctx, &it );
+	ok( it.from == 1 && it.to == 2, "interval (%d, %d) shall be (1, 2)",
+		it.from, it.to );
+	ok( chewing_interval_hasNext( ctx ) == 0, "shall not have next interval" );
+
+	chewing_delete( ctx );
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	/* handling stops right after the commit */
+	ok( chewing_handle_String( ctx, "5j/ jp6<E>hk4" ) == 10,
+		"keys after commit shall not be handled" );
+	ok_keystroke_rtn( ctx, KEYSTROKE_COMMIT );
+	ok_commit_buffer( ctx, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ );
+	ok_preedit_buffer( ctx, "" );
+
+	ok( chewing_handle_String( ctx, "hk4<X>g4" ) == 3,
+		"keys after malformed escape shall not be handled" );
+	ok_preedit_buffer( ctx, "\xE6\xB8\xAC" /* 測 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_handle_KeyArray()
+{
+	static const int keys[] = {
+		'h', 'k', '4', 'g', '4', CHEWING_KEY_LEFT, CHEWING_KEY_DOWN, '1',
+	};
+	ChewingContext *ctx;
+	ChewingContext *expected;
+	char *buf;
+	char *expected_buf;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+	expected = chewing_new();
+	chewing_set_maxChiSymbolLen( expected, 16 );
+
+	ok( chewing_handle_KeyArray( ctx, keys, ARRAY_SIZE( keys ) ) == ARRAY_SIZE( keys ),
+		"all keys shall be handled" );
+	type_keystroke_by_string( expected, "hk4g4<L><D>1" );
+
+	buf = chewing_buffer_String( ctx );
+	expected_buf = chewing_buffer_String( expected );
+	ok( strcmp( buf, expected_buf ) == 0, "`%s' shall be `%s'", buf, expected_buf );
+	chewing_free( buf );
+	chewing_free( expected_buf );
+	ok( chewing_cursor_Current( ctx ) == chewing_cursor_Current( expected ),
+		"cursor `%d' shall be `%d'",
+		chewing_cursor_Current( ctx ), chewing_cursor_Current( expected ) );
+
+	/* the message of the last key is kept */
+	ok( chewing_handle_String( ctx, "<H><C2>" ) == 7, "all keys shall be handled" );
+	ok( chewing_aux_Check( ctx ) == 1, "aux message shall be shown" );
+
+	chewing_delete( expected );
+	chewing_delete( ctx );
+}
+
+void test_lazy_phrasing()
+{
+	ChewingContext *ctx;
+	IntervalType it;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	ok( chewing_get_lazyPhrasing( ctx ) == 0, "lazy phrasing shall be disabled by default" );
+	chewing_set_lazyPhrasing( ctx, 1 );
+
+	type_keystroke_by_string( ctx, "hk4g4" );
+	ok_preedit_buffer( ctx, "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ );
+
+	/* inserts a breakpoint between 測 and 試 */
+	type_keystroke_by_string( ctx, "<L><T>" );
+	chewing_interval_Enumerate( ctx );
+	ok( chewing_interval_hasNext( ctx ) == 1, "shall have next interval" );
+	chewing_interval_Get( ctx, &it );
+	ok( it.from == 0 && it.to == 1, "interval (%d, %d) shall be (0, 1)",
+		it.from, it.to );
+	ok( chewing_interval_hasNext( ctx ) == 1, "shall have next interval" );
+	chewing_interval_Get( ctx, &it );
+	ok( it.from == 1 && it.to == 2, "interval (%d, %d) shall be (1, 2)",
+		it.from, it.to );
+	ok( chewing_interval_hasNext( ctx ) == 0, "shall not have next interval" );
+
+	chewing_Reset( ctx );
+	ok( chewing_get_lazyPhrasing( ctx ) == 1, "lazy phrasing shall be kept after reset" );
+
+	type_keystroke_by_string( ctx, "5j/ jp6<H><C2>" );
+	ok( chewing_aux_Check( ctx ) == 1, "aux message shall be shown" );
+	chewing_set_lazyPhrasing( ctx, 0 );
+	ok_preedit_buffer( ctx, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_String_static()
+{
+	ChewingContext *ctx;
+	const char *s;
+	char *buf;
+	int len;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	type_keystroke_by_string( ctx, "hk4g" );
+	s = chewing_buffer_String_static( ctx, &len );
+	ok( strcmp( s, "\xE6\xB8\xAC" /* 測 */ ) == 0 && len == 3,
+		"buffer `%s' (%d) shall be `\xE6\xB8\xAC' (3)", s, len );
+	s = chewing_zuin_String_static( ctx, &len );
+	ok( strcmp( s, "\xE3\x84\x95" /* ㄕ */ ) == 0 && len == 3,
+		"zuin `%s' (%d) shall be `\xE3\x84\x95' (3)", s, len );
+
+	type_keystroke_by_string( ctx, "4<D>" );
+	chewing_cand_Enumerate( ctx );
+	buf = chewing_cand_String( ctx );
+	chewing_cand_Enumerate( ctx );
+	s = chewing_cand_String_static( ctx, &len );
+	ok( strcmp( s, buf ) == 0 && len == (int) strlen( buf ),
+		"candidate `%s' (%d) shall be `%s'", s, len, buf );
+	chewing_free( buf );
+
+	type_keystroke_by_string( ctx, "<EE><B><B>5j/ jp6<E>" );
+	s = chewing_commit_String_static( ctx, &len );
+	ok( strcmp( s, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ ) == 0 && len == 6,
+		"commit `%s' (%d) shall be `\xE4\xB8\xAD\xE6\x96\x87' (6)", s, len );
+	ok( strcmp( chewing_aux_String_static( ctx, NULL ), "" ) == 0, "aux shall be empty" );
+
+	chewing_delete( ctx );
+}
+
+void test_snapshot_restore()
+{
+	ChewingContext *ctx, *ctx2;
+	char buf[ 512 ], buf2[ 512 ];
+	char *s, *s2;
+	int len, len2;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+	chewing_set_candPerPage( ctx, 7 );
+
+	/* 中文, a symbol, 測 replaced by its second candidate, and a pending ㄕ */
+	type_keystroke_by_string( ctx, "5j/ jp6" );
+	chewing_set_ChiEngMode( ctx, SYMBOL_MODE );
+	type_keystroke_by_string( ctx, "a" );
+	chewing_set_ChiEngMode( ctx, CHINESE_MODE );
+	type_keystroke_by_string( ctx, "hk4<L><D>2g" );
+
+	len = chewing_snapshot( ctx, NULL, 0 );
+	ok( len > 0 && len <= (int) sizeof( buf ), "snapshot size %d shall fit", len );
+	ok( chewing_snapshot( ctx, buf, sizeof( buf ) ) == len, "snapshot size shall not change" );
+
+	ctx2 = chewing_new();
+	ok( chewing_restore( ctx2, buf, len ) == 0, "chewing_restore shall succeed" );
+
+	s = chewing_buffer_String( ctx );
+	ok_preedit_buffer( ctx2, s );
+	chewing_free( s );
+	s = chewing_zuin_String( ctx, NULL );
+	ok_zuin_buffer( ctx2, s );
+	chewing_free( s );
+	ok( chewing_cursor_Current( ctx2 ) == chewing_cursor_Current( ctx ),
+		"cursor shall be restored" );
+	ok( chewing_get_candPerPage( ctx2 ) == 7, "candPerPage shall be restored" );
+
+	/* Both shall go on in the same way. */
+	type_keystroke_by_string( ctx, "4<L><L>" );
+	type_keystroke_by_string( ctx2, "4<L><L>" );
+	s = chewing_buffer_String( ctx );
+	ok_preedit_buffer( ctx2, s );
+	chewing_free( s );
+	len = chewing_snapshot( ctx, buf, sizeof( buf ) );
+	len2 = chewing_snapshot( ctx2, buf2, sizeof( buf2 ) );
+	ok( len == len2 && memcmp( buf, buf2, len ) == 0, "snapshots shall be the same" );
+
+	/* A broken snapshot shall leave the context untouched. */
+	s = chewing_buffer_String( ctx2 );
+	ok( chewing_restore( ctx2, buf, len - 1 ) == -1, "truncated snapshot shall be rejected" );
+	buf[ 0 ] = 'X';
+	ok( chewing_restore( ctx2, buf, len ) == -1, "bad magic shall be rejected" );
+	s2 = chewing_buffer_String( ctx2 );
+	ok( strcmp( s, s2 ) == 0, "buffer `%s' shall be kept as `%s'", s2, s );
+	chewing_free( s );
+	chewing_free( s2 );
+
+	chewing_delete( ctx );
+	chewing_delete( ctx2 );
+}
+
+void test_output_Diff()
+{
+	ChewingContext *ctx;
+	OutputDiffType diff;
+
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	ok( chewing_output_Diff( ctx, &diff ) == 0, "new context shall have no change" );
+
+	type_keystroke_by_string( ctx, "hk" );
+	ok( chewing_output_Diff( ctx, &diff ) == 1, "zuin input shall be a change" );
+	ok( diff.zuinChanged == 1, "zuin shall change" );
+	ok( diff.bufferFrom == 0 && diff.bufferTo == 0 && diff.bufferOldTo == 0,
+		"buffer range (%d, %d, %d) shall be empty",
+		diff.bufferFrom, diff.bufferTo, diff.bufferOldTo );
+
+	type_keystroke_by_string( ctx, "4g4" );
+	chewing_output_Diff( ctx, &diff );
+	ok( diff.bufferFrom == 0 && diff.bufferTo == 2 && diff.bufferOldTo == 0,
+		"buffer range (%d, %d, %d) shall be (0, 2, 0)",
+		diff.bufferFrom, diff.bufferTo, diff.bufferOldTo );
+	ok( diff.cursorChanged == 1 && diff.intervalChanged == 1,
+		"cursor and interval shall change" );
+
+	/* 5j/ (中) appended after 測試 */
+	type_keystroke_by_string( ctx, "5j/ " );
+	chewing_output_Diff( ctx, &diff );
+	ok( diff.bufferFrom >= 1 && diff.bufferTo == 3 && diff.bufferOldTo == 2,
+		"buffer range (%d, %d, %d) shall end at (3, 2)",
+		diff.bufferFrom, diff.bufferTo, diff.bufferOldTo );
+
+	type_keystroke_by_string( ctx, "<L>" );
+	chewing_output_Diff( ctx, &diff );
+	ok( diff.bufferFrom == diff.bufferTo && diff.bufferFrom == diff.bufferOldTo,
+		"buffer shall not change" );
+	ok( diff.cursorChanged == 1 && diff.candChanged == 0, "only cursor shall change" );
+
+	type_keystroke_by_string( ctx, "<D>" );
+	chewing_output_Diff( ctx, &diff );
+	ok( diff.candChanged == 1, "candidate window shall open" );
+	ok( chewing_output_Diff( ctx, &diff ) == 0, "repeated call shall have no change" );
+
+	type_keystroke_by_string( ctx, "<R>" );
+	chewing_output_Diff( ctx, &diff );
+	ok( diff.candChanged == 1, "candidate page shall change" );
+
+	chewing_delete( ctx );
+}
+
 int main()
 {
 	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
@@ -679,6 +1085,14 @@ int main()
 
 	test_get_phoneSeq();
 	test_zuin_buffer();
+	test_predict();
+	test_fuzzy_phone();
+	test_handle_String();
+	test_handle_KeyArray();
+	test_lazy_phrasing();
+	test_String_static();
+	test_output_Diff();
+	test_snapshot_restore();
 
 	return exit_status();
 }
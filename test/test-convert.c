@@ -0,0 +1,105 @@
+/**
+ * test-convert.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chewing.h"
+#include "testhelper.h"
+
+static const char CHINESE[] = "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */;
+
+#define ok_convert( result, expected ) \
+	do { \
+		char *_result = ( result ); \
+		ok( _result && strcmp( _result, ( expected ) ) == 0, \
+			"conversion `%s' shall be `%s'", _result ? _result : "(null)", ( expected ) ); \
+		chewing_free( _result ); \
+	} while ( 0 )
+
+void test_convert_Bopomofo()
+{
+	ChewingContext *ctx;
+
+	ctx = chewing_new();
+
+	ok_convert( chewing_convert_Bopomofo( ctx,
+		"\xE3\x84\x93\xE3\x84\xA8\xE3\x84\xA5 \xE3\x84\xA8\xE3\x84\xA3\xCB\x8A" /* ㄓㄨㄥ ㄨㄣˊ */ ),
+		CHINESE );
+	ok_convert( chewing_convert_Bopomofo( ctx, "" ), "" );
+
+	/* Anything else is copied as is, and breaks the phrase. */
+	ok_convert( chewing_convert_Bopomofo( ctx,
+		"\xE3\x84\x93\xE3\x84\xA8\xE3\x84\xA5 , \xE3\x84\xA8\xE3\x84\xA3\xCB\x8A" /* ㄓㄨㄥ , ㄨㄣˊ */ ),
+		"\xE4\xB8\xAD,\xE6\x96\x87" /* 中,文 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_convert_Keystroke()
+{
+	ChewingContext *ctx;
+
+	ctx = chewing_new();
+
+	ok_convert( chewing_convert_Keystroke( ctx, "5j/ jp6" ), CHINESE );
+	ok_convert( chewing_convert_Keystroke( ctx, "hk4g4" ),
+		"\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_convert_keep_editing_state()
+{
+	ChewingContext *ctx;
+
+	ctx = chewing_new();
+	type_keystroke_by_string( ctx, "hk4g4" );
+	ok_convert( chewing_convert_Keystroke( ctx, "5j/ jp6" ), CHINESE );
+	ok_preedit_buffer( ctx, "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ );
+	chewing_delete( ctx );
+}
+
+void test_convert_long_sequence()
+{
+	ChewingContext *ctx;
+	char keys[ 100 * 7 + 1 ];
+	char expected[ 100 * sizeof( CHINESE ) ];
+	int i;
+
+	/* longer than the preedit buffer */
+	keys[ 0 ] = '\0';
+	expected[ 0 ] = '\0';
+	for ( i = 0; i < 100; i++ ) {
+		strcat( keys, "5j/ jp6" );
+		strcat( expected, CHINESE );
+	}
+
+	ctx = chewing_new();
+	ok_convert( chewing_convert_Keystroke( ctx, keys ), expected );
+	chewing_delete( ctx );
+}
+
+int main()
+{
+	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
+	putenv( "CHEWING_USER_PATH=" TEST_HASH_DIR );
+
+	test_convert_Bopomofo();
+	test_convert_Keystroke();
+	test_convert_keep_editing_state();
+	test_convert_long_sequence();
+
+	return exit_status();
+}
@@ -0,0 +1,234 @@
+/**
+ * test-dict-layer.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chewing.h"
+#include "plat_types.h"
+#include "plat_path.h"
+#include "hash-private.h"
+#include "testhelper.h"
+
+#define PROFILE TEST_HASH_DIR PLAT_SEPARATOR "dict-layer"
+
+/* Layers built from layer-data by init_database, see Makefile.am. */
+#define LAYER_A TEST_HASH_DIR PLAT_SEPARATOR "layer-a"
+#define LAYER_B TEST_HASH_DIR PLAT_SEPARATOR "layer-b"
+
+static const char PHRASE[] = "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */;
+/* Only in layer A, as frequent as LAYER_B_PHRASE */
+static const char LAYER_A_PHRASE[] = "\xE5\x86\x8A\xE5\x86\x8A" /* 冊冊 */;
+/* Only in layer B */
+static const char LAYER_B_PHRASE[] = "\xE7\xAD\x96\xE7\xAD\x96" /* 策策 */;
+/* In layer A, more frequent than PHRASE of the same phones */
+static const char LAYER_A_FREQUENT[] = "\xE5\x86\x8A\xE5\xB8\x82" /* 冊市 */;
+
+static const char *KEYSTROKE[] = {
+	"hk4g4<H><D>",	/* phrase candidates */
+	"hk4<H><D>",	/* character candidates */
+	"5j/ jp6<H><D>",
+};
+
+/* Number of candidates listed for each of KEYSTROKE. */
+static void count_candidate( ChewingEngine *engine, int count[] )
+{
+	ChewingContext *ctx;
+	size_t i;
+
+	for ( i = 0; i < ARRAY_SIZE( KEYSTROKE ); i++ ) {
+		ctx = chewing_engine_new_session( engine, PROFILE );
+		type_keystroke_by_string( ctx, (char *) KEYSTROKE[ i ] );
+		count[ i ] = chewing_cand_TotalChoice( ctx );
+		chewing_delete( ctx );
+	}
+}
+
+void test_layer_same_dictionary()
+{
+	ChewingEngine *engine;
+	ChewingContext *ctx;
+	int count[ ARRAY_SIZE( KEYSTROKE ) ];
+	int layer_count[ ARRAY_SIZE( KEYSTROKE ) ];
+	size_t i;
+
+	engine = chewing_engine_new();
+	count_candidate( engine, count );
+	chewing_engine_delete( engine );
+
+	/* The system dictionary stacked over itself changes nothing. */
+	putenv( "CHEWING_DICT_PATH=" CHEWING_DATA_PREFIX );
+	engine = chewing_engine_new();
+	ok( engine != NULL, "chewing_engine_new shall not return NULL" );
+
+	ctx = chewing_engine_new_session( engine, PROFILE );
+	type_keystroke_by_string( ctx, "hk4g4" );
+	ok_preedit_buffer( ctx, PHRASE );
+	chewing_delete( ctx );
+
+	count_candidate( engine, layer_count );
+	for ( i = 0; i < ARRAY_SIZE( KEYSTROKE ); i++ ) {
+		ok( count[ i ] > 0 && layer_count[ i ] == count[ i ],
+			"`%s' shall list %d candidates as without the layer",
+			KEYSTROKE[ i ], count[ i ] );
+	}
+
+	chewing_engine_delete( engine );
+}
+
+/* Number of times cand is listed, and its position in *pos, -1 if not listed. */
+static int find_candidate( ChewingContext *ctx, const char *cand, int *pos )
+{
+	int i, count = 0;
+	char *buf;
+
+	*pos = -1;
+	chewing_cand_Enumerate( ctx );
+	for ( i = 0; chewing_cand_hasNext( ctx ); i++ ) {
+		buf = chewing_cand_String( ctx );
+		if ( strcmp( buf, cand ) == 0 ) {
+			if ( count++ == 0 )
+				*pos = i;
+		}
+		chewing_free( buf );
+	}
+	return count;
+}
+
+void test_layer_new_phrase()
+{
+	ChewingContext *ctx;
+	int pos;
+
+	putenv( "CHEWING_DICT_PATH=" LAYER_A );
+	ctx = chewing_new();
+	ok( ctx != NULL, "chewing_new shall not return NULL" );
+
+	/* A phrase absent from the system dictionary is found in the layer. */
+	type_keystroke_by_string( ctx, "hk4hk4" );
+	ok_preedit_buffer( ctx, LAYER_A_PHRASE );
+	type_keystroke_by_string( ctx, "<H><D>" );
+	ok( find_candidate( ctx, LAYER_A_PHRASE, &pos ) == 1 && pos == 0,
+		"`%s' shall be listed once as the first candidate", LAYER_A_PHRASE );
+
+	chewing_delete( ctx );
+}
+
+void test_layer_merge_order()
+{
+	ChewingContext *ctx;
+	int pos, pos_frequent;
+
+	putenv( "CHEWING_DICT_PATH=" LAYER_A );
+	ctx = chewing_new();
+
+	/* The layer is more frequent, and its copy of PHRASE is listed once. */
+	type_keystroke_by_string( ctx, "hk4g4" );
+	ok_preedit_buffer( ctx, LAYER_A_FREQUENT );
+	type_keystroke_by_string( ctx, "<H><D>" );
+	ok( find_candidate( ctx, LAYER_A_FREQUENT, &pos_frequent ) == 1 && pos_frequent == 0,
+		"`%s' shall be listed once as the first candidate", LAYER_A_FREQUENT );
+	ok( find_candidate( ctx, PHRASE, &pos ) == 1 && pos > pos_frequent,
+		"`%s' shall be listed once after `%s'", PHRASE, LAYER_A_FREQUENT );
+
+	chewing_delete( ctx );
+}
+
+void test_layer_tie_order()
+{
+	ChewingContext *ctx;
+	int pos_a, pos_b;
+
+	/* Phrases of the same frequency are listed in the order of layers. */
+	putenv( "CHEWING_DICT_PATH=" LAYER_A SEARCH_PATH_SEP LAYER_B );
+	ctx = chewing_new();
+	type_keystroke_by_string( ctx, "hk4hk4" );
+	ok_preedit_buffer( ctx, LAYER_A_PHRASE );
+	type_keystroke_by_string( ctx, "<H><D>" );
+	find_candidate( ctx, LAYER_A_PHRASE, &pos_a );
+	find_candidate( ctx, LAYER_B_PHRASE, &pos_b );
+	ok( pos_a == 0 && pos_b == 1, "`%s' shall be followed by `%s'",
+		LAYER_A_PHRASE, LAYER_B_PHRASE );
+	chewing_delete( ctx );
+
+	putenv( "CHEWING_DICT_PATH=" LAYER_B SEARCH_PATH_SEP LAYER_A );
+	ctx = chewing_new();
+	type_keystroke_by_string( ctx, "hk4hk4" );
+	ok_preedit_buffer( ctx, LAYER_B_PHRASE );
+	type_keystroke_by_string( ctx, "<H><D>" );
+	find_candidate( ctx, LAYER_A_PHRASE, &pos_a );
+	find_candidate( ctx, LAYER_B_PHRASE, &pos_b );
+	ok( pos_b == 0 && pos_a == 1, "`%s' shall be followed by `%s'",
+		LAYER_B_PHRASE, LAYER_A_PHRASE );
+	chewing_delete( ctx );
+}
+
+void test_layer_fuzzy_system_phrase()
+{
+	ChewingContext *ctx;
+
+	putenv( "CHEWING_DICT_PATH=" LAYER_A );
+	ctx = chewing_new();
+	chewing_set_maxChiSymbolLen( ctx, 16 );
+
+	/*
+	 * Layer A has a word for each initial of the class followed by ㄨㄥ, so
+	 * that its fuzzy paths alone outnumber the beam of both layers.
+	 */
+	chewing_clear_fuzzyPhoneClass( ctx );
+	ok( chewing_add_fuzzyPhoneClass( ctx,
+		"\xE3\x84\x89\xE3\x84\x8A\xE3\x84\x8B\xE3\x84\x8C\xE3\x84\x8D\xE3\x84\x8E"
+		"\xE3\x84\x8F\xE3\x84\x93\xE3\x84\x97\xE3\x84\x98\xE3\x84\x99"
+		/* ㄉㄊㄋㄌㄍㄎㄏㄓㄗㄘㄙ */ ) == 0,
+		"class of initials shall be accepted" );
+	chewing_set_fuzzyPhone( ctx, 1 );
+
+	/* The fuzzy match from the system dictionary is still found. */
+	type_keystroke_by_string( ctx, "2j/ jp6" ); /* ㄉㄨㄥ ㄨㄣˊ */
+	ok_preedit_buffer( ctx, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ );
+
+	chewing_delete( ctx );
+}
+
+void test_layer_missing_directory()
+{
+	ChewingContext *ctx;
+
+	putenv( "CHEWING_DICT_PATH=" CHEWING_DATA_PREFIX "_no_such_path" );
+	ctx = chewing_new();
+	ok( ctx != NULL, "directory without dictionary shall be skipped" );
+
+	type_keystroke_by_string( ctx, "hk4g4" );
+	ok_preedit_buffer( ctx, PHRASE );
+
+	chewing_delete( ctx );
+}
+
+int main()
+{
+	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
+	putenv( "CHEWING_USER_PATH=" TEST_HASH_DIR );
+
+	remove( PROFILE PLAT_SEPARATOR HASH_FILE );
+
+	test_layer_same_dictionary();
+	test_layer_new_phrase();
+	test_layer_merge_order();
+	test_layer_tie_order();
+	test_layer_fuzzy_system_phrase();
+	test_layer_missing_directory();
+
+	return exit_status();
+}
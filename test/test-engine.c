@@ -0,0 +1,145 @@
+/**
+ * test-engine.c
+ *
+ * Copyright (c) 2013
+ *      libchewing Core Team. See ChangeLog for details.
+ *
+ * See the file "COPYING" for information on usage and redistribution
+ * of this file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "chewing.h"
+#include "plat_types.h"
+#include "plat_thread.h"
+#include "hash-private.h"
+#include "testhelper.h"
+
+#define PROFILE_A TEST_HASH_DIR PLAT_SEPARATOR "engine-a"
+#define PROFILE_B TEST_HASH_DIR PLAT_SEPARATOR "engine-b"
+
+#define THREAD_NUM 4
+#define THREAD_LOOP 200
+
+static const char PHRASE[] = "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */;
+static const char BOPOMOFO[] = "\xE3\x84\x98\xE3\x84\x9C\xCB\x8B \xE3\x84\x95\xCB\x8B" /* ㄘㄜˋ ㄕˋ */;
+
+static const char CHINESE[] = "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */;
+
+void test_engine_share_userphrase()
+{
+	ChewingEngine *engine;
+	ChewingContext *ctx_a1;
+	ChewingContext *ctx_a2;
+	ChewingContext *ctx_b;
+
+	remove( PROFILE_A PLAT_SEPARATOR HASH_FILE );
+	remove( PROFILE_B PLAT_SEPARATOR HASH_FILE );
+
+	engine = chewing_engine_new();
+	ok( engine != NULL, "chewing_engine_new shall not return NULL" );
+
+	ctx_a1 = chewing_engine_new_session( engine, PROFILE_A );
+	ctx_a2 = chewing_engine_new_session( engine, PROFILE_A );
+	ctx_b = chewing_engine_new_session( engine, PROFILE_B );
+	ok( ctx_a1 && ctx_a2 && ctx_b, "chewing_engine_new_session shall not return NULL" );
+
+	type_keystroke_by_string( ctx_a1, "hk4g4<SL><SL><E>" );
+	ok_preedit_buffer( ctx_a1, PHRASE );
+
+	ok( has_userphrase( ctx_a2, BOPOMOFO, PHRASE ) == 1,
+		"`%s' shall be shared by sessions of the same profile", PHRASE );
+	ok( has_userphrase( ctx_b, BOPOMOFO, PHRASE ) == 0,
+		"`%s' shall not be shared by sessions of another profile", PHRASE );
+
+	chewing_delete( ctx_a1 );
+	chewing_delete( ctx_a2 );
+	chewing_delete( ctx_b );
+	chewing_engine_delete( engine );
+}
+
+void test_engine_session_outlive_engine()
+{
+	ChewingEngine *engine;
+	ChewingContext *ctx;
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, PROFILE_B );
+	chewing_engine_delete( engine );
+
+	type_keystroke_by_string( ctx, "5j/ jp6" );
+	ok_preedit_buffer( ctx, CHINESE );
+
+	chewing_delete( ctx );
+}
+
+typedef struct {
+	ChewingContext *ctx;
+	int error;
+} SessionThread;
+
+static void *TypeInSession( void *arg )
+{
+	SessionThread *st = (SessionThread *) arg;
+	char *buf;
+	int i;
+
+	for ( i = 0; i < THREAD_LOOP; i++ ) {
+		chewing_handle_String( st->ctx, "5j/ jp6" );
+		buf = chewing_buffer_String( st->ctx );
+		if ( strcmp( buf, CHINESE ) != 0 )
+			st->error++;
+		chewing_free( buf );
+		/* Commit to keep the user dictionary updated concurrently */
+		chewing_handle_Enter( st->ctx );
+	}
+	return NULL;
+}
+
+void test_engine_concurrent_sessions()
+{
+	ChewingEngine *engine;
+	SessionThread st[ THREAD_NUM ];
+	plat_thread thread[ THREAD_NUM ];
+	int started[ THREAD_NUM ];
+	int i;
+
+	engine = chewing_engine_new();
+
+	for ( i = 0; i < THREAD_NUM; i++ ) {
+		st[ i ].ctx = chewing_engine_new_session( engine, PROFILE_B );
+		st[ i ].error = 0;
+	}
+	/* Learning updates of all sessions go through one writer thread. */
+	ok( chewing_set_backgroundWrite( st[ 0 ].ctx, 1 ) == 0, "background write shall be enabled" );
+	for ( i = 0; i < THREAD_NUM; i++ )
+		started[ i ] = plat_thread_create( &thread[ i ], TypeInSession, &st[ i ] ) == 0;
+	for ( i = 0; i < THREAD_NUM; i++ ) {
+		ok( started[ i ], "thread %d shall be started", i );
+		if ( started[ i ] )
+			plat_thread_join( thread[ i ] );
+		ok( st[ i ].error == 0, "session %d shall type `%s' every time", i, CHINESE );
+		chewing_delete( st[ i ].ctx );
+	}
+
+	chewing_engine_delete( engine );
+}
+
+int main()
+{
+	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
+	putenv( "CHEWING_USER_PATH=" TEST_HASH_DIR );
+
+	test_engine_share_userphrase();
+	test_engine_session_outlive_engine();
+	test_engine_concurrent_sessions();
+
+	return exit_status();
+}
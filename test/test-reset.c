@@ -12,12 +12,18 @@
 #include <config.h>
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "chewing.h"
+#include "plat_types.h"
+#include "hash-private.h"
 #include "testhelper.h"
 
+static const char PHRASE[] = "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */;
+static const char BOPOMOFO[] = "\xE3\x84\x98\xE3\x84\x9C\xCB\x8B \xE3\x84\x95\xCB\x8B" /* ㄘㄜˋ ㄕˋ */;
+
 void test_reset_shall_not_clean_static_data()
 {
 	const TestData DATA = { "hk4g4<E>", "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */ };
@@ -41,8 +47,47 @@ void test_reset_shall_not_clean_static_data()
 	chewing_delete( ctx );
 }
 
+void test_new_from_template()
+{
+	ChewingContext *tmpl, *ctx, *ctx2;
+
+	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
+	putenv( "CHEWING_USER_PATH=" TEST_HASH_DIR );
+	remove( TEST_HASH_DIR PLAT_SEPARATOR HASH_FILE );
+
+	tmpl = chewing_new();
+	chewing_set_candPerPage( tmpl, 5 );
+	chewing_set_maxChiSymbolLen( tmpl, 16 );
+	chewing_set_ShapeMode( tmpl, FULLSHAPE_MODE );
+
+	ctx = chewing_new_from_template( tmpl );
+	ok( ctx != NULL, "chewing_new_from_template shall return a context" );
+	ok( chewing_get_candPerPage( ctx ) == 5, "candPerPage shall be copied" );
+	ok( chewing_get_maxChiSymbolLen( ctx ) == 16, "maxChiSymbolLen shall be copied" );
+	ok( chewing_get_ShapeMode( ctx ) == FULLSHAPE_MODE, "shape mode shall be copied" );
+
+	chewing_set_ShapeMode( ctx, HALFSHAPE_MODE );
+	type_keystroke_by_string( ctx, "hk4g4<SL><SL><E>" );
+	ok( has_userphrase( tmpl, BOPOMOFO, PHRASE ) == 1,
+		"`%s' learned by the new context shall be seen by its template", PHRASE );
+	chewing_set_ShapeMode( ctx, FULLSHAPE_MODE );
+
+	ctx2 = chewing_new_from_template( ctx );
+	chewing_delete( tmpl );
+	chewing_delete( ctx );
+
+	chewing_set_ShapeMode( ctx2, HALFSHAPE_MODE );
+	type_keystroke_by_string( ctx2, "5j/ jp6" );
+	ok_preedit_buffer( ctx2, "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */ );
+	type_keystroke_by_string( ctx2, "<D>" );
+	ok( chewing_cand_TotalChoice( ctx2 ) > 0, "candidates shall be listed" );
+
+	chewing_delete( ctx2 );
+}
+
 int main ()
 {
 	test_reset_shall_not_clean_static_data();
+	test_new_from_template();
 	return exit_status();
 }
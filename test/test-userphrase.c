@@ -14,6 +14,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "chewing.h"
 #include "plat_types.h"
@@ -274,6 +275,163 @@ void test_userphrase()
 	test_userphrase_auto_learn_hardcode_break();
 }
 
+#define BACKGROUND_WRITE_PROFILE TEST_HASH_DIR PLAT_SEPARATOR "background-write"
+
+static long RecordOffset( int item_index )
+{
+	return item_index * FIELD_SIZE + 4 + strlen( BIN_HASH_SIG );
+}
+
+/* Size of the hash file in profile, or -1 */
+static long hash_file_size( const char *profile )
+{
+	char path[ 256 ];
+	FILE *fp;
+	long size;
+
+	snprintf( path, sizeof( path ), "%s" PLAT_SEPARATOR HASH_FILE, profile );
+	fp = fopen( path, "rb" );
+	if ( ! fp )
+		return -1;
+	fseek( fp, 0, SEEK_END );
+	size = ftell( fp );
+	fclose( fp );
+	return size;
+}
+
+void test_background_write_flush()
+{
+	static const char phrase[] = "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */;
+	static const char bopomofo[] = "\xE3\x84\x98\xE3\x84\x9C\xCB\x8B \xE3\x84\x95\xCB\x8B" /* ㄘㄜˋ ㄕˋ */;
+	ChewingEngine *engine;
+	ChewingEngine *engine_reload;
+	ChewingContext *ctx;
+	ChewingContext *ctx_reload;
+	int i;
+
+	remove( BACKGROUND_WRITE_PROFILE PLAT_SEPARATOR HASH_FILE );
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	ok( chewing_get_backgroundWrite( ctx ) == 0, "background write shall be disabled by default" );
+	ok( chewing_set_backgroundWrite( ctx, 1 ) == 0, "background write shall be enabled" );
+	ok( chewing_get_backgroundWrite( ctx ) == 1, "background write shall be enabled" );
+
+	/* learn the same phrase repeatedly, so that its updates are coalesced */
+	for ( i = 0; i < 3; i++ )
+		type_keystroke_by_string( ctx, "hk4g4<SL><SL><E>" );
+	ok( has_userphrase( ctx, bopomofo, phrase ) == 1,
+		"`%s' shall be in userphrase", phrase );
+	chewing_flush( ctx );
+	ok( hash_file_size( BACKGROUND_WRITE_PROFILE ) == RecordOffset( 1 ),
+		"updates of `%s' shall be written to one record", phrase );
+
+	/* another engine loads the user dictionary from disk */
+	engine_reload = chewing_engine_new();
+	ctx_reload = chewing_engine_new_session( engine_reload, BACKGROUND_WRITE_PROFILE );
+	ok( has_userphrase( ctx_reload, bopomofo, phrase ) == 1,
+		"`%s' shall be written by chewing_flush", phrase );
+	ok( userphrase_freq( ctx_reload, bopomofo, phrase ) == userphrase_freq( ctx, bopomofo, phrase ),
+		"the last update of `%s' shall be written by chewing_flush", phrase );
+
+	ok( chewing_set_backgroundWrite( ctx, 0 ) == 0, "background write shall be disabled" );
+	ok( chewing_get_backgroundWrite( ctx ) == 0, "background write shall be disabled" );
+
+	chewing_delete( ctx_reload );
+	chewing_engine_delete( engine_reload );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+}
+
+void test_background_write_delete()
+{
+	static const char phrase[] = "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */;
+	static const char bopomofo[] = "\xE3\x84\x93\xE3\x84\xA8\xE3\x84\xA5 \xE3\x84\xA8\xE3\x84\xA3\xCB\x8A" /* ㄓㄨㄥ ㄨㄣˊ */;
+	ChewingEngine *engine;
+	ChewingContext *ctx;
+
+	remove( BACKGROUND_WRITE_PROFILE PLAT_SEPARATOR HASH_FILE );
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	chewing_set_backgroundWrite( ctx, 1 );
+	type_keystroke_by_string( ctx, "5j/ jp6<SL><SL><E>" );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	ok( has_userphrase( ctx, bopomofo, phrase ) == 1,
+		"`%s' shall be written by chewing_delete", phrase );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+}
+
+void test_background_write_shared_file()
+{
+	static const char phrase[] = "\xE6\xB8\xAC\xE8\xA9\xA6" /* 測試 */;
+	static const char bopomofo[] = "\xE3\x84\x98\xE3\x84\x9C\xCB\x8B \xE3\x84\x95\xCB\x8B" /* ㄘㄜˋ ㄕˋ */;
+	static const char phrase2[] = "\xE4\xB8\xAD\xE6\x96\x87" /* 中文 */;
+	static const char bopomofo2[] = "\xE3\x84\x93\xE3\x84\xA8\xE3\x84\xA5 \xE3\x84\xA8\xE3\x84\xA3\xCB\x8A" /* ㄓㄨㄥ ㄨㄣˊ */;
+	ChewingEngine *engine;
+	ChewingEngine *engine2;
+	ChewingContext *ctx;
+	ChewingContext *ctx2;
+
+	remove( BACKGROUND_WRITE_PROFILE PLAT_SEPARATOR HASH_FILE );
+
+	/* a template and its clone learn different phrases */
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	chewing_set_backgroundWrite( ctx, 1 );
+	ctx2 = chewing_new_from_template( ctx );
+	type_keystroke_by_string( ctx, "hk4g4<SL><SL><E>" );
+	type_keystroke_by_string( ctx2, "5j/ jp6<SL><SL><E>" );
+	chewing_delete( ctx2 );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	ok( has_userphrase( ctx, bopomofo, phrase ) == 1,
+		"`%s' learned in template shall be written", phrase );
+	ok( has_userphrase( ctx, bopomofo2, phrase2 ) == 1,
+		"`%s' learned in clone shall be written", phrase2 );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+
+	remove( BACKGROUND_WRITE_PROFILE PLAT_SEPARATOR HASH_FILE );
+
+	/* two engines open the same file and learn different phrases */
+	engine = chewing_engine_new();
+	engine2 = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	ctx2 = chewing_engine_new_session( engine2, BACKGROUND_WRITE_PROFILE );
+	chewing_set_backgroundWrite( ctx, 1 );
+	type_keystroke_by_string( ctx, "hk4g4<SL><SL><E>" );
+	type_keystroke_by_string( ctx2, "5j/ jp6<SL><SL><E>" );
+	chewing_delete( ctx2 );
+	chewing_engine_delete( engine2 );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+
+	engine = chewing_engine_new();
+	ctx = chewing_engine_new_session( engine, BACKGROUND_WRITE_PROFILE );
+	ok( has_userphrase( ctx, bopomofo, phrase ) == 1,
+		"`%s' learned in one engine shall be written", phrase );
+	ok( has_userphrase( ctx, bopomofo2, phrase2 ) == 1,
+		"`%s' learned in another engine shall be written", phrase2 );
+	chewing_delete( ctx );
+	chewing_engine_delete( engine );
+}
+
+void test_background_write()
+{
+	test_background_write_flush();
+	test_background_write_delete();
+	test_background_write_shared_file();
+}
+
 int main()
 {
 	putenv( "CHEWING_PATH=" CHEWING_DATA_PREFIX );
@@ -283,6 +441,7 @@ int main()
 	test_ShiftRight();
 	test_CtrlNum();
 	test_userphrase();
+	test_background_write();
 
 	return exit_status();
 }
@@ -387,8 +387,7 @@ void internal_ok_keystroke_rtn( const char *file, int line,
 	}
 }
 
-int internal_has_userphrase( const char *file UNUSED, int line UNUSED,
-	ChewingContext *ctx, const char *bopomofo, const char *phrase )
+static HASH_ITEM *find_userphrase( ChewingContext *ctx, const char *bopomofo, const char *phrase )
 {
 	KeySeqWord *phone = NULL;
 	char *bopomofo_buf = NULL;
@@ -396,7 +395,6 @@ int internal_has_userphrase( const char *file UNUSED, int line UNUSED,
 	char *p;
 	char *save_ptr = NULL;
 	HASH_ITEM *item = NULL;
-	int ret = 0;
 
 	phone = calloc( MAX_PHONE_SEQ_LEN, sizeof (*phone) );
 	if ( !phone ) {
@@ -417,17 +415,28 @@ int internal_has_userphrase( const char *file UNUSED, int line UNUSED,
 	}
 
 	while ( ( item = HashFindPhonePhrase( ctx->data, phone, item ) ) != NULL ) {
-		if ( phrase == NULL || strcmp( item->data.wordSeq, phrase ) == 0 ) {
-			ret = 1;
-			goto end;
-		}
+		if ( phrase == NULL || strcmp( item->data.wordSeq, phrase ) == 0 )
+			break;
 	}
 
 end:
 	free( bopomofo_buf );
 	free( phone );
 
-	return ret;
+	return item;
+}
+
+int internal_has_userphrase( const char *file UNUSED, int line UNUSED,
+	ChewingContext *ctx, const char *bopomofo, const char *phrase )
+{
+	return find_userphrase( ctx, bopomofo, phrase ) != NULL;
+}
+
+int userphrase_freq( ChewingContext *ctx, const char *bopomofo, const char *phrase )
+{
+	HASH_ITEM *item = find_userphrase( ctx, bopomofo, phrase );
+
+	return item ? item->data.userfreq : -1;
 }
 
 int exit_status()
@@ -84,6 +84,7 @@ typedef int (*get_char_func) ( void *param );
 int get_keystroke( get_char_func get_char, void *param );
 void type_keystroke_by_string( ChewingContext *ctx, char* keystroke );
 void type_single_keystroke( ChewingContext *ctx, int ch );
+int userphrase_freq( ChewingContext *ctx, const char *bopomofo, const char *phrase );
 int exit_status();
 
 // The internal_xxx function shall be used indirectly by macro in order to